@@ -9,5 +9,13 @@
 #include "fiber.h"
 #include "mutex.h"
 #include "scheduler.h"
+#include "fiber_sync.h"
+#include "channel.h"
+#include "future.h"
+#include "spawn_scope.h"
+#include "parallel.h"
+#ifdef AWCOTN_COROUTINE
+#include "coroutine.h"
+#endif
 
 #endif
\ No newline at end of file
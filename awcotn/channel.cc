@@ -0,0 +1,78 @@
+#include "channel.h"
+#include <algorithm>
+
+namespace awcotn {
+
+//select轮转的起点
+static thread_local uint32_t t_select_seq = 0;
+
+ChannelSelect::~ChannelSelect() {
+    for(auto c : m_cases) {
+        delete c;
+    }
+}
+
+void ChannelSelect::lockAll() {
+    for(auto ch : m_channels) {
+        ch->m_lock.lock();
+    }
+}
+
+void ChannelSelect::unlockAll() {
+    for(auto it = m_channels.rbegin(); it != m_channels.rend(); ++it) {
+        (*it)->m_lock.unlock();
+    }
+}
+
+int ChannelSelect::select(bool block) {
+    AWCOTN_ASSERT2(!m_cases.empty(), "select without cases");
+    if(m_channels.empty()) {
+        for(auto c : m_cases) {
+            m_channels.push_back(c->getChannel());
+        }
+        std::sort(m_channels.begin(), m_channels.end());
+        m_channels.erase(std::unique(m_channels.begin(), m_channels.end()), m_channels.end());
+    }
+
+    //持有所有通道的锁尝试和登记, 期间其它操作看不到这次select
+    lockAll();
+    size_t n = m_cases.size();
+    size_t start = t_select_seq++ % n;
+    for(size_t k = 0; k < n; ++k) {
+        size_t i = (start + k) % n;
+        FiberWaitQueue::Waiter* woken = nullptr;
+        if(m_cases[i]->tryLocked(woken)) {
+            unlockAll();
+            if(woken) {
+                FiberWaitQueue::Wake(woken);
+            }
+            return i;
+        }
+    }
+    if(!block) {
+        unlockAll();
+        return -1;
+    }
+
+    ChannelWaitState* state = NewNode<ChannelWaitState>();
+    state->waiter = FiberWaitQueue::NewWaiter();
+    for(size_t i = 0; i < n; ++i) {
+        m_cases[i]->enqueueLocked(state, i);
+    }
+    unlockAll();
+
+    FiberWaitQueue::Park(state->waiter);
+
+    //被选中的分支已经由对方移出队列, 其余的在这里移除
+    int fired = state->fired;
+    lockAll();
+    for(auto c : m_cases) {
+        c->dequeueLocked();
+    }
+    unlockAll();
+    DeleteNode(state);
+    m_cases[fired]->finish();
+    return fired;
+}
+
+}
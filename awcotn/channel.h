@@ -0,0 +1,567 @@
+#ifndef __AWCOTN_CHANNEL_H__
+#define __AWCOTN_CHANNEL_H__
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fiber_sync.h"
+#include "node_pool.h"
+#include "macro.h"
+
+namespace awcotn {
+
+/**
+ * @brief 一次阻塞的send/recv/select, select时挂在多个通道的等待队列上
+ * @details 对方持有通道锁时通过fire抢占, 成功的一方完成操作并负责唤醒
+ */
+struct ChannelWaitState {
+    //被完成的分支下标, -1表示还在等待
+    std::atomic<int> fired = {-1};
+    FiberWaitQueue::Waiter* waiter = nullptr;
+
+    bool fire(int index) {
+        int expect = -1;
+        return fired.compare_exchange_strong(expect, index);
+    }
+};
+
+/**
+ * @brief 通道的公共部分, select按地址顺序对各通道加锁
+ */
+class ChannelBase : Noncopyable {
+friend class ChannelSelect;
+public:
+    virtual ~ChannelBase() {}
+
+protected:
+    enum Result {
+        OK,
+        NOT_READY,
+        CLOSED
+    };
+
+    //唤醒完成了操作的对方
+    static void WakePeer(FiberWaitQueue::Waiter* w) {
+        if(w) {
+            FiberWaitQueue::Wake(w);
+        }
+    }
+
+protected:
+    Spinlock m_lock;
+};
+
+/**
+ * @brief select的一个分支, 除finish外都在持有通道锁时调用
+ */
+class ChannelCase {
+public:
+    ChannelCase(ChannelBase* channel)
+        : m_channel(channel) {
+    }
+    virtual ~ChannelCase() {}
+
+    ChannelBase* getChannel() const { return m_channel; }
+
+    //不阻塞地执行, 完成(包括通道已关闭)返回true, woken为需要唤醒的对方
+    virtual bool tryLocked(FiberWaitQueue::Waiter*& woken) = 0;
+    //加入通道的等待队列
+    virtual void enqueueLocked(ChannelWaitState* state, int index) = 0;
+    //从等待队列移除(没有被选中的分支)
+    virtual void dequeueLocked() = 0;
+    //被对方完成后取出结果
+    virtual void finish() = 0;
+
+protected:
+    ChannelBase* m_channel;
+};
+
+/**
+ * @brief 有界多生产者多消费者通道
+ * @details
+ * 1. 环形缓冲区, 满时send挂起当前协程(不在任务协程中时阻塞线程), 空时recv挂起, 形成背压
+ * 2. 有等待的接收方时send把值直接移动给它, 不经过缓冲区; 值只移动不拷贝, 可以传递只能移动的类型
+ * 3. capacity为0时是无缓冲通道, send等到有接收方取走才返回
+ * 4. 被唤醒的一方通过调度器重新执行, 在同一线程上时进入本地队列(后进先出),
+ *    当前协程挂起后紧接着执行; 不用Scheduler::YieldTo直接切换, 那样会在当前协程
+ *    走到自己的recv之前就把它换下去, 一问一答时反而多切换
+ * 5. close后send返回false, recv取完缓冲区剩余的值后返回false, 等待中的双方都被唤醒
+ * 6. 配合ChannelSelect可以同时等待多个通道
+ */
+template<class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    /**
+     * @param[in] capacity 缓冲区大小, 0为无缓冲
+     */
+    explicit Channel(size_t capacity)
+        : m_capacity(capacity) {
+        if(m_capacity) {
+            m_buf = static_cast<T*>(::operator new(sizeof(T) * m_capacity));
+        }
+    }
+
+    ~Channel() {
+        AWCOTN_ASSERT2(!m_recvq.head && !m_sendq.head, "destroy channel with waiters");
+        while(m_size) {
+            popFront().~T();
+        }
+        ::operator delete(m_buf);
+    }
+
+    /**
+     * @brief 发送, 缓冲区满时等待
+     * @return 通道已关闭返回false, 值被丢弃
+     */
+    bool send(T&& value) {
+        return sendImpl(value);
+    }
+
+    bool send(const T& value) {
+        T tmp(value);
+        return sendImpl(tmp);
+    }
+
+    /**
+     * @brief 不等待的发送
+     * @return 成功返回true; 缓冲区满或通道已关闭返回false, 此时value不被移动
+     */
+    bool trySend(T&& value) {
+        FiberWaitQueue::Waiter* woken = nullptr;
+        Spinlock::Lock lock(m_lock);
+        if(trySendLocked(value, woken) != OK) {
+            return false;
+        }
+        lock.unlock();
+        WakePeer(woken);
+        return true;
+    }
+
+    bool trySend(const T& value) {
+        T tmp(value);
+        return trySend(std::move(tmp));
+    }
+
+    /**
+     * @brief 接收, 没有数据时等待
+     * @return 通道已关闭且没有剩余数据返回false
+     */
+    bool recv(T& out) {
+        FiberWaitQueue::Waiter* woken = nullptr;
+        Spinlock::Lock lock(m_lock);
+        int rt = tryRecvLocked(out, woken);
+        if(rt != NOT_READY) {
+            lock.unlock();
+            WakePeer(woken);
+            return rt == OK;
+        }
+        Entry* e = NewNode<Entry>();
+        ChannelWaitState* state = NewNode<ChannelWaitState>();
+        e->state = state;
+        state->waiter = FiberWaitQueue::NewWaiter();
+        m_recvq.push(e);
+        lock.unlock();
+
+        FiberWaitQueue::Park(state->waiter);
+        //被唤醒时发送方已经把值放入e并移出队列
+        bool ok = e->ok;
+        if(ok) {
+            out = std::move(*e->value());
+        }
+        freeEntry(e);
+        DeleteNode(state);
+        return ok;
+    }
+
+    /**
+     * @brief 不等待的接收, 没有数据(或已关闭)返回false
+     */
+    bool tryRecv(T& out) {
+        FiberWaitQueue::Waiter* woken = nullptr;
+        Spinlock::Lock lock(m_lock);
+        if(tryRecvLocked(out, woken) != OK) {
+            return false;
+        }
+        lock.unlock();
+        WakePeer(woken);
+        return true;
+    }
+
+    //关闭通道, 重复关闭无效
+    void close() {
+        FiberWaitQueue::Waiter* head = nullptr;
+        {
+            Spinlock::Lock lock(m_lock);
+            if(m_closed) {
+                return;
+            }
+            m_closed = true;
+            EntryList* queues[] = {&m_recvq, &m_sendq};
+            for(EntryList* q : queues) {
+                while(Entry* e = popWaiter(*q)) {
+                    e->ok = false;
+                    FiberWaitQueue::Waiter* w = e->state->waiter;
+                    w->next = head;
+                    head = w;
+                }
+            }
+        }
+        FiberWaitQueue::WakeAll(head);
+    }
+
+    bool isClosed() {
+        Spinlock::Lock lock(m_lock);
+        return m_closed;
+    }
+
+    //缓冲区中的数据个数
+    size_t size() {
+        Spinlock::Lock lock(m_lock);
+        return m_size;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    /**
+     * @brief 等待队列中的一项
+     * @details 从NodePool分配而不是放在等待方的栈上, 共享栈协程切出后栈上的内容会被覆盖
+     */
+    struct Entry {
+        ChannelWaitState* state = nullptr;
+        int index = 0;
+        bool linked = false;
+        //操作完成(false表示因通道关闭被唤醒)
+        bool ok = false;
+        bool hasValue = false;
+        Entry* prev = nullptr;
+        Entry* next = nullptr;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T* value() { return reinterpret_cast<T*>(&storage); }
+    };
+
+    struct EntryList {
+        Entry* head = nullptr;
+        Entry* tail = nullptr;
+
+        void push(Entry* e) {
+            e->linked = true;
+            e->prev = tail;
+            e->next = nullptr;
+            if(tail) {
+                tail->next = e;
+            } else {
+                head = e;
+            }
+            tail = e;
+        }
+
+        void remove(Entry* e) {
+            if(e->prev) {
+                e->prev->next = e->next;
+            } else {
+                head = e->next;
+            }
+            if(e->next) {
+                e->next->prev = e->prev;
+            } else {
+                tail = e->prev;
+            }
+            e->prev = e->next = nullptr;
+            e->linked = false;
+        }
+    };
+
+    class RecvCase : public ChannelCase {
+    public:
+        RecvCase(Channel& ch, T& out, bool* ok)
+            : ChannelCase(&ch)
+            , m_ch(ch)
+            , m_out(out)
+            , m_ok(ok) {
+        }
+
+        ~RecvCase() {
+            if(m_entry) {
+                m_ch.freeEntry(m_entry);
+            }
+        }
+
+        bool tryLocked(FiberWaitQueue::Waiter*& woken) override {
+            int rt = m_ch.tryRecvLocked(m_out, woken);
+            if(rt == NOT_READY) {
+                return false;
+            }
+            setOk(rt == OK);
+            return true;
+        }
+
+        void enqueueLocked(ChannelWaitState* state, int index) override {
+            m_entry = NewNode<Entry>();
+            m_entry->state = state;
+            m_entry->index = index;
+            m_ch.m_recvq.push(m_entry);
+        }
+
+        void dequeueLocked() override {
+            if(m_entry && m_entry->linked) {
+                m_ch.m_recvq.remove(m_entry);
+            }
+        }
+
+        void finish() override {
+            if(m_entry->ok) {
+                m_out = std::move(*m_entry->value());
+            }
+            setOk(m_entry->ok);
+        }
+
+    private:
+        void setOk(bool v) {
+            if(m_ok) {
+                *m_ok = v;
+            }
+        }
+
+    private:
+        Channel& m_ch;
+        T& m_out;
+        bool* m_ok;
+        Entry* m_entry = nullptr;
+    };
+
+    class SendCase : public ChannelCase {
+    public:
+        SendCase(Channel& ch, T&& value, bool* ok)
+            : ChannelCase(&ch)
+            , m_ch(ch)
+            , m_value(std::move(value))
+            , m_ok(ok) {
+        }
+
+        ~SendCase() {
+            if(m_entry) {
+                m_ch.freeEntry(m_entry);
+            }
+        }
+
+        bool tryLocked(FiberWaitQueue::Waiter*& woken) override {
+            int rt = m_ch.trySendLocked(m_value, woken);
+            if(rt == NOT_READY) {
+                return false;
+            }
+            setOk(rt == OK);
+            return true;
+        }
+
+        void enqueueLocked(ChannelWaitState* state, int index) override {
+            m_entry = NewNode<Entry>();
+            m_entry->state = state;
+            m_entry->index = index;
+            new (m_entry->value()) T(std::move(m_value));
+            m_entry->hasValue = true;
+            m_ch.m_sendq.push(m_entry);
+        }
+
+        void dequeueLocked() override {
+            if(m_entry && m_entry->linked) {
+                m_ch.m_sendq.remove(m_entry);
+                //没有发出去的值放回来
+                m_value = std::move(*m_entry->value());
+                m_entry->value()->~T();
+                m_entry->hasValue = false;
+            }
+        }
+
+        void finish() override {
+            setOk(m_entry->ok);
+        }
+
+    private:
+        void setOk(bool v) {
+            if(m_ok) {
+                *m_ok = v;
+            }
+        }
+
+    private:
+        Channel& m_ch;
+        T m_value;
+        bool* m_ok;
+        Entry* m_entry = nullptr;
+    };
+
+    friend class ChannelSelect;
+
+    bool sendImpl(T& value) {
+        FiberWaitQueue::Waiter* woken = nullptr;
+        Spinlock::Lock lock(m_lock);
+        int rt = trySendLocked(value, woken);
+        if(rt != NOT_READY) {
+            lock.unlock();
+            WakePeer(woken);
+            return rt == OK;
+        }
+        Entry* e = NewNode<Entry>();
+        ChannelWaitState* state = NewNode<ChannelWaitState>();
+        e->state = state;
+        state->waiter = FiberWaitQueue::NewWaiter();
+        new (e->value()) T(std::move(value));
+        e->hasValue = true;
+        m_sendq.push(e);
+        lock.unlock();
+
+        FiberWaitQueue::Park(state->waiter);
+        //被接收方取走, 或通道关闭(值在freeEntry中析构)
+        bool ok = e->ok;
+        freeEntry(e);
+        DeleteNode(state);
+        return ok;
+    }
+
+    //取出队首还在等待的一项并抢占其等待状态, 已被其它通道完成的项直接移除
+    Entry* popWaiter(EntryList& q) {
+        while(Entry* e = q.head) {
+            q.remove(e);
+            if(e->state->fire(e->index)) {
+                return e;
+            }
+        }
+        return nullptr;
+    }
+
+    int trySendLocked(T& value, FiberWaitQueue::Waiter*& woken) {
+        if(m_closed) {
+            return CLOSED;
+        }
+        if(Entry* e = popWaiter(m_recvq)) {
+            new (e->value()) T(std::move(value));
+            e->hasValue = true;
+            e->ok = true;
+            woken = e->state->waiter;
+            return OK;
+        }
+        if(m_size < m_capacity) {
+            pushBack(std::move(value));
+            return OK;
+        }
+        return NOT_READY;
+    }
+
+    int tryRecvLocked(T& out, FiberWaitQueue::Waiter*& woken) {
+        if(m_size) {
+            T& front = m_buf[m_head];
+            out = std::move(front);
+            front.~T();
+            m_head = (m_head + 1) % m_capacity;
+            --m_size;
+            //缓冲区空出一个位置, 放入等待中的发送方的值
+            if(Entry* e = popWaiter(m_sendq)) {
+                pushBack(std::move(*e->value()));
+                takeEntryValue(e, woken);
+            }
+            return OK;
+        }
+        if(Entry* e = popWaiter(m_sendq)) {
+            out = std::move(*e->value());
+            takeEntryValue(e, woken);
+            return OK;
+        }
+        return m_closed ? CLOSED : NOT_READY;
+    }
+
+    void takeEntryValue(Entry* e, FiberWaitQueue::Waiter*& woken) {
+        e->value()->~T();
+        e->hasValue = false;
+        e->ok = true;
+        woken = e->state->waiter;
+    }
+
+    void pushBack(T&& value) {
+        new (&m_buf[(m_head + m_size) % m_capacity]) T(std::move(value));
+        ++m_size;
+    }
+
+    //只在析构时使用, 返回的引用需要调用方析构
+    T& popFront() {
+        T& v = m_buf[m_head];
+        m_head = (m_head + 1) % m_capacity;
+        --m_size;
+        return v;
+    }
+
+    void freeEntry(Entry* e) {
+        if(e->hasValue) {
+            e->value()->~T();
+        }
+        DeleteNode(e);
+    }
+
+private:
+    size_t m_capacity;
+    T* m_buf = nullptr;
+    size_t m_head = 0;
+    size_t m_size = 0;
+    bool m_closed = false;
+    EntryList m_recvq;
+    EntryList m_sendq;
+};
+
+/**
+ * @brief 同时等待多个通道的收发, 完成其中一个
+ * @details
+ * 1. 按添加顺序编号, wait/tryWait返回完成的分支下标
+ * 2. 多个分支同时可以完成时从轮转的起点选择, 避免总是选中第一个
+ * 3. 对已关闭通道的recv/send也算完成, 通过ok参数返回false
+ * 4. 每个对象只能wait一次
+ *
+ * 用法:
+ * @code
+ *   int v;
+ *   awcotn::ChannelSelect sel;
+ *   sel.recv(*in, v).send(*out, std::move(item));
+ *   switch(sel.wait()) { ... }
+ * @endcode
+ */
+class ChannelSelect : Noncopyable {
+public:
+    ~ChannelSelect();
+
+    template<class T>
+    ChannelSelect& recv(Channel<T>& ch, T& out, bool* ok = nullptr) {
+        m_cases.push_back(new typename Channel<T>::RecvCase(ch, out, ok));
+        return *this;
+    }
+
+    template<class T>
+    ChannelSelect& send(Channel<T>& ch, T value, bool* ok = nullptr) {
+        m_cases.push_back(new typename Channel<T>::SendCase(ch, std::move(value), ok));
+        return *this;
+    }
+
+    //等待直到某个分支完成, 返回其下标
+    int wait() { return select(true); }
+
+    //不等待, 没有可以完成的分支返回-1
+    int tryWait() { return select(false); }
+
+private:
+    int select(bool block);
+    void lockAll();
+    void unlockAll();
+
+private:
+    std::vector<ChannelCase*> m_cases;
+    //去重并按地址排序的通道, 加锁顺序一致避免死锁
+    std::vector<ChannelBase*> m_channels;
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "context.h"
+#include "macro.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifndef AWCOTN_FIBER_UCONTEXT
+/**
+ * void awcotn_swap_context(void** from_sp, void* to_sp)
+ * 把callee-saved寄存器压入当前栈, 栈顶写入*from_sp,
+ * 然后切到to_sp, 按相反顺序弹出寄存器并ret到目标上下文
+ */
+extern "C" void awcotn_swap_context(void** from_sp, void* to_sp);
+
+#if defined(__x86_64__)
+/**
+ * 栈帧布局(低地址 -> 高地址):
+ * [mxcsr|x87 cw] r15 r14 r13 r12 rbx rbp ret
+ */
+__asm__(
+    ".text\n"
+    ".globl awcotn_swap_context\n"
+    ".hidden awcotn_swap_context\n"
+    ".type awcotn_swap_context,@function\n"
+    ".align 16\n"
+    "awcotn_swap_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    leaq -8(%rsp), %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    leaq 8(%rsp), %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size awcotn_swap_context,.-awcotn_swap_context\n"
+);
+#elif defined(__aarch64__)
+/**
+ * 栈帧布局(176字节, 保持16字节对齐):
+ * x19-x28 [0,80) x29 x30 [80,96) d8-d15 [96,160) 填充 [160,176)
+ */
+__asm__(
+    ".text\n"
+    ".globl awcotn_swap_context\n"
+    ".hidden awcotn_swap_context\n"
+    ".type awcotn_swap_context,%function\n"
+    ".align 4\n"
+    "awcotn_swap_context:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size awcotn_swap_context,.-awcotn_swap_context\n"
+);
+#endif
+#endif
+
+namespace awcotn {
+
+#ifdef AWCOTN_FIBER_UCONTEXT
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+    if(getcontext(&ctx->uc)) {
+        AWCOTN_ASSERT2(false, "getcontext");
+    }
+    ctx->uc.uc_link = nullptr;
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = size;
+    makecontext(&ctx->uc, fn, 0);
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    if(swapcontext(&from->uc, &to->uc)) {
+        AWCOTN_ASSERT2(false, "swapcontext");
+    }
+}
+
+void* FiberContextStackPointer(const FiberContext* ctx) {
+#if defined(__x86_64__)
+    return (void*)ctx->uc.uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+    return (void*)ctx->uc.uc_mcontext.sp;
+#else
+    return nullptr;
+#endif
+}
+
+const char* FiberContextBackend() {
+    return "ucontext";
+}
+
+#else
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)top;
+#if defined(__x86_64__)
+    // fn入口处要求 (rsp + 8) 16字节对齐, ret弹出fn后rsp = top - 8
+    *--sp = 0;              // fn的返回地址, fn不允许返回
+    *--sp = (uintptr_t)fn;  // ret的目标
+    for(int i = 0; i < 6; ++i) {
+        *--sp = 0;          // rbp rbx r12 r13 r14 r15
+    }
+    // 低32位mxcsr, 高32位低16位x87控制字, 都使用默认值
+    *--sp = ((uint64_t)0x037F << 32) | 0x1F80;
+#elif defined(__aarch64__)
+    sp -= 176 / sizeof(uint64_t);
+    memset(sp, 0, 176);
+    sp[11] = (uintptr_t)fn; // x30, ret的目标
+#endif
+    ctx->sp = sp;
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    awcotn_swap_context(&from->sp, to->sp);
+}
+
+void* FiberContextStackPointer(const FiberContext* ctx) {
+    return ctx->sp;
+}
+
+const char* FiberContextBackend() {
+#if defined(__x86_64__)
+    return "asm-x86_64";
+#else
+    return "asm-aarch64";
+#endif
+}
+
+#endif
+
+}
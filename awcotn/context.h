@@ -0,0 +1,71 @@
+#ifndef __AWCOTN_CONTEXT_H__
+#define __AWCOTN_CONTEXT_H__
+
+#include <stddef.h>
+
+/**
+ * 协程上下文切换后端(编译期选择)
+ * 默认: x86-64/aarch64 上使用手写汇编, 只保存callee-saved寄存器,
+ *       不走rt_sigprocmask系统调用, 不保存完整FPU状态
+ * AWCOTN_FIBER_UCONTEXT: 使用glibc的ucontext(getcontext/makecontext/swapcontext)
+ * 其它体系结构自动回退到ucontext
+ */
+#if !defined(AWCOTN_FIBER_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define AWCOTN_FIBER_UCONTEXT
+#endif
+
+#ifdef AWCOTN_FIBER_UCONTEXT
+#include <ucontext.h>
+#endif
+
+/**
+ * 能否取得挂起上下文的栈指针, 共享栈(拷贝栈)模式依赖它
+ * 汇编后端总是可以, ucontext后端只支持x86-64/aarch64
+ */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define AWCOTN_FIBER_CONTEXT_HAS_SP
+#endif
+
+namespace awcotn {
+
+/**
+ * @brief 协程上下文
+ */
+struct FiberContext {
+#ifdef AWCOTN_FIBER_UCONTEXT
+    ucontext_t uc;
+#else
+    // 挂起时保存寄存器后的栈顶指针
+    void* sp = nullptr;
+#endif
+};
+
+/**
+ * @brief 在指定栈上初始化上下文, 切入后从fn开始执行
+ * @param[out] ctx 上下文
+ * @param[in] stack 栈内存起始地址
+ * @param[in] size 栈大小
+ * @param[in] fn 入口函数, 不允许返回
+ */
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)());
+
+/**
+ * @brief 保存当前上下文到from, 切换到to
+ */
+void SwapFiberContext(FiberContext* from, FiberContext* to);
+
+/**
+ * @brief 返回挂起上下文保存的栈指针
+ * @details 栈上[sp, 栈顶)是恢复执行需要的全部内容
+ *          未定义AWCOTN_FIBER_CONTEXT_HAS_SP时返回nullptr
+ */
+void* FiberContextStackPointer(const FiberContext* ctx);
+
+/**
+ * @brief 返回当前编译使用的上下文切换后端名称
+ */
+const char* FiberContextBackend();
+
+}
+
+#endif
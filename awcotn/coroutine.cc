@@ -0,0 +1,97 @@
+#include "coroutine.h"
+#include "iomanager.h"
+#include "node_pool.h"
+#include "macro.h"
+#include <errno.h>
+
+namespace awcotn {
+
+void CoResume(Scheduler* scheduler, std::coroutine_handle<> h) {
+    AWCOTN_ASSERT2(scheduler, "resume coroutine without scheduler");
+    scheduler->scheduleInline(Task(h));
+}
+
+//同步原语唤醒等待的协程, 节点由这里释放
+static void ResumeWaiter(FiberWaitQueue::Waiter* w) {
+    Scheduler* scheduler = w->scheduler;
+    std::coroutine_handle<> h = std::coroutine_handle<>::from_address(w->arg);
+    DeleteNode(w);
+    CoResume(scheduler, h);
+}
+
+bool CoSyncAwaiter::await_suspend(std::coroutine_handle<> h) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    AWCOTN_ASSERT2(scheduler, "co_await sync primitive outside scheduler");
+    FiberWaitQueue::Waiter* w = NewNode<FiberWaitQueue::Waiter>();
+    w->scheduler = scheduler;
+    w->callback = &ResumeWaiter;
+    w->arg = h.address();
+    if(m_enqueue(m_obj, w)) {
+        DeleteNode(w);
+        return false;
+    }
+    //入队后可能已经在别的线程被唤醒, 不能再访问this
+    return true;
+}
+
+CoTask<void> CoWait(FiberCondVar& cond, FiberMutex& mutex) {
+    struct Context {
+        FiberCondVar* cond;
+        FiberMutex* mutex;
+    } ctx{&cond, &mutex};
+    //先入队再解锁, 解锁后的notify不会丢失
+    co_await CoSyncAwaiter(&ctx, [](void* obj, FiberWaitQueue::Waiter* w){
+        Context* ctx = static_cast<Context*>(obj);
+        ctx->cond->enqueue(w);
+        ctx->mutex->unlock();
+        return false;
+    }, false);
+    co_await CoLock(mutex);
+}
+
+bool CoEventAwaiter::await_suspend(std::coroutine_handle<> h) {
+    IOManager::Event event = (IOManager::Event)m_event;
+    if(m_timeout != (uint64_t)-1) {
+        m_cancelled = std::make_shared<int>(0);
+        std::weak_ptr<int> wcancelled(m_cancelled);
+        IOManager* iom = m_iom;
+        int fd = m_fd;
+        m_timer = m_iom->addConditionTimer(m_timeout, [wcancelled, iom, fd, event](){
+            auto c = wcancelled.lock();
+            if(!c || *c) {
+                return;
+            }
+            *c = ETIMEDOUT;
+            iom->cancelEvent(fd, event);
+        }, wcancelled, false, true);
+    }
+    if(m_iom->addEvent(m_fd, event, Task(h), true)) {
+        if(m_timer) {
+            m_timer->cancel();
+        }
+        m_rt = -1;
+        return false;
+    }
+    //事件可能已经触发并在别的线程恢复了协程, 不能再访问this
+    return true;
+}
+
+int CoEventAwaiter::await_resume() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    if(m_rt) {
+        return m_rt;
+    }
+    if(m_cancelled && *m_cancelled) {
+        errno = *m_cancelled;
+        return -1;
+    }
+    return 0;
+}
+
+void CoSleepAwaiter::await_suspend(std::coroutine_handle<> h) {
+    m_timers->addTimer(m_ms, Task(h), false, true);
+}
+
+}
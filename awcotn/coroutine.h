@@ -0,0 +1,312 @@
+#ifndef __AWCOTN_COROUTINE_H__
+#define __AWCOTN_COROUTINE_H__
+
+#if !defined(AWCOTN_COROUTINE) || !defined(__cpp_impl_coroutine)
+#error "coroutine.h requires C++20, configure with -DCXX20_COROUTINE=ON"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "fiber_sync.h"
+#include "future.h"
+#include "scheduler.h"
+#include "timer.h"
+
+namespace awcotn {
+
+class IOManager;
+
+/**
+ * @brief C++20无栈协程与调度器的适配
+ * @details
+ * 1. 协程挂起时只保留堆上的协程帧(通常几百字节), 不占用协程栈; 适合大量小的协议状态机
+ * 2. 协程由调度器恢复: CoResume以不会阻塞的回调(scheduleInline)在工作线程的调度协程上直接执行,
+ *    不占用回调协程; coroutine_handle本身可调用, 也可以直接schedule(h)在回调协程中恢复
+ * 3. 等待的对象: IOManager的fd就绪(readable/writable)和定时器(sleepFor),
+ *    协程同步原语(CoLock/CoWait等), 另一个CoTask(co_await task)
+ * 4. 协程中不能调用会挂起协程的阻塞接口(如hook后的read/sleep, FiberMutex::lock), 应使用对应的co_await
+ */
+
+//在scheduler上恢复h
+void CoResume(Scheduler* scheduler, std::coroutine_handle<> h);
+
+//所有协程的恢复共用coroutine_handle类型, 栈统计不按它分入口
+template<class P>
+struct TaskSharedEntry<std::coroutine_handle<P> > : std::true_type {
+};
+
+template<class T>
+class CoTask;
+
+struct CoPromiseBase {
+    //执行完成后恢复的调用方(co_await这个任务的协程)
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template<class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> c = h.promise().continuation;
+            return c ? c : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<class T>
+struct CoPromise : CoPromiseBase {
+    std::optional<T> value;
+
+    CoTask<T> get_return_object();
+
+    template<class U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+    T result() {
+        if(exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct CoPromise<void> : CoPromiseBase {
+    CoTask<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if(exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+/**
+ * @brief 惰性启动的协程任务, co_await时才开始执行, 结束后对称转移回等待方
+ * @details 只能移动; 析构时销毁协程帧, 不能在任务执行中析构
+ */
+template<class T = void>
+class CoTask {
+public:
+    typedef CoPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    CoTask() = default;
+    explicit CoTask(handle_type h)
+        :m_handle(h) {
+    }
+    CoTask(CoTask&& rhs) noexcept
+        :m_handle(std::exchange(rhs.m_handle, nullptr)) {
+    }
+    CoTask& operator=(CoTask&& rhs) noexcept {
+        if(this != &rhs) {
+            reset();
+            m_handle = std::exchange(rhs.m_handle, nullptr);
+        }
+        return *this;
+    }
+    ~CoTask() { reset(); }
+
+    bool valid() const { return (bool)m_handle; }
+    bool isDone() const { return m_handle && m_handle.done(); }
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    void reset() {
+        if(m_handle) {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+private:
+    handle_type m_handle;
+};
+
+template<class T>
+CoTask<T> CoPromise<T>::get_return_object() {
+    return CoTask<T>(std::coroutine_handle<CoPromise<T> >::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object() {
+    return CoTask<void>(std::coroutine_handle<CoPromise<void> >::from_promise(*this));
+}
+
+//CoSpawn的外层协程, 结束后自动销毁
+struct CoDetached {
+    struct promise_type {
+        CoDetached get_return_object() noexcept {
+            return CoDetached{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<class T>
+CoDetached CoRunInto(CoTask<T> task, Promise<T> promise) {
+    try {
+        if constexpr(std::is_void<T>::value) {
+            co_await task;
+            promise.setValue();
+        } else {
+            promise.setValue(co_await task);
+        }
+    } catch(...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+/**
+ * @brief 在scheduler上启动task
+ * @return task的结果, 协程或普通线程可以通过Future等待
+ */
+template<class T>
+Future<T> CoSpawn(Scheduler* scheduler, CoTask<T> task) {
+    Promise<T> promise;
+    Future<T> rt = promise.getFuture();
+    CoResume(scheduler, CoRunInto(std::move(task), std::move(promise)).handle);
+    return rt;
+}
+
+/**
+ * @brief co_await CoSchedule(scheduler): 协程放到scheduler的队列中, 由它的工作线程恢复
+ * @details 用于把协程转到另一个调度器上执行, 或者在同一个调度器上让出
+ */
+class CoSchedule {
+public:
+    explicit CoSchedule(Scheduler* scheduler)
+        :m_scheduler(scheduler) {
+    }
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) const { CoResume(m_scheduler, h); }
+    void await_resume() const noexcept {}
+
+private:
+    Scheduler* m_scheduler;
+};
+
+/**
+ * @brief 等待协程同步原语
+ * @details enqueue获得资源时返回true(不挂起), 否则入队, 唤醒时在当前调度器上恢复协程
+ */
+class CoSyncAwaiter {
+public:
+    typedef bool (*Enqueue)(void* obj, FiberWaitQueue::Waiter* w);
+
+    CoSyncAwaiter(void* obj, Enqueue enqueue, bool ready)
+        :m_obj(obj)
+        ,m_enqueue(enqueue)
+        ,m_ready(ready) {
+    }
+    bool await_ready() const noexcept { return m_ready; }
+    bool await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {}
+
+private:
+    void* m_obj;
+    Enqueue m_enqueue;
+    bool m_ready;
+};
+
+//co_await CoLock(mutex)后持有锁, 之后调用mutex.unlock()
+inline CoSyncAwaiter CoLock(FiberMutex& mutex) {
+    return CoSyncAwaiter(&mutex, [](void* obj, FiberWaitQueue::Waiter* w){
+        return static_cast<FiberMutex*>(obj)->lockOrEnqueue(w);
+    }, mutex.tryLock());
+}
+
+inline CoSyncAwaiter CoReadLock(FiberRWMutex& mutex) {
+    return CoSyncAwaiter(&mutex, [](void* obj, FiberWaitQueue::Waiter* w){
+        return static_cast<FiberRWMutex*>(obj)->rdlockOrEnqueue(w);
+    }, false);
+}
+
+inline CoSyncAwaiter CoWriteLock(FiberRWMutex& mutex) {
+    return CoSyncAwaiter(&mutex, [](void* obj, FiberWaitQueue::Waiter* w){
+        return static_cast<FiberRWMutex*>(obj)->wrlockOrEnqueue(w);
+    }, false);
+}
+
+inline CoSyncAwaiter CoWait(FiberSemaphore& sem) {
+    return CoSyncAwaiter(&sem, [](void* obj, FiberWaitQueue::Waiter* w){
+        return static_cast<FiberSemaphore*>(obj)->waitOrEnqueue(w);
+    }, sem.tryWait());
+}
+
+inline CoSyncAwaiter CoWait(WaitGroup& wg) {
+    return CoSyncAwaiter(&wg, [](void* obj, FiberWaitQueue::Waiter* w){
+        return static_cast<WaitGroup*>(obj)->waitOrEnqueue(w);
+    }, wg.getCount() == 0);
+}
+
+//释放mutex并等待notify, 返回前重新加锁; 与FiberCondVar::wait一样可能虚假唤醒
+CoTask<void> CoWait(FiberCondVar& cond, FiberMutex& mutex);
+
+/**
+ * @brief 等待fd就绪, 由IOManager::readable/writable创建
+ * @details 协程恢复后await_resume返回0表示就绪(或事件被cancelEvent取消), -1表示失败,
+ *          超时时errno为ETIMEDOUT. fd应为非阻塞, 同一fd的同一事件同时只能有一个等待者
+ */
+class CoEventAwaiter {
+public:
+    CoEventAwaiter(IOManager* iom, int fd, int event, uint64_t timeout_ms)
+        :m_iom(iom)
+        ,m_fd(fd)
+        ,m_event(event)
+        ,m_timeout(timeout_ms) {
+    }
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    int await_resume();
+
+private:
+    IOManager* m_iom;
+    int m_fd;
+    int m_event;
+    uint64_t m_timeout;
+    int m_rt = 0;
+    //超时的定时器回调写入ETIMEDOUT, 协程恢复后释放, 之后到期的回调不再访问
+    std::shared_ptr<int> m_cancelled;
+    Timer::ptr m_timer;
+};
+
+//等待ms毫秒, 由IOManager::sleepFor创建
+class CoSleepAwaiter {
+public:
+    CoSleepAwaiter(TimerManager* timers, uint64_t ms)
+        :m_timers(timers)
+        ,m_ms(ms) {
+    }
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {}
+
+private:
+    TimerManager* m_timers;
+    uint64_t m_ms;
+};
+
+}
+
+#endif
@@ -4,6 +4,11 @@
 #include <atomic>
 #include "log.h"
 #include "scheduler.h"
+#include "stack_allocator.h"
+#include "stack_profile.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
 
 namespace awcotn {
 
@@ -14,22 +19,150 @@ static std::atomic<uint64_t> s_fiber_count {0};
 
 static thread_local Fiber* t_fiber = nullptr;
 static thread_local Fiber::ptr t_threadFiber = nullptr;
+//NoYieldScope的嵌套层数
+static thread_local uint32_t t_no_yield = 0;
+
+//刚切出、收尾尚未完成的协程, 由下一个恢复执行的协程处理
+struct PendingSwitch {
+    Fiber* prev = nullptr;
+    //切出完成后prev的状态, 切换完成前prev保持EXEC, 其它线程不会把它切入
+    Fiber::State state = Fiber::EXEC;
+    Fiber::SwitchDone done = nullptr;
+    void* arg = nullptr;
+};
+static thread_local PendingSwitch t_pending;
 
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size = 
     Config::Lookup<uint32_t>("fiber.stack_size", 1024 * 1024, "fiber stack size");
 
-class MalloStackAllocator {
-public:
-    static void* Alloc(size_t size) {
-        return malloc(size);
+static ConfigVar<uint32_t>::ptr g_shared_stack_count =
+    Config::Lookup<uint32_t>("fiber.shared_stack.count", 4
+            , "shared stacks per thread for shared-stack fibers");
+
+static ConfigVar<uint32_t>::ptr g_shared_stack_size =
+    Config::Lookup<uint32_t>("fiber.shared_stack.size", 8 * 1024 * 1024
+            , "size of each shared stack");
+
+static ConfigVar<uint32_t>::ptr g_stack_trim_idle_ms =
+    Config::Lookup<uint32_t>("fiber.stack_trim.idle_ms", 30 * 1000
+            , "release unused stack pages of fibers parked longer than this, 0 disable");
+
+static ConfigVar<bool>::ptr g_fiber_stats_enable =
+    Config::Lookup<bool>("fiber.stats.enable", false
+            , "record per fiber cpu/ready/hold time");
+
+static ConfigVar<bool>::ptr g_fiber_stats_log =
+    Config::Lookup<bool>("fiber.stats.log", false
+            , "log per fiber stats when the fiber terminates");
+
+static uint32_t s_stack_trim_idle_ms = 0;
+static bool s_fiber_stats = false;
+static bool s_fiber_stats_log = false;
+
+struct _FiberIniter {
+    _FiberIniter() {
+        s_stack_trim_idle_ms = g_stack_trim_idle_ms->getValue();
+        g_stack_trim_idle_ms->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_trim.idle_ms changed from "
+                                     << old_value << " to " << new_value;
+            s_stack_trim_idle_ms = new_value;
+        });
+
+        s_fiber_stats = g_fiber_stats_enable->getValue();
+        s_fiber_stats_log = g_fiber_stats_log->getValue();
+        g_fiber_stats_enable->addListener([](const bool& old_value, const bool& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stats.enable changed from "
+                                     << old_value << " to " << new_value;
+            s_fiber_stats = new_value;
+        });
+        g_fiber_stats_log->addListener([](const bool& old_value, const bool& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stats.log changed from "
+                                     << old_value << " to " << new_value;
+            s_fiber_stats_log = new_value;
+        });
+    }
+};
+
+static _FiberIniter s_fiber_initer;
+
+//m_parkTime的特殊值, 正在回收
+static const uint64_t s_trimming = ~0ull;
+//m_parkTime的特殊值, 正在切出, 栈指针还未保存好
+static const uint64_t s_switching = ~0ull - 1;
+
+/**
+ * @brief 独占栈协程链表, 按id分片减少构造析构时的锁竞争
+ */
+struct FiberListShard {
+    Mutex mutex;
+    Fiber* head = nullptr;
+};
+
+static const size_t s_fiber_list_shards = 16;
+
+static FiberListShard* GetFiberListShards() {
+    static FiberListShard s_shards[s_fiber_list_shards];
+    return s_shards;
+}
+
+static std::atomic<uint64_t> s_last_trim_ms {0};
+//回收轮次, 每次扫描加一; 协程挂起时记录当前轮次, 不用在切换路径上读时钟
+static std::atomic<uint64_t> s_park_epoch {1};
+
+static std::atomic<size_t> s_local_slot_count {0};
+static Fiber::LocalDestructor s_local_dtors[Fiber::MAX_LOCAL_SLOTS];
+
+using StackAllocator = StackPool;
+
+/**
+ * @brief 共享栈
+ * @details 属于某个线程, 同一时刻栈上只有occupant的栈帧
+ */
+struct SharedStack {
+    void* stack = nullptr;
+    size_t size = 0;
+    Fiber* occupant = nullptr;
+};
+
+/**
+ * @brief 线程的共享栈集合
+ * @details 第一个共享栈协程在本线程执行时创建, 新协程轮流分配到各个共享栈
+ */
+struct ThreadSharedStacks {
+    std::vector<SharedStack> stacks;
+    size_t next = 0;
+    //已经开始执行但还没结束的协程数
+    size_t live = 0;
+
+    SharedStack* get() {
+        if(stacks.empty()) {
+            uint32_t count = g_shared_stack_count->getValue();
+            size_t size = g_shared_stack_size->getValue();
+            stacks.resize(count ? count : 1);
+            for(auto& i : stacks) {
+                i.size = size;
+                i.stack = StackAllocator::Alloc(size);
+            }
+        }
+        return &stacks[next++ % stacks.size()];
     }
 
-    static void Dealloc(void* vp, size_t size) {
-        free(vp);
+    ~ThreadSharedStacks() {
+        for(auto& i : stacks) {
+            StackAllocator::Dealloc(i.stack, i.size);
+        }
     }
 };
 
-using StackAllocator = MalloStackAllocator;
+static thread_local ThreadSharedStacks t_shared_stacks;
+
+uint64_t Fiber::GetDefaultStackSize() {
+    return g_fiber_stack_size->getValue();
+}
+
+size_t Fiber::GetSharedStackFibers() {
+    return t_shared_stacks.live;
+}
 
 uint64_t Fiber::GetFiberId() {
     if(t_fiber) {
@@ -44,43 +177,82 @@ Fiber::Fiber()
     m_state = EXEC;
     SetThis(this);
 
-    if(getcontext(&m_ctx)) {
-        AWCOTN_ASSERT2(false, "getcontext");
-    }
-
     ++s_fiber_count;
     
 
     AWCOTN_LOG_DEBUG(g_logger) << "Fiber::Fiber main id=" << m_id;   
 }
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller) 
+Fiber::Fiber(Task cb, size_t stacksize, bool use_caller
+             ,bool shared_stack) 
     : m_id(s_fiber_id++)
-    , m_cb(cb) {
+    , m_useCaller(use_caller)
+    , m_cb(std::move(cb)) {
     ++s_fiber_count;
+#ifndef AWCOTN_FIBER_CONTEXT_HAS_SP
+    if(shared_stack) {
+        AWCOTN_LOG_WARN(g_logger) << "shared stack unsupported by context backend "
+            << FiberContextBackend() << ", fiber id=" << m_id << " use private stack";
+        shared_stack = false;
+    }
+#endif
+    if(shared_stack) {
+        // 栈在第一次切入时从所在线程的共享栈中分配
+        m_useSharedStack = true;
+        AWCOTN_LOG_DEBUG(g_logger) << "Fiber::Fiber shared stack id=" << m_id;
+        return;
+    }
     m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
 
     m_stack = StackAllocator::Alloc(m_stacksize);
-    if(getcontext(&m_ctx)) {
-        AWCOTN_ASSERT2(false, "getcontext");
-    }
-
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+    paintStack();
     if(!use_caller) {
-        makecontext(&m_ctx, &Fiber::MainFunc, 0);
+        MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
     } else {
-        makecontext(&m_ctx, &Fiber::CallerMainFunc, 0);
+        MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::CallerMainFunc);
     }
-    
+    {
+        FiberListShard& shard = GetFiberListShards()[m_id % s_fiber_list_shards];
+        Mutex::Lock lock(shard.mutex);
+        m_nextAll = shard.head;
+        if(shard.head) {
+            shard.head->m_prevAll = this;
+        }
+        shard.head = this;
+    }
+    if(s_fiber_stats) {
+        m_lastSwitch = GetCycleCount();
+    }
+    switchingOut();
+    markParked();
+
     AWCOTN_LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << m_id;  
 }
 
 Fiber::~Fiber() {
     --s_fiber_count;
-    if(m_stack) {
+    clearLocals();
+    if(m_useSharedStack) {
+        AWCOTN_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
+        if(m_sharedStack && m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        free(m_saveBuffer);
+    } else if(m_stack) {
         AWCOTN_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
+        {
+            //持有分片锁时TrimParkedStacks不会访问本协程
+            FiberListShard& shard = GetFiberListShards()[m_id % s_fiber_list_shards];
+            Mutex::Lock lock(shard.mutex);
+            if(m_prevAll) {
+                m_prevAll->m_nextAll = m_nextAll;
+            } else {
+                shard.head = m_nextAll;
+            }
+            if(m_nextAll) {
+                m_nextAll->m_prevAll = m_prevAll;
+            }
+        }
         StackAllocator::Dealloc(m_stack, m_stacksize);
     } else {
         AWCOTN_ASSERT(!m_cb);
@@ -96,37 +268,282 @@ Fiber::~Fiber() {
 }
 
 //重置协程
-void Fiber::reset(std::function<void()> cb) {
-    AWCOTN_ASSERT(m_stack);
+void Fiber::reset(Task cb) {
+    AWCOTN_ASSERT(m_stack || m_useSharedStack);
     AWCOTN_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
-    m_cb = cb;
-    if(getcontext(&m_ctx)) {
-        AWCOTN_ASSERT2(false, "getcontext");
+    unmarkParked();
+    recordStackUsage();
+    clearLocals();
+    m_lastSwitch = s_fiber_stats ? GetCycleCount() : 0;
+    m_scheduledAt = m_cpuCycles = m_readyCycles = m_holdCycles = m_switches = 0;
+    m_cb = std::move(cb);
+    m_useCaller = false;
+    if(m_useSharedStack) {
+        // 共享栈上可能是其它协程的栈帧, 上下文推迟到切入时初始化
+        m_saveSize = 0;
+    } else {
+        paintStack();
+        MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
     }
+    m_state = INIT;
+    switchingOut();
+    markParked();
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+void Fiber::acquireSharedStack() {
+    if(!m_sharedStack) {
+        m_sharedStack = t_shared_stacks.get();
+        m_boundThread = GetThreadId();
+    }
+    AWCOTN_ASSERT2(m_boundThread == GetThreadId(), "shared stack fiber id="
+            + std::to_string(m_id) + " resumed on another thread");
+    AWCOTN_ASSERT2(!t_fiber || t_fiber->m_sharedStack != m_sharedStack
+            , "switch between fibers on the same shared stack");
+
+    Fiber* occupant = m_sharedStack->occupant;
+    if(occupant && occupant != this) {
+        occupant->saveSharedStack();
+    }
+    if(m_state == INIT) {
+        ++t_shared_stacks.live;
+        MakeFiberContext(&m_ctx, m_sharedStack->stack, m_sharedStack->size
+                , m_useCaller ? &Fiber::CallerMainFunc : &Fiber::MainFunc);
+    } else if(occupant != this) {
+        char* top = (char*)m_sharedStack->stack + m_sharedStack->size;
+        memcpy(top - m_saveSize, m_saveBuffer, m_saveSize);
+    }
+    m_sharedStack->occupant = this;
+}
 
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    m_state = INIT;
+void Fiber::saveSharedStack() {
+    char* top = (char*)m_sharedStack->stack + m_sharedStack->size;
+    char* sp = (char*)FiberContextStackPointer(&m_ctx);
+    size_t used = top - sp;
+    // 保存区按实际使用量分配, 用量明显变小时收缩
+    if(m_saveCapacity < used || m_saveCapacity > used * 2) {
+        free(m_saveBuffer);
+        m_saveBuffer = (char*)malloc(used);
+        m_saveCapacity = used;
+    }
+    memcpy(m_saveBuffer, sp, used);
+    m_saveSize = used;
+}
+
+void Fiber::paintStack() {
+    m_entry = m_cb.entryType();
+    m_painted = m_entry && StackProfile::ShouldPaint(*m_entry);
+    if(m_painted) {
+        StackProfile::Paint(m_stack, m_stacksize);
+    }
+}
+
+void Fiber::recordStackUsage() {
+    if(m_painted) {
+        m_painted = false;
+        StackProfile::Record(*m_entry
+                , StackProfile::MeasureUsed(m_stack, m_stacksize), m_stacksize);
+    }
+}
+
+void Fiber::switchingOut() {
+    if(m_stack && s_stack_trim_idle_ms) {
+        m_parkTime.store(s_switching, std::memory_order_relaxed);
+    }
+}
+
+void Fiber::markParked() {
+    //涂色采样中的栈不能回收, 否则高水位测量失真
+    if(m_painted) {
+        return;
+    }
+    //协程可能已经在别的线程被切入并取消了标记, 只从s_switching改为挂起轮次
+    uint64_t expect = s_switching;
+    m_parkTime.compare_exchange_strong(expect
+            , s_park_epoch.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+void Fiber::unmarkParked() {
+    uint64_t v = m_parkTime.load(std::memory_order_relaxed);
+    while(v) {
+        if(v == s_trimming) {
+            v = m_parkTime.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(m_parkTime.compare_exchange_weak(v, 0, std::memory_order_acquire)) {
+            break;
+        }
+    }
+}
+
+size_t Fiber::TrimParkedStacks() {
+    uint32_t idle_ms = s_stack_trim_idle_ms;
+    if(!idle_ms) {
+        return 0;
+    }
+    uint64_t now = GetCurrentMS();
+    uint64_t last = s_last_trim_ms;
+    if(now - last < idle_ms / 2
+            || !s_last_trim_ms.compare_exchange_strong(last, now)) {
+        return 0;
+    }
+
+    //挂起后至少经过两个完整扫描间隔(即idle_ms)才回收
+    uint64_t epoch = ++s_park_epoch;
+    size_t bytes = 0;
+    FiberListShard* shards = GetFiberListShards();
+    for(size_t i = 0; i < s_fiber_list_shards; ++i) {
+        Mutex::Lock lock(shards[i].mutex);
+        for(Fiber* f = shards[i].head; f; f = f->m_nextAll) {
+            uint64_t t = f->m_parkTime;
+            if(!t || t >= s_switching || epoch < t + 3
+                    || !f->m_parkTime.compare_exchange_strong(t, s_trimming
+                            , std::memory_order_acquire)) {
+                continue;
+            }
+            bytes += StackAllocator::Trim(f->m_stack, FiberContextStackPointer(&f->m_ctx));
+            //已回收, 再次挂起前不需要重复处理
+            f->m_parkTime.store(0, std::memory_order_release);
+        }
+    }
+    if(bytes) {
+        AWCOTN_LOG_DEBUG(g_logger) << "TrimParkedStacks released " << bytes << " bytes";
+    }
+    return bytes;
+}
+
+size_t Fiber::AllocLocalSlot(LocalDestructor dtor) {
+    size_t slot = s_local_slot_count++;
+    AWCOTN_ASSERT2(slot < MAX_LOCAL_SLOTS, "fiber local slots exhausted, max="
+            + std::to_string(MAX_LOCAL_SLOTS));
+    s_local_dtors[slot] = dtor;
+    return slot;
+}
+
+void* Fiber::GetLocal(size_t slot) {
+    return t_fiber ? t_fiber->m_locals[slot] : nullptr;
+}
+
+void Fiber::SetLocal(size_t slot, void* value) {
+    Fiber* cur = t_fiber;
+    if(!cur) {
+        cur = GetThis().get();
+    }
+    void* old = cur->m_locals[slot];
+    cur->m_locals[slot] = value;
+    if(value) {
+        cur->m_localMask |= (1u << slot);
+    } else {
+        cur->m_localMask &= ~(1u << slot);
+    }
+    if(old && old != value && s_local_dtors[slot]) {
+        s_local_dtors[slot](old);
+    }
+}
+
+void Fiber::clearLocals() {
+    //析构函数可能再次设置局部变量, 直到全部清空
+    while(m_localMask) {
+        int slot = __builtin_ctz(m_localMask);
+        void* v = m_locals[slot];
+        m_locals[slot] = nullptr;
+        m_localMask &= ~(1u << slot);
+        if(s_local_dtors[slot]) {
+            s_local_dtors[slot](v);
+        }
+    }
+}
+
+void Fiber::statsSwitchIn() {
+    uint64_t now = GetCycleCount();
+    if(m_lastSwitch) {
+        if(m_scheduledAt > m_lastSwitch) {
+            //不同核心的计数器可能有微小偏差
+            uint64_t scheduled = std::min(m_scheduledAt, now);
+            m_holdCycles += scheduled - m_lastSwitch;
+            m_readyCycles += now - scheduled;
+        } else if(m_state == HOLD) {
+            m_holdCycles += now - m_lastSwitch;
+        } else {
+            m_readyCycles += now - m_lastSwitch;
+        }
+    }
+    m_lastSwitch = now;
+    ++m_switches;
+}
+
+void Fiber::statsSwitchOut() {
+    uint64_t now = GetCycleCount();
+    if(m_lastSwitch) {
+        m_cpuCycles += now - m_lastSwitch;
+    }
+    m_lastSwitch = now;
+}
+
+void Fiber::markScheduled() {
+    if(s_fiber_stats) {
+        m_scheduledAt = GetCycleCount();
+    }
+}
+
+Fiber::Stats Fiber::getStats() const {
+    uint64_t cpu = m_cpuCycles;
+    if(this == t_fiber && m_lastSwitch) {
+        cpu += GetCycleCount() - m_lastSwitch;
+    }
+    Stats st;
+    st.cpuNs = CyclesToNs(cpu);
+    st.readyNs = CyclesToNs(m_readyCycles);
+    st.holdNs = CyclesToNs(m_holdCycles);
+    st.switches = m_switches;
+    return st;
+}
+
+void Fiber::logStats() {
+    Stats st = getStats();
+    AWCOTN_LOG_INFO(g_logger) << "Fiber stats id=" << m_id
+        << " state=" << m_state
+        << " cpu_us=" << st.cpuNs / 1000
+        << " ready_us=" << st.readyNs / 1000
+        << " hold_us=" << st.holdNs / 1000
+        << " switches=" << st.switches;
+}
+
+void Fiber::releaseSharedStack(State state) {
+    if(state == TERM || state == EXCEPT) {
+        --t_shared_stacks.live;
+        if(m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        m_saveSize = 0;
+    }
 }
 
 //切换到当前协程执行
 void Fiber::call() {
+    if(m_useSharedStack) {
+        acquireSharedStack();
+    } else {
+        unmarkParked();
+    }
+    if(s_fiber_stats) {
+        statsSwitchIn();
+    }
     SetThis(this);
     m_state = EXEC;
-    AWCOTN_LOG_ERROR(g_logger) << getId();
-    if(swapcontext(&t_threadFiber->m_ctx, &m_ctx)) {
-        AWCOTN_ASSERT2(false, "swapcontext");
-    }
+    SwapFiberContext(&t_threadFiber->m_ctx, &m_ctx);
+    FinishSwitch();
 }
 
 void Fiber::back() {
-    SetThis(t_threadFiber.get());
-    if(swapcontext(&m_ctx, &t_threadFiber->m_ctx)) {
-        AWCOTN_ASSERT2(false, "swapcontext");
+    if(s_fiber_stats) {
+        statsSwitchOut();
     }
+    SetThis(t_threadFiber.get());
+    switchingOut();
+    t_pending.prev = this;
+    t_pending.state = m_state;
+    SwapFiberContext(&m_ctx, &t_threadFiber->m_ctx);
+    FinishSwitch();
 }
 
 /**
@@ -143,15 +560,23 @@ void Fiber::back() {
  * - 首次执行时从MainFunc/CallerMainFunc开始
  * - 非首次执行时从上次YieldToReady/YieldToHold的下一条指令继续
  */
-void Fiber::swapIn() {
-    SetThis(this);
+Fiber::State Fiber::swapIn() {
     AWCOTN_ASSERT(m_state != EXEC);
+    if(m_useSharedStack) {
+        acquireSharedStack();
+    } else {
+        unmarkParked();
+    }
+    if(s_fiber_stats) {
+        statsSwitchIn();
+    }
+    SetThis(this);
     m_state = EXEC;
     // 保存调度器主协程上下文到Scheduler::GetMainFiber()->m_ctx
     // 并将当前上下文切换为this协程的m_ctx
-    if(swapcontext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx)) {
-        AWCOTN_ASSERT2(false, "swapcontext");
-    }
+    SwapFiberContext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx);
+    // 切回来的不一定是this: 期间可能经过swapTo直接切换到了别的协程
+    return FinishSwitch();
 }
 
 /**
@@ -165,14 +590,95 @@ void Fiber::swapIn() {
  * 注意: 协程状态(READY/HOLD)的设置需要在调用swapOut前完成
  */
 void Fiber::swapOut() {
+    swapOut(m_state);
+}
+
+void Fiber::swapOut(State state) {
+    if(s_fiber_stats) {
+        statsSwitchOut();
+    }
     SetThis(Scheduler::GetMainFiber());
+    switchingOut();
     // 保存当前协程上下文到m_ctx
     // 并恢复调度器主协程的上下文继续执行
-    if(swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx)) {
-        AWCOTN_ASSERT2(false, "swapcontext");
+    t_pending.prev = this;
+    t_pending.state = state;
+    SwapFiberContext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx);
+    FinishSwitch();
+}
+
+void Fiber::swapTo(Fiber* next, State state, SwitchDone done, void* arg) {
+    AWCOTN_ASSERT(t_fiber == this);
+    AWCOTN_ASSERT2(t_no_yield == 0, "yield in non-blocking task");
+    AWCOTN_ASSERT(canSwapTo(next));
+    if(next->m_useSharedStack) {
+        next->acquireSharedStack();
+    } else {
+        next->unmarkParked();
+    }
+    if(s_fiber_stats) {
+        statsSwitchOut();
+        next->statsSwitchIn();
+    }
+    SetThis(next);
+    next->m_state = EXEC;
+    switchingOut();
+    t_pending.prev = this;
+    t_pending.state = state;
+    t_pending.done = done;
+    t_pending.arg = arg;
+    SwapFiberContext(&m_ctx, &next->m_ctx);
+    FinishSwitch();
+}
+
+bool Fiber::canSwapTo(const Fiber* next) const {
+    if(!next || next == this || next->m_state == EXEC || next->m_useCaller) {
+        return false;
+    }
+    if(next->m_useSharedStack) {
+        if(next->m_boundThread != -1 && next->m_boundThread != GetThreadId()) {
+            return false;
+        }
+        //未分配共享栈的协程可能被分配到当前协程所在的共享栈
+        if(m_useSharedStack && (!next->m_sharedStack
+                    || next->m_sharedStack == m_sharedStack)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Fiber::afterSwitchOut(State state) {
+    if(m_useSharedStack) {
+        releaseSharedStack(state);
+    } else {
+        if(state == TERM || state == EXCEPT) {
+            recordStackUsage();
+        }
+        if(state != READY) {
+            markParked();
+        }
     }
 }
 
+Fiber::State Fiber::FinishSwitch() {
+    Fiber* prev = t_pending.prev;
+    if(!prev) {
+        return EXEC;
+    }
+    State state = t_pending.state;
+    SwitchDone done = t_pending.done;
+    void* arg = t_pending.arg;
+    t_pending = PendingSwitch();
+    prev->afterSwitchOut(state);
+    //发布HOLD之后prev可能立即被别的线程切入, 之后只能使用state
+    prev->m_state = state;
+    if(done) {
+        done(prev, state, arg);
+    }
+    return state;
+}
+
 void Fiber::SetThis(Fiber* f) {
     t_fiber = f;
 }
@@ -180,24 +686,38 @@ void Fiber::SetThis(Fiber* f) {
 //返回当前协程
 Fiber::ptr Fiber::GetThis() {
     if(t_fiber) {
-        return t_fiber->shared_from_this();
+        return Fiber::ptr(t_fiber);
     }
     Fiber::ptr main_fiber(new Fiber);
     AWCOTN_ASSERT(t_fiber == main_fiber.get());
     t_threadFiber = main_fiber;
-    return t_fiber->shared_from_this();
+    return main_fiber;
 }
 //切换到后台并Ready状态
+Fiber::NoYieldScope::NoYieldScope() {
+    ++t_no_yield;
+}
+
+Fiber::NoYieldScope::~NoYieldScope() {
+    --t_no_yield;
+}
+
 void Fiber::YieldToReady() {
-    Fiber::ptr cur = GetThis();
-    cur->m_state = READY;
-    cur->swapOut();
+    //切换路径上不持有引用, 协程的引用由调度器/事件/定时器保存
+    Fiber* cur = t_fiber;
+    AWCOTN_ASSERT(cur);
+    AWCOTN_ASSERT2(t_no_yield == 0, "yield in non-blocking task");
+    //切出完成后才设置状态, 之前被其它线程唤醒也不会在两个线程上同时执行
+    cur->swapOut(READY);
 }
 //切换到后台并Hold状态
 void Fiber::YieldToHold() {
-    Fiber::ptr cur = GetThis();
-    cur->m_state = HOLD;
-    cur->swapOut();
+    //切换路径上不持有引用, 协程的引用由调度器/事件/定时器保存
+    Fiber* cur = t_fiber;
+    AWCOTN_ASSERT(cur);
+    AWCOTN_ASSERT2(t_no_yield == 0, "yield in non-blocking task");
+    //切出完成后才设置状态, 之前被其它线程唤醒也不会在两个线程上同时执行
+    cur->swapOut(HOLD);
 }
 
 uint64_t Fiber::TotalFibers() {
@@ -205,7 +725,10 @@ uint64_t Fiber::TotalFibers() {
 }
 
 void Fiber::MainFunc() {
-    Fiber::ptr cur = GetThis();
+    FinishSwitch();
+    //执行期间协程的引用由切入方(调度器或call的调用者)持有, 这里只用裸指针,
+    //避免在不会返回的栈上留下引用
+    Fiber* cur = t_fiber;
     AWCOTN_ASSERT(cur);
     try {
         cur->m_cb();
@@ -224,15 +747,22 @@ void Fiber::MainFunc() {
                                             << std::endl
                                             << awcotn::BacktraceToString();
     }
-    auto raw_ptr = cur.get();
-    cur.reset();
+    //在协程自己的栈上析构局部变量
+    cur->clearLocals();
+    if(s_fiber_stats && s_fiber_stats_log) {
+        cur->logStats();
+    }
+    auto raw_ptr = cur;
     raw_ptr->swapOut();
 
     AWCOTN_ASSERT2(false, "never reach fiber id=" + std::to_string(raw_ptr->getId()));
 }
 
 void Fiber::CallerMainFunc() {
-    Fiber::ptr cur = GetThis();
+    FinishSwitch();
+    //执行期间协程的引用由切入方(调度器或call的调用者)持有, 这里只用裸指针,
+    //避免在不会返回的栈上留下引用
+    Fiber* cur = t_fiber;
     AWCOTN_ASSERT(cur);
     try {
         cur->m_cb();
@@ -251,8 +781,12 @@ void Fiber::CallerMainFunc() {
                                             << std::endl
                                             << awcotn::BacktraceToString();
     }
-    auto raw_ptr = cur.get();
-    cur.reset();
+    //在协程自己的栈上析构局部变量
+    cur->clearLocals();
+    if(s_fiber_stats && s_fiber_stats_log) {
+        cur->logStats();
+    }
+    auto raw_ptr = cur;
     raw_ptr->back();
 
     AWCOTN_ASSERT2(false, "never reach fiber id=" + std::to_string(raw_ptr->getId()));
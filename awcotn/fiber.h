@@ -3,12 +3,18 @@
 
 #include <memory>
 #include <functional>
-#include <ucontext.h>
+#include <typeinfo>
+#include <atomic>
+#include "context.h"
+#include "intrusive_ptr.h"
+#include "task.h"
 #include "thread.h"
 #include "mutex.h"
 
 namespace awcotn {
 
+struct SharedStack;
+
 /**
  * @brief 协程类
  * @details 封装了协程的创建、切换、让出和恢复等操作
@@ -33,11 +39,66 @@ namespace awcotn {
  *    - B完成后让出CPU: YieldToReady()/YieldToHold()
  *    - 调度器可能调度A或其他协程继续执行
  *    - 适用于异步调用场景
+ *
+ * 4. 共享栈(拷贝栈)模式:
+ *    - 构造时shared_stack=true, 协程不独占栈, 运行在所属线程的几个大共享栈上
+ *    - 切入时如果共享栈上是别的协程的栈帧, 先把它已用部分拷贝到其保存区,
+ *      再把本协程保存的栈帧拷回共享栈
+ *    - 第一次执行后绑定到该线程, 之后只会被调度到这个线程
+ *    - 适合大量长时间空闲的连接, 热点协程仍应使用独占栈
+ *
+ * 5. 挂起协程的栈回收:
+ *    - 独占栈协程不在执行时(INIT/HOLD/TERM)记录挂起时的回收轮次
+ *    - IOManager空闲时调用TrimParkedStacks, 挂起超过fiber.stack_trim.idle_ms的协程,
+ *      把保存的栈指针以下的整页madvise(MADV_DONTNEED)归还
+ *    - 切入/reset前等待正在进行的回收结束
+ *
+ * 6. 协程局部存储:
+ *    - 每个key在创建时分配一个全局槽位, 之后按下标访问, 不查表不分配内存
+ *    - 协程结束(TERM/EXCEPT)、reset或析构时调用各槽位的析构函数
+ *    - 通常通过FiberLocal<T>使用
+ *
+ * 7. 引用计数:
+ *    - Fiber::ptr是侵入式指针, 计数在Fiber对象内, 从裸指针(如GetThis)构造不需要shared_from_this
+ *    - 调度器内部传递协程时尽量移动而不是拷贝, 切换路径上使用裸指针
+ *
+ * 8. 运行统计(fiber.stats.enable):
+ *    - 切入/切出时读取CPU周期计数器, 累计执行时间和切入次数
+ *    - 切出到下次切入之间的时间, 被加入调度队列之前算挂起(HOLD)等待,
+ *      之后算就绪(READY)等待
+ *    - 关闭时切换路径上只多一次分支判断
+ *
+ * 9. 直接切换(swapTo):
+ *    - 当前协程不经过调度协程, 直接切换到同一线程上的另一个协程, 只有一次上下文切换
+ *    - 切出方的收尾(状态、共享栈释放、挂起标记、调度器回调)推迟到切入方恢复执行后完成,
+ *      所有恢复点(swapIn返回、swapOut/swapTo返回、MainFunc开始)都会先处理上一次切出
+ *    - 通常通过Scheduler::YieldTo使用
  */
-class Fiber : public std::enable_shared_from_this<Fiber> {
+class Fiber {
 friend class Scheduler;
+friend void intrusive_ptr_add_ref(Fiber* f);
+friend void intrusive_ptr_release(Fiber* f);
+friend long intrusive_ptr_use_count(const Fiber* f);
 public:
-    typedef std::shared_ptr<Fiber> ptr;
+    typedef IntrusivePtr<Fiber> ptr;
+    typedef void (*LocalDestructor)(void*);
+
+    /**
+     * @brief 协程运行统计
+     */
+    struct Stats {
+        //执行时间
+        uint64_t cpuNs = 0;
+        //在调度队列中等待执行的时间
+        uint64_t readyNs = 0;
+        //挂起等待事件/定时器的时间
+        uint64_t holdNs = 0;
+        //切入次数
+        uint64_t switches = 0;
+    };
+
+    //协程局部存储槽位数量
+    static const size_t MAX_LOCAL_SLOTS = 16;
 
     enum State {
         INIT, //初始化
@@ -51,14 +112,26 @@ private:
     Fiber();
 
 public:
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+    /**
+     * @brief 构造函数
+     * @param[in] cb 协程执行的函数
+     * @param[in] stacksize 独占栈大小, 0使用fiber.stack_size
+     * @param[in] use_caller 是否在MainFiber上调度
+     * @param[in] shared_stack 是否使用共享栈(拷贝栈), 为true时忽略stacksize
+     */
+    Fiber(Task cb, size_t stacksize = 0, bool use_caller = false
+          ,bool shared_stack = false);
     ~Fiber();
 
     //重置协程
-    void reset(std::function<void()> cb);
-    //切换到当前协程
-    void swapIn();
-    //切换到后台执行
+    void reset(Task cb);
+    /**
+     * @brief 切换到当前协程
+     * @return 切回调度协程的协程切出后的状态
+     * @details 状态为HOLD时协程可能已经在别的线程上被唤醒执行, 调用者只能使用返回值, 不能再读取协程状态
+     */
+    State swapIn();
+    //切换到后台执行, 状态(READY/HOLD)需要在调用前设置
     void swapOut();
 
     /**
@@ -76,12 +149,48 @@ public:
      */
     void back();
 
+    //切出方的收尾回调, 在切入方恢复执行后调用, prev已经完全切出, state为切出后的状态
+    typedef void (*SwitchDone)(Fiber* prev, State state, void* arg);
+
+    /**
+     * @brief 从当前协程直接切换到next, 不经过调度协程
+     * @details this必须是当前正在执行的协程; next不能在执行中, 调用前先用canSwapTo检查
+     * @param[in] next 切入的协程
+     * @param[in] state 当前协程切出后的状态(READY/HOLD), 切换完成前保持EXEC
+     * @param[in] done 切出完成后在next上调用done(this, state, arg), 可以为nullptr
+     */
+    void swapTo(Fiber* next, State state, SwitchDone done = nullptr, void* arg = nullptr);
+
+    /**
+     * @brief 是否可以从当前协程直接切换到next
+     * @details next未在执行且不是use_caller协程; next是共享栈协程时必须绑定在当前线程,
+     *          并且不能与当前协程使用(或可能分配到)同一个共享栈
+     */
+    bool canSwapTo(const Fiber* next) const;
+
     uint64_t getId() const { return m_id; }
 
+    uint64_t getStackSize() const { return m_stacksize; }
+
     State getState() const { return m_state;}
 
     void setState(State s) { m_state = s;}
 
+    bool isSharedStack() const { return m_useSharedStack; }
+
+    /**
+     * @brief 返回运行统计
+     * @details 未开启fiber.stats.enable时全为0, 正在执行的协程包含本次执行的时间
+     */
+    Stats getStats() const;
+
+    //共享栈协程绑定的线程id, 未绑定返回-1
+    int getBoundThread() const { return m_boundThread; }
+
+    //调度优先级, 见Scheduler::Priority, 被唤醒或让出后按该优先级重新入队
+    int getPriority() const { return m_priority; }
+    void setPriority(int priority) { m_priority = priority; }
+
 public:
     //设置当前协程
     static void SetThis(Fiber* f);
@@ -92,6 +201,15 @@ public:
     //切换到后台并Hold状态
     static void YieldToHold();
 
+    /**
+     * @brief 作用域内当前线程不允许让出, YieldToReady/YieldToHold断言失败
+     * @details 用于直接在调度协程上执行的不阻塞回调, 见Scheduler::scheduleInline
+     */
+    struct NoYieldScope {
+        NoYieldScope();
+        ~NoYieldScope();
+    };
+
     static uint64_t TotalFibers();
 
     static void MainFunc();
@@ -100,15 +218,165 @@ public:
 
     static uint64_t GetFiberId();
 
+    //fiber.stack_size配置的默认栈大小
+    static uint64_t GetDefaultStackSize();
+
+    //绑定在当前线程共享栈上且尚未结束的协程数, 不为0时线程不能退出
+    static size_t GetSharedStackFibers();
+
+    /**
+     * @brief 回收挂起时间超过fiber.stack_trim.idle_ms的协程栈中未使用的物理页
+     * @details 多个线程同时调用时, 每半个idle_ms最多只有一个执行扫描
+     * @return 本次归还的字节数
+     */
+    static size_t TrimParkedStacks();
+
+    /**
+     * @brief 分配协程局部存储槽位, 槽位不回收
+     * @param[in] dtor 值的析构函数, 协程结束、reset或析构时对非空值调用, 可以为nullptr
+     * @return 槽位下标
+     */
+    static size_t AllocLocalSlot(LocalDestructor dtor);
+
+    /**
+     * @brief 返回当前协程指定槽位的值, 不在协程中或未设置返回nullptr
+     */
+    static void* GetLocal(size_t slot);
+
+    /**
+     * @brief 设置当前协程指定槽位的值, 原有的非空值先析构
+     * @details 不在协程中时使用线程的主协程
+     */
+    static void SetLocal(size_t slot, void* value);
+
+private:
+    //切入前占用共享栈, 必要时换出原占用者并恢复本协程的栈帧
+    void acquireSharedStack();
+    //把共享栈上本协程已用的部分拷贝到保存区
+    void saveSharedStack();
+    //切回后如果协程已结束, 释放对共享栈的占用
+    void releaseSharedStack(State state);
+    //依次析构并清空所有协程局部变量
+    void clearLocals();
+    //运行统计: 切入, 切出, 被加入调度队列
+    void statsSwitchIn();
+    void statsSwitchOut();
+    void markScheduled();
+    //输出最终的运行统计日志(fiber.stats.log)
+    void logStats();
+    //需要采样时给独占栈涂色, 见StackProfile
+    void paintStack();
+    //协程结束或reset时记录本次执行的栈高水位
+    void recordStackUsage();
+    //切出前标记栈指针即将失效, TrimParkedStacks跳过
+    void switchingOut();
+    //切出完成后记录挂起轮次, 之后可以被TrimParkedStacks回收
+    void markParked();
+    //切入/reset前取消挂起标记, 如果正在回收则等待结束
+    void unmarkParked();
+    //切换到调度协程, 切出完成后状态设置为state
+    void swapOut(State state);
+    //切出完成后的收尾: 释放共享栈或记录栈用量和挂起标记, 在发布状态state之前调用
+    void afterSwitchOut(State state);
+    //在恢复点处理上一次切出的收尾和回调, 返回上一个协程切出后的状态(没有时为EXEC)
+    static State FinishSwitch();
+
 private:
     uint64_t m_id = 0;
     uint64_t m_stacksize = 0;
     State m_state = INIT;
 
-    ucontext_t m_ctx;  
+    FiberContext m_ctx;
     void* m_stack = nullptr;
 
-    std::function<void()> m_cb;
+    bool m_useCaller = false;
+    bool m_useSharedStack = false;
+    int m_boundThread = -1;
+    int m_priority = 1;
+    SharedStack* m_sharedStack = nullptr;
+    //共享栈模式下换出时的栈帧保存区
+    char* m_saveBuffer = nullptr;
+    size_t m_saveSize = 0;
+    size_t m_saveCapacity = 0;
+
+    //本次执行是否涂色采样, 以及采样归属的入口
+    bool m_painted = false;
+    const std::type_info* m_entry = nullptr;
+
+    //挂起时的回收轮次, 0表示不可回收
+    std::atomic<uint64_t> m_parkTime {0};
+    //所有独占栈协程的链表, 供TrimParkedStacks遍历
+    Fiber* m_prevAll = nullptr;
+    Fiber* m_nextAll = nullptr;
+
+    //协程局部存储, m_localMask标记非空槽位
+    void* m_locals[MAX_LOCAL_SLOTS] = {};
+    uint32_t m_localMask = 0;
+
+    std::atomic<int32_t> m_refCount {0};
+
+    //运行统计, 单位为CPU周期
+    uint64_t m_lastSwitch = 0;
+    uint64_t m_scheduledAt = 0;
+    uint64_t m_cpuCycles = 0;
+    uint64_t m_readyCycles = 0;
+    uint64_t m_holdCycles = 0;
+    uint64_t m_switches = 0;
+
+    Task m_cb;
+};
+
+inline void intrusive_ptr_add_ref(Fiber* f) {
+    //增加引用时调用者已经持有一个引用, 不需要同步其它内存
+    f->m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(Fiber* f) {
+    if(f->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete f;
+    }
+}
+
+inline long intrusive_ptr_use_count(const Fiber* f) {
+    return f->m_refCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief 协程局部变量
+ * @details
+ * 通常定义为全局或静态变量, 构造时分配一个槽位, 同一变量在不同协程中有各自的值
+ * 值以T*保存, 协程结束、reset或析构时delete
+ * 协程在线程间迁移时值跟随协程, 替代thread_local保存请求级状态
+ */
+template<class T>
+class FiberLocal : Noncopyable {
+public:
+    FiberLocal()
+        : m_slot(Fiber::AllocLocalSlot(&FiberLocal::Destroy)) {
+    }
+
+    //当前协程的值, 未设置返回nullptr
+    T* get() const { return static_cast<T*>(Fiber::GetLocal(m_slot)); }
+
+    //设置当前协程的值, 接管v的所有权
+    void set(T* v) const { Fiber::SetLocal(m_slot, v); }
+
+    //当前协程的值, 未设置时默认构造一个
+    T& value() const {
+        T* v = get();
+        if(!v) {
+            v = new T();
+            set(v);
+        }
+        return *v;
+    }
+
+    T* operator->() const { return &value(); }
+    T& operator*() const { return value(); }
+private:
+    static void Destroy(void* v) { delete static_cast<T*>(v); }
+private:
+    size_t m_slot;
 };
 
 }
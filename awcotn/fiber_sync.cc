@@ -0,0 +1,376 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "node_pool.h"
+#include "macro.h"
+
+namespace awcotn {
+
+//不在任务协程中等待时, 每个线程同时只会等待一个
+static Semaphore* GetThreadSemaphore() {
+    static thread_local Semaphore s_sem;
+    return &s_sem;
+}
+
+FiberWaitQueue::~FiberWaitQueue() {
+    AWCOTN_ASSERT2(!m_head, "destroy wait queue with waiters");
+}
+
+FiberWaitQueue::Waiter* FiberWaitQueue::NewWaiter(int flag) {
+    Waiter* w = NewNode<Waiter>();
+    w->flag = flag;
+    if(Scheduler::InTaskFiber()) {
+        w->fiber = Fiber::GetThis();
+        w->scheduler = Scheduler::GetThis();
+    } else {
+        w->sem = GetThreadSemaphore();
+    }
+    return w;
+}
+
+FiberWaitQueue::Waiter* FiberWaitQueue::push(int flag) {
+    Waiter* w = NewWaiter(flag);
+    push(w);
+    return w;
+}
+
+void FiberWaitQueue::push(Waiter* w) {
+    if(m_tail) {
+        m_tail->next = w;
+    } else {
+        m_head = w;
+    }
+    m_tail = w;
+    ++m_size;
+}
+
+FiberWaitQueue::Waiter* FiberWaitQueue::pop() {
+    Waiter* w = m_head;
+    if(w) {
+        m_head = w->next;
+        if(!m_head) {
+            m_tail = nullptr;
+        }
+        w->next = nullptr;
+        --m_size;
+    }
+    return w;
+}
+
+FiberWaitQueue::Waiter* FiberWaitQueue::popAll() {
+    Waiter* head = m_head;
+    m_head = m_tail = nullptr;
+    m_size = 0;
+    return head;
+}
+
+void FiberWaitQueue::Park(Waiter* w) {
+    if(w->sem) {
+        Semaphore* sem = w->sem;
+        sem->wait();
+    } else {
+        //切出完成前被唤醒时, 调度器看到协程仍在执行会稍后再切入
+        Fiber::YieldToHold();
+    }
+    DeleteNode(w);
+}
+
+void FiberWaitQueue::Wake(Waiter* w) {
+    //唤醒后等待方会释放节点, 先取出需要的字段
+    if(w->callback) {
+        w->callback(w);
+    } else if(w->sem) {
+        Semaphore* sem = w->sem;
+        sem->notify();
+    } else {
+        Fiber::ptr fiber = std::move(w->fiber);
+        Scheduler* scheduler = w->scheduler;
+        scheduler->schedule(std::move(fiber));
+    }
+}
+
+void FiberWaitQueue::WakeAll(Waiter* head) {
+    while(head) {
+        Waiter* next = head->next;
+        Wake(head);
+        head = next;
+    }
+}
+
+bool FiberMutex::lockOrEnqueue(FiberWaitQueue::Waiter* w) {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        if(state == 0) {
+            if(m_state.compare_exchange_weak(state, LOCKED, std::memory_order_acquire)) {
+                return true;
+            }
+        } else if(state & QUEUE_LOCKED) {
+            state = m_state.load(std::memory_order_relaxed);
+        } else if(m_state.compare_exchange_weak(state, state | CONTENDED | QUEUE_LOCKED
+                    , std::memory_order_acquire)) {
+            break;
+        }
+    }
+    m_waiters.push(w);
+    m_state.fetch_and(~QUEUE_LOCKED, std::memory_order_release);
+    return false;
+}
+
+void FiberMutex::lockSlow() {
+    FiberWaitQueue::Waiter* w = FiberWaitQueue::NewWaiter();
+    if(lockOrEnqueue(w)) {
+        DeleteNode(w);
+        return;
+    }
+    //被唤醒时锁已经转交给本协程
+    FiberWaitQueue::Park(w);
+}
+
+void FiberMutex::unlockSlow() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        if(state & QUEUE_LOCKED) {
+            state = m_state.load(std::memory_order_relaxed);
+        } else if(state == LOCKED) {
+            if(m_state.compare_exchange_weak(state, 0, std::memory_order_release)) {
+                return;
+            }
+        } else if(m_state.compare_exchange_weak(state, state | QUEUE_LOCKED
+                    , std::memory_order_acquire)) {
+            break;
+        }
+    }
+    FiberWaitQueue::Waiter* w = m_waiters.pop();
+    if(!w) {
+        //同时释放锁和队列锁, 之后不再访问对象
+        m_state.store(0, std::memory_order_release);
+        return;
+    }
+    //锁不释放, 直接转交给w; 没有其它等待者时新的持有者可以走快路径解锁
+    m_state.store(m_waiters.empty() ? LOCKED : (LOCKED | CONTENDED), std::memory_order_release);
+    FiberWaitQueue::Wake(w);
+}
+
+void FiberCondVar::wait(FiberMutex& mutex) {
+    Spinlock::Lock lock(m_lock);
+    FiberWaitQueue::Waiter* w = m_waiters.push();
+    lock.unlock();
+    //先入队再解锁, 解锁后的notify不会丢失
+    mutex.unlock();
+    FiberWaitQueue::Park(w);
+    mutex.lock();
+}
+
+void FiberCondVar::enqueue(FiberWaitQueue::Waiter* w) {
+    Spinlock::Lock lock(m_lock);
+    m_waiters.push(w);
+}
+
+void FiberCondVar::notifyOne() {
+    FiberWaitQueue::Waiter* w = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        w = m_waiters.pop();
+    }
+    if(w) {
+        FiberWaitQueue::Wake(w);
+    }
+}
+
+void FiberCondVar::notifyAll() {
+    FiberWaitQueue::Waiter* head = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        head = m_waiters.popAll();
+    }
+    FiberWaitQueue::WakeAll(head);
+}
+
+bool FiberSemaphore::tryWait() {
+    uint64_t state = m_state.load(std::memory_order_relaxed);
+    while(state >= ONE_COUNT) {
+        if(m_state.compare_exchange_weak(state, state - ONE_COUNT, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FiberSemaphore::waitOrEnqueue(FiberWaitQueue::Waiter* w) {
+    Spinlock::Lock lock(m_lock);
+    //持锁登记等待者并入队, notify看到等待者后加锁时一定能取到节点
+    uint64_t state = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        if(state >= ONE_COUNT) {
+            if(m_state.compare_exchange_weak(state, state - ONE_COUNT, std::memory_order_acquire)) {
+                return true;
+            }
+        } else if(m_state.compare_exchange_weak(state, state + 1, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    m_waiters.push(w);
+    return false;
+}
+
+void FiberSemaphore::wait() {
+    if(tryWait()) {
+        return;
+    }
+    FiberWaitQueue::Waiter* w = FiberWaitQueue::NewWaiter();
+    if(waitOrEnqueue(w)) {
+        DeleteNode(w);
+        return;
+    }
+    //被唤醒时已经分到一个余量
+    FiberWaitQueue::Park(w);
+}
+
+void FiberSemaphore::notify() {
+    uint64_t state = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        if((uint32_t)state == 0) {
+            if(m_state.compare_exchange_weak(state, state + ONE_COUNT, std::memory_order_release)) {
+                return;
+            }
+        } else if(m_state.compare_exchange_weak(state, state - 1, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+    //余量直接分给一个等待者, 它被唤醒前对象不会析构
+    FiberWaitQueue::Waiter* w = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        w = m_waiters.pop();
+    }
+    AWCOTN_ASSERT(w);
+    FiberWaitQueue::Wake(w);
+}
+
+void FiberRWMutex::rdlock() {
+    Spinlock::Lock lock(m_lock);
+    if(!m_writer && m_waiters.empty()) {
+        ++m_readers;
+        return;
+    }
+    FiberWaitQueue::Waiter* w = m_waiters.push(READER);
+    lock.unlock();
+    FiberWaitQueue::Park(w);
+}
+
+void FiberRWMutex::wrlock() {
+    Spinlock::Lock lock(m_lock);
+    if(!m_writer && m_readers == 0 && m_waiters.empty()) {
+        m_writer = true;
+        return;
+    }
+    FiberWaitQueue::Waiter* w = m_waiters.push(WRITER);
+    lock.unlock();
+    FiberWaitQueue::Park(w);
+}
+
+bool FiberRWMutex::rdlockOrEnqueue(FiberWaitQueue::Waiter* w) {
+    Spinlock::Lock lock(m_lock);
+    if(!m_writer && m_waiters.empty()) {
+        ++m_readers;
+        return true;
+    }
+    w->flag = READER;
+    m_waiters.push(w);
+    return false;
+}
+
+bool FiberRWMutex::wrlockOrEnqueue(FiberWaitQueue::Waiter* w) {
+    Spinlock::Lock lock(m_lock);
+    if(!m_writer && m_readers == 0 && m_waiters.empty()) {
+        m_writer = true;
+        return true;
+    }
+    w->flag = WRITER;
+    m_waiters.push(w);
+    return false;
+}
+
+void FiberRWMutex::unlock() {
+    FiberWaitQueue::Waiter* head = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        if(m_writer) {
+            m_writer = false;
+        } else {
+            AWCOTN_ASSERT(m_readers > 0);
+            --m_readers;
+        }
+        head = grantNoLock();
+    }
+    FiberWaitQueue::WakeAll(head);
+}
+
+FiberWaitQueue::Waiter* FiberRWMutex::grantNoLock() {
+    FiberWaitQueue::Waiter* head = nullptr;
+    FiberWaitQueue::Waiter* tail = nullptr;
+    while(!m_writer) {
+        FiberWaitQueue::Waiter* w = m_waiters.front();
+        if(!w) {
+            break;
+        }
+        if(w->flag == WRITER) {
+            //写者要等所有读者释放, 且不能和已放行的读者同时持有
+            if(m_readers > 0) {
+                break;
+            }
+            m_writer = true;
+        } else {
+            ++m_readers;
+        }
+        m_waiters.pop();
+        if(tail) {
+            tail->next = w;
+        } else {
+            head = w;
+        }
+        tail = w;
+    }
+    return head;
+}
+
+bool WaitGroup::waitOrEnqueue(FiberWaitQueue::Waiter* w) {
+    Spinlock::Lock lock(m_lock);
+    uint64_t state = m_state.load(std::memory_order_acquire);
+    while(true) {
+        if((state >> 32) == 0) {
+            return true;
+        }
+        //计数不为0时登记等待者, 期间计数变化则重新检查; 归零的一方看到等待者后会加锁来唤醒
+        if(m_state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+    m_waiters.push(w);
+    return false;
+}
+
+void WaitGroup::wait() {
+    if(getCount() == 0) {
+        return;
+    }
+    FiberWaitQueue::Waiter* w = FiberWaitQueue::NewWaiter();
+    if(waitOrEnqueue(w)) {
+        DeleteNode(w);
+        return;
+    }
+    FiberWaitQueue::Park(w);
+}
+
+void WaitGroup::wakeAll() {
+    FiberWaitQueue::Waiter* head = nullptr;
+    {
+        Spinlock::Lock lock(m_lock);
+        head = m_waiters.popAll();
+        //计数为0时不会有新的等待者登记, 清掉等待者数
+        m_state.fetch_and(~(uint64_t)0xffffffff, std::memory_order_acq_rel);
+    }
+    //唤醒后等待方可能立即析构对象, 之后不再访问this
+    FiberWaitQueue::WakeAll(head);
+}
+
+}
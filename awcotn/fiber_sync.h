@@ -0,0 +1,268 @@
+#ifndef __AWCOTN_FIBER_SYNC_H__
+#define __AWCOTN_FIBER_SYNC_H__
+
+#include <atomic>
+#include <stdint.h>
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "macro.h"
+
+namespace awcotn {
+
+class Scheduler;
+
+/**
+ * @brief 协程等待队列, 协程同步原语的公共部分
+ * @details
+ * 1. 在调度器的任务协程中等待时只挂起当前协程(HOLD), 唤醒时通过等待时所在的调度器重新调度,
+ *    可以由同一调度器的其它线程唤醒; 不在任务协程中(普通线程、调度协程)时阻塞线程
+ * 2. 等待者节点从NodePool分配, 不使用等待方的栈(共享栈协程切出后栈上的内容会被覆盖)
+ * 3. push/pop需要持有外部的锁; park/wake在锁外调用
+ * 4. 等待者也可以是回调(如C++20协程的恢复), 由各原语的xxxOrEnqueue入队, Wake时调用callback, 不需要Park
+ */
+class FiberWaitQueue : Noncopyable {
+public:
+    struct Waiter {
+        Fiber::ptr fiber;
+        Scheduler* scheduler = nullptr;
+        //不在任务协程中等待时使用的线程信号量
+        Semaphore* sem = nullptr;
+        //同步原语自定义的标记, 如读写锁的读/写
+        int flag = 0;
+        //不为空时Wake调用callback(w), 由callback负责释放节点
+        void (*callback)(Waiter* w) = nullptr;
+        void* arg = nullptr;
+        Waiter* next = nullptr;
+    };
+
+    ~FiberWaitQueue();
+
+    bool empty() const { return !m_head; }
+    size_t size() const { return m_size; }
+
+    //为当前协程(或线程)创建等待者节点, 不加入队列, 之后交给Park
+    static Waiter* NewWaiter(int flag = 0);
+    //把当前协程(或线程)加入队尾, 返回的节点交给Park
+    Waiter* push(int flag = 0);
+    //把已经创建的节点加入队尾
+    void push(Waiter* w);
+    //取出队首, 空队列返回nullptr
+    Waiter* pop();
+    //队首的等待者, 空队列返回nullptr
+    Waiter* front() const { return m_head; }
+    //取出全部, 返回链表头
+    Waiter* popAll();
+
+    /**
+     * @brief 挂起直到被Wake, 返回后节点已释放
+     * @details 调用前释放外部的锁; Wake可能在Park之前发生
+     */
+    static void Park(Waiter* w);
+
+    //唤醒等待者, 之后不能再访问w
+    static void Wake(Waiter* w);
+
+    //依次唤醒popAll返回的链表
+    static void WakeAll(Waiter* head);
+
+private:
+    Waiter* m_head = nullptr;
+    Waiter* m_tail = nullptr;
+    size_t m_size = 0;
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details
+ * 没有竞争时加锁解锁各一次CAS, 不进入内核;
+ * 竞争时等待的协程挂起, 解锁时锁直接转交给队首的等待者(FIFO, 不会被插队饿死)
+ * 等待队列的锁也在m_state中, 解锁的最后一次访问是一次原子写,
+ * 其它协程拿到锁后可以立即解锁并析构(如栈上或引用计数对象中的锁)
+ */
+class FiberMutex : Noncopyable {
+public:
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    void lock() {
+        uint32_t expect = 0;
+        if(!m_state.compare_exchange_strong(expect, LOCKED, std::memory_order_acquire)) {
+            lockSlow();
+        }
+    }
+
+    bool tryLock() {
+        uint32_t expect = 0;
+        return m_state.compare_exchange_strong(expect, LOCKED, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        uint32_t expect = LOCKED;
+        if(!m_state.compare_exchange_strong(expect, 0, std::memory_order_release)) {
+            unlockSlow();
+        }
+    }
+
+    /**
+     * @brief 加锁或者把w加入等待队列, 不挂起
+     * @return 直接获得锁返回true, w没有入队(由调用者释放);
+     *         否则返回false, 锁转交给w时Wake(w)
+     */
+    bool lockOrEnqueue(FiberWaitQueue::Waiter* w);
+
+private:
+    void lockSlow();
+    void unlockSlow();
+
+private:
+    static const uint32_t LOCKED = 1;
+    //加锁且可能有等待者, 解锁需要走慢路径
+    static const uint32_t CONTENDED = 2;
+    //正在操作等待队列
+    static const uint32_t QUEUE_LOCKED = 4;
+
+    std::atomic<uint32_t> m_state = {0};
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程条件变量, 与FiberMutex配合使用
+ */
+class FiberCondVar : Noncopyable {
+public:
+    /**
+     * @brief 释放mutex并等待notify, 返回前重新加锁
+     * @details 与std::condition_variable一样可能虚假唤醒, 调用方应在循环中检查条件
+     */
+    void wait(FiberMutex& mutex);
+
+    template<class Predicate>
+    void wait(FiberMutex& mutex, Predicate pred) {
+        while(!pred()) {
+            wait(mutex);
+        }
+    }
+
+    void notifyOne();
+    void notifyAll();
+
+    //把w加入等待队列, notify时Wake(w); 调用者之后自己释放mutex
+    void enqueue(FiberWaitQueue::Waiter* w);
+
+private:
+    Spinlock m_lock;
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程信号量
+ * @details
+ * 余量和等待者数在同一个64位原子变量中(高32位余量, 低32位等待者数)
+ * 有余量时wait只有一次CAS; 没有等待者时notify只有一次CAS, 之后不再访问对象,
+ * 被唤醒的一方可以立即析构信号量; 有等待者时余量直接分给队首(FIFO)
+ */
+class FiberSemaphore : Noncopyable {
+public:
+    FiberSemaphore(uint32_t count = 0)
+        : m_state((uint64_t)count << 32) {
+    }
+
+    void wait();
+    bool tryWait();
+    void notify();
+
+    //取得余量返回true(w没有入队, 由调用者释放); 否则w入队返回false, 分到余量时Wake(w)
+    bool waitOrEnqueue(FiberWaitQueue::Waiter* w);
+
+    uint32_t getCount() const { return (uint32_t)(m_state.load(std::memory_order_relaxed) >> 32); }
+
+private:
+    static const uint64_t ONE_COUNT = (uint64_t)1 << 32;
+
+    std::atomic<uint64_t> m_state;
+    Spinlock m_lock;
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程读写锁
+ * @details
+ * 状态由自旋锁保护, 不进入内核; 有等待者时新来的读者也排队, 写者不会饿死
+ * 等待者按到达顺序放行: 队首是写者时放行一个写者, 是读者时放行队首连续的所有读者
+ */
+class FiberRWMutex : Noncopyable {
+public:
+    typedef ReadScopedLockImpl<FiberRWMutex> ReadLock;
+    typedef WriteScopedLockImpl<FiberRWMutex> WriteLock;
+
+    void rdlock();
+    void wrlock();
+    void unlock();
+
+    //获得锁返回true(w没有入队, 由调用者释放); 否则w入队返回false, 放行时Wake(w)
+    bool rdlockOrEnqueue(FiberWaitQueue::Waiter* w);
+    bool wrlockOrEnqueue(FiberWaitQueue::Waiter* w);
+
+private:
+    //放行队首可以获得锁的等待者, 需持有m_lock, 返回要唤醒的链表
+    FiberWaitQueue::Waiter* grantNoLock();
+
+private:
+    enum {
+        READER = 0,
+        WRITER = 1
+    };
+
+    Spinlock m_lock;
+    uint32_t m_readers = 0;
+    bool m_writer = false;
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 等待一组任务完成(Go的sync.WaitGroup)
+ * @details
+ * 1. add登记任务数, 每个任务结束时done, wait挂起直到计数归零;
+ *    add(n)一次后只等待时就是一次性的latch. 之前的wait都返回后可以再次add复用
+ * 2. 计数和等待者数放在同一个64位原子变量中(高32位计数, 低32位等待者数),
+ *    done只有一次原子减, 只有减到0且有等待者时才加锁唤醒, 大量任务同时结束时互不影响
+ * 3. 减到0时没有等待者就不再访问对象, wait返回后可以立即析构(如栈上的WaitGroup)
+ */
+class WaitGroup : Noncopyable {
+public:
+    WaitGroup(int32_t count = 0)
+        : m_state((uint64_t)(uint32_t)count << 32) {
+    }
+
+    void add(int32_t n = 1) {
+        uint64_t state = m_state.fetch_add((uint64_t)(int64_t)n << 32, std::memory_order_acq_rel)
+                            + ((uint64_t)(int64_t)n << 32);
+        int32_t count = (int32_t)(state >> 32);
+        AWCOTN_ASSERT2(count >= 0, "negative WaitGroup counter");
+        if(count == 0 && (uint32_t)state != 0) {
+            wakeAll();
+        }
+    }
+
+    void done() { add(-1); }
+
+    //挂起直到计数归零
+    void wait();
+
+    //计数为0返回true(w没有入队, 由调用者释放); 否则w入队返回false, 归零时Wake(w)
+    bool waitOrEnqueue(FiberWaitQueue::Waiter* w);
+
+    int32_t getCount() const { return (int32_t)(m_state.load(std::memory_order_acquire) >> 32); }
+
+private:
+    void wakeAll();
+
+private:
+    std::atomic<uint64_t> m_state;
+    Spinlock m_lock;
+    FiberWaitQueue m_waiters;
+};
+
+}
+
+#endif
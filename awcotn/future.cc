@@ -0,0 +1,149 @@
+#include "future.h"
+
+namespace awcotn {
+
+FutureStateBase::~FutureStateBase() {
+    Callback* cb = m_callbacks;
+    while(cb) {
+        Callback* next = cb->next;
+        DeleteNode(cb);
+        cb = next;
+    }
+}
+
+void FutureStateBase::wait() {
+    if(isReady()) {
+        return;
+    }
+    Spinlock::Lock lock(m_lock);
+    if(isReady()) {
+        return;
+    }
+    FiberWaitQueue::Waiter* w = m_waiters.push();
+    lock.unlock();
+    FiberWaitQueue::Park(w);
+}
+
+void FutureStateBase::addCallback(Task cb, Scheduler* scheduler) {
+    Callback* node = NewNode<Callback>();
+    node->cb = std::move(cb);
+    node->scheduler = scheduler;
+    node->next = nullptr;
+    if(!isReady()) {
+        Spinlock::Lock lock(m_lock);
+        if(!isReady()) {
+            node->next = m_callbacks;
+            m_callbacks = node;
+            return;
+        }
+    }
+    Dispatch(node);
+}
+
+void FutureStateBase::setException(std::exception_ptr e) {
+    markSatisfied();
+    m_exception = e;
+    complete();
+}
+
+void FutureStateBase::markSatisfied() {
+    bool satisfied = m_satisfied.exchange(true, std::memory_order_relaxed);
+    AWCOTN_ASSERT2(!satisfied, "promise already satisfied");
+}
+
+void FutureStateBase::complete() {
+    Spinlock::Lock lock(m_lock);
+    m_ready.store(true, std::memory_order_release);
+    FiberWaitQueue::Waiter* waiters = m_waiters.popAll();
+    Callback* cbs = m_callbacks;
+    m_callbacks = nullptr;
+    lock.unlock();
+
+    FiberWaitQueue::WakeAll(waiters);
+    //恢复添加顺序
+    Callback* ordered = nullptr;
+    while(cbs) {
+        Callback* next = cbs->next;
+        cbs->next = ordered;
+        ordered = cbs;
+        cbs = next;
+    }
+    //回调可能释放最后一个引用, 之后不能再访问this
+    while(ordered) {
+        Callback* next = ordered->next;
+        Dispatch(ordered);
+        ordered = next;
+    }
+}
+
+void FutureStateBase::Dispatch(Callback* cb) {
+    if(cb->scheduler) {
+        cb->scheduler->schedule(std::move(cb->cb));
+    } else {
+        cb->cb();
+    }
+    DeleteNode(cb);
+}
+
+Future<void> WhenAll(std::vector<Future<void> >& futures) {
+    struct Context {
+        Promise<void> promise;
+        std::atomic<size_t> left;
+        std::atomic<bool> done = {false};
+    };
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<void> rt = ctx->promise.getFuture();
+    ctx->left = futures.size();
+    if(futures.empty()) {
+        ctx->promise.setValue();
+        return rt;
+    }
+    for(auto& i : futures) {
+        AWCOTN_ASSERT2(i.valid(), "WhenAll on invalid future");
+        FutureState<void>::ptr s = std::move(i.m_state);
+        FutureState<void>* state = s.get();
+        state->addCallback([ctx, s](){
+            if(s->hasException()) {
+                if(!ctx->done.exchange(true)) {
+                    ctx->promise.setException(s->getException());
+                }
+            }
+            if(--ctx->left == 0 && !ctx->done.exchange(true)) {
+                ctx->promise.setValue();
+            }
+        }, nullptr);
+    }
+    futures.clear();
+    return rt;
+}
+
+Future<size_t> WhenAny(std::vector<Future<void> >& futures) {
+    struct Context {
+        Promise<size_t> promise;
+        std::atomic<size_t> left;
+        std::atomic<bool> done = {false};
+    };
+    AWCOTN_ASSERT2(!futures.empty(), "WhenAny on empty vector");
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<size_t> rt = ctx->promise.getFuture();
+    ctx->left = futures.size();
+    for(size_t i = 0; i < futures.size(); ++i) {
+        AWCOTN_ASSERT2(futures[i].valid(), "WhenAny on invalid future");
+        FutureState<void>::ptr s = std::move(futures[i].m_state);
+        FutureState<void>* state = s.get();
+        state->addCallback([ctx, s, i](){
+            bool last = --ctx->left == 0;
+            if(s->hasException()) {
+                if(last && !ctx->done.exchange(true)) {
+                    ctx->promise.setException(s->getException());
+                }
+            } else if(!ctx->done.exchange(true)) {
+                ctx->promise.setValue(i);
+            }
+        }, nullptr);
+    }
+    futures.clear();
+    return rt;
+}
+
+}
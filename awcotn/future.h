@@ -0,0 +1,574 @@
+#ifndef __AWCOTN_FUTURE_H__
+#define __AWCOTN_FUTURE_H__
+
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fiber_sync.h"
+#include "node_pool.h"
+#include "scheduler.h"
+#include "task.h"
+#include "macro.h"
+
+namespace awcotn {
+
+template<class T> class Future;
+template<class T> class Promise;
+
+/**
+ * @brief Future/Promise共享状态的公共部分
+ * @details
+ * 1. 引用计数在对象内部, 状态对象从NodePool分配
+ * 2. 等待者(get/wait)用FiberWaitQueue挂起, 完成时在各自等待时所在的调度器上恢复
+ * 3. 完成回调带有调度器时schedule到该调度器执行, 没有调度器时在完成的线程上直接执行
+ *    (WhenAll/WhenAny等内部回调只做计数和转移结果, 不值得再调度一次)
+ */
+class FutureStateBase : Noncopyable {
+friend void intrusive_ptr_add_ref(FutureStateBase* s);
+friend void intrusive_ptr_release(FutureStateBase* s);
+friend long intrusive_ptr_use_count(const FutureStateBase* s);
+public:
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    //挂起直到完成
+    void wait();
+
+    /**
+     * @brief 添加完成回调, 已经完成时立即执行(或schedule)
+     * @param[in] scheduler 执行回调的调度器, nullptr表示在完成的线程上直接执行
+     */
+    void addCallback(Task cb, Scheduler* scheduler);
+
+    //已完成且结果是异常
+    bool hasException() const { return (bool)m_exception; }
+    const std::exception_ptr& getException() const { return m_exception; }
+
+    void setException(std::exception_ptr e);
+
+protected:
+    virtual ~FutureStateBase();
+
+    //设置结果前调用, 重复设置时断言失败
+    void markSatisfied();
+    //结果已写入, 唤醒等待者并执行回调
+    void complete();
+    //归还内存
+    virtual void destroy() = 0;
+
+private:
+    struct Callback {
+        Task cb;
+        Scheduler* scheduler;
+        Callback* next;
+    };
+
+    static void Dispatch(Callback* cb);
+
+private:
+    std::atomic<int32_t> m_refCount = {0};
+    std::atomic<bool> m_satisfied = {false};
+    std::atomic<bool> m_ready = {false};
+    std::exception_ptr m_exception;
+    Spinlock m_lock;
+    FiberWaitQueue m_waiters;
+    //倒序, 完成时反转后按添加顺序执行
+    Callback* m_callbacks = nullptr;
+};
+
+inline void intrusive_ptr_add_ref(FutureStateBase* s) {
+    s->m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(FutureStateBase* s) {
+    if(s->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        s->destroy();
+    }
+}
+
+inline long intrusive_ptr_use_count(const FutureStateBase* s) {
+    return s->m_refCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief 带值的共享状态
+ */
+template<class T>
+class FutureState : public FutureStateBase {
+template<class U> friend void DeleteNode(U* p);
+public:
+    typedef IntrusivePtr<FutureState> ptr;
+
+    static ptr Create() {
+        return ptr(NewNode<FutureState>());
+    }
+
+    template<class U>
+    void setValue(U&& v) {
+        markSatisfied();
+        new (value()) T(std::forward<U>(v));
+        m_hasValue = true;
+        complete();
+    }
+
+    //移出结果, 结果是异常时重新抛出
+    T take() {
+        if(hasException()) {
+            std::rethrow_exception(getException());
+        }
+        return std::move(*value());
+    }
+
+protected:
+    ~FutureState() {
+        if(m_hasValue) {
+            value()->~T();
+        }
+    }
+
+    void destroy() override {
+        DeleteNode(this);
+    }
+
+private:
+    T* value() { return reinterpret_cast<T*>(&m_storage); }
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    bool m_hasValue = false;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+template<class U> friend void DeleteNode(U* p);
+public:
+    typedef IntrusivePtr<FutureState> ptr;
+
+    static ptr Create() {
+        return ptr(NewNode<FutureState>());
+    }
+
+    void setValue() {
+        markSatisfied();
+        complete();
+    }
+
+    void take() {
+        if(hasException()) {
+            std::rethrow_exception(getException());
+        }
+    }
+
+protected:
+    void destroy() override {
+        DeleteNode(this);
+    }
+};
+
+/**
+ * @brief 把可调用对象的返回值(或抛出的异常)写入Promise
+ * @details R是Future<U>时等内层完成后转发结果, 外层得到Future<U>而不是Future<Future<U>>
+ */
+template<class R>
+struct FutureFulfill {
+    typedef R type;
+
+    template<class P, class Fn>
+    static void Run(P& p, Fn& fn) {
+        p.setValue(fn());
+    }
+};
+
+template<>
+struct FutureFulfill<void> {
+    typedef void type;
+
+    template<class P, class Fn>
+    static void Run(P& p, Fn& fn) {
+        fn();
+        p.setValue();
+    }
+};
+
+template<class U>
+struct FutureFulfill<Future<U> > {
+    typedef U type;
+
+    template<class P, class Fn>
+    static void Run(P& p, Fn& fn) {
+        fn().forwardTo(std::move(p));
+    }
+};
+
+/**
+ * @brief 以Future<T>的值调用F, 用于then
+ */
+template<class T, class F>
+struct FutureInvoke {
+    typedef decltype(std::declval<F&>()(std::declval<T>())) result_type;
+
+    static result_type Call(F& f, FutureState<T>& s) {
+        return f(s.take());
+    }
+};
+
+template<class F>
+struct FutureInvoke<void, F> {
+    typedef decltype(std::declval<F&>()()) result_type;
+
+    static result_type Call(F& f, FutureState<void>& s) {
+        s.take();
+        return f();
+    }
+};
+
+/**
+ * @brief 异步结果, 由对应的Promise设置
+ * @details
+ * 1. 只能移动. get移出结果(结果是异常时重新抛出), 只能调用一次; wait/isReady可以多次调用
+ * 2. 在任务协程中get/wait只挂起当前协程, 完成时在原来的调度器上恢复; 普通线程中阻塞线程
+ * 3. then注册后续操作, 消耗当前Future, 返回后续操作结果的Future;
+ *    后续操作schedule到调用then时所在的调度器执行(不在调度器中时在完成的线程上直接执行),
+ *    可以在其中挂起; 前一步是异常时跳过后续操作, 异常传到返回的Future
+ */
+template<class T>
+class Future {
+template<class U> friend class Future;
+friend class Promise<T>;
+template<class U> friend struct FutureFulfill;
+template<class U> friend Future<std::vector<U> > WhenAll(std::vector<Future<U> >& futures);
+friend Future<void> WhenAll(std::vector<Future<void> >& futures);
+template<class U> friend Future<std::pair<size_t, U> > WhenAny(std::vector<Future<U> >& futures);
+friend Future<size_t> WhenAny(std::vector<Future<void> >& futures);
+public:
+    typedef FutureState<T> State;
+
+    Future() {}
+
+    Future(Future&& rhs) = default;
+    Future& operator=(Future&& rhs) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    //是否关联了共享状态(get/then之后不再有效)
+    bool valid() const { return (bool)m_state; }
+
+    bool isReady() const { return m_state->isReady(); }
+
+    void wait() const { m_state->wait(); }
+
+    T get() {
+        AWCOTN_ASSERT2(m_state, "get on invalid future");
+        m_state->wait();
+        typename State::ptr s = std::move(m_state);
+        return s->take();
+    }
+
+    template<class F>
+    Future<typename FutureFulfill<typename FutureInvoke<T, typename std::decay<F>::type>::result_type>::type>
+    then(F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        typedef typename FutureInvoke<T, Fn>::result_type R;
+        typedef typename FutureFulfill<R>::type U;
+        AWCOTN_ASSERT2(m_state, "then on invalid future");
+        Promise<U> p;
+        Future<U> rt = p.getFuture();
+        State* s = m_state.get();
+        s->addCallback(Then<Fn, R>(std::move(m_state), std::move(p), std::forward<F>(f))
+                        , Scheduler::GetThis());
+        return rt;
+    }
+
+private:
+    explicit Future(typename State::ptr s)
+        : m_state(std::move(s)) {
+    }
+
+    //then注册的后续操作
+    template<class Fn, class R>
+    class Then {
+    public:
+        typedef typename FutureFulfill<R>::type U;
+
+        template<class F>
+        Then(typename State::ptr s, Promise<U>&& p, F&& f)
+            : m_state(std::move(s))
+            , m_promise(std::move(p))
+            , m_fn(std::forward<F>(f)) {
+        }
+
+        void operator()() {
+            if(m_state->hasException()) {
+                m_promise.setException(m_state->getException());
+                return;
+            }
+            try {
+                Bound bound = {m_fn, *m_state};
+                FutureFulfill<R>::Run(m_promise, bound);
+            } catch(...) {
+                m_promise.setException(std::current_exception());
+            }
+        }
+
+        const std::type_info* entryType() const { return Task::EntryTypeOf(m_fn); }
+
+    private:
+        struct Bound {
+            Fn& fn;
+            State& state;
+            R operator()() { return FutureInvoke<T, Fn>::Call(fn, state); }
+        };
+
+    private:
+        typename State::ptr m_state;
+        Promise<U> m_promise;
+        Fn m_fn;
+    };
+
+    //完成时把结果转交给p, 用于展开then返回的Future
+    void forwardTo(Promise<T>&& p);
+
+private:
+    typename State::ptr m_state;
+};
+
+/**
+ * @brief 设置Future的结果
+ * @details
+ * 只能移动, setValue/setException只能调用一次;
+ * 没有设置结果就析构时, Future得到std::future_error(broken_promise)
+ */
+template<class T>
+class Promise {
+public:
+    typedef FutureState<T> State;
+
+    Promise()
+        : m_state(State::Create()) {
+    }
+
+    Promise(Promise&& rhs) = default;
+    Promise& operator=(Promise&& rhs) {
+        if(this != &rhs) {
+            abandon();
+            m_state = std::move(rhs.m_state);
+        }
+        return *this;
+    }
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() {
+        abandon();
+    }
+
+    //关联的Future, 只取一次
+    Future<T> getFuture() {
+        AWCOTN_ASSERT2(!m_retrieved, "future already retrieved");
+        m_retrieved = true;
+        return Future<T>(m_state);
+    }
+
+    template<class... Args>
+    void setValue(Args&&... args) {
+        m_state->setValue(std::forward<Args>(args)...);
+        m_state.reset();
+    }
+
+    void setException(std::exception_ptr e) {
+        m_state->setException(e);
+        m_state.reset();
+    }
+
+private:
+    void abandon() {
+        if(m_state) {
+            m_state->setException(std::make_exception_ptr(
+                    std::future_error(std::future_errc::broken_promise)));
+            m_state.reset();
+        }
+    }
+
+private:
+    typename State::ptr m_state;
+    bool m_retrieved = false;
+};
+
+/**
+ * @brief 把完成的共享状态的结果转交给Promise
+ */
+template<class T>
+struct FutureForward {
+    typename FutureState<T>::ptr state;
+    Promise<T> promise;
+
+    void operator()() {
+        if(state->hasException()) {
+            promise.setException(state->getException());
+        } else {
+            promise.setValue(state->take());
+        }
+    }
+};
+
+template<>
+struct FutureForward<void> {
+    FutureState<void>::ptr state;
+    Promise<void> promise;
+
+    void operator()() {
+        if(state->hasException()) {
+            promise.setException(state->getException());
+        } else {
+            promise.setValue();
+        }
+    }
+};
+
+template<class T>
+void Future<T>::forwardTo(Promise<T>&& p) {
+    State* s = m_state.get();
+    s->addCallback(FutureForward<T>{std::move(m_state), std::move(p)}, nullptr);
+}
+
+/**
+ * @brief 已经有结果的Future
+ */
+template<class T>
+Future<typename std::decay<T>::type> MakeReadyFuture(T&& v) {
+    Promise<typename std::decay<T>::type> p;
+    Future<typename std::decay<T>::type> f = p.getFuture();
+    p.setValue(std::forward<T>(v));
+    return f;
+}
+
+inline Future<void> MakeReadyFuture() {
+    Promise<void> p;
+    Future<void> f = p.getFuture();
+    p.setValue();
+    return f;
+}
+
+/**
+ * @brief 在调度器上执行f, 返回其结果的Future
+ * @details f作为普通回调任务执行(使用回调协程池), 不单独创建协程; f返回Future时展开
+ */
+template<class F>
+Future<typename FutureFulfill<decltype(std::declval<typename std::decay<F>::type&>()())>::type>
+Async(Scheduler* scheduler, F&& f) {
+    typedef typename std::decay<F>::type Fn;
+    typedef decltype(std::declval<Fn&>()()) R;
+    typedef typename FutureFulfill<R>::type U;
+    struct Run {
+        Promise<U> promise;
+        Fn fn;
+
+        void operator()() {
+            try {
+                FutureFulfill<R>::Run(promise, fn);
+            } catch(...) {
+                promise.setException(std::current_exception());
+            }
+        }
+
+        const std::type_info* entryType() const { return Task::EntryTypeOf(fn); }
+    };
+    Promise<U> p;
+    Future<U> rt = p.getFuture();
+    scheduler->schedule(Task(Run{std::move(p), std::forward<F>(f)}));
+    return rt;
+}
+
+/**
+ * @brief 全部完成后得到各自的结果(按输入顺序)
+ * @details
+ * 每个输入只挂一个直接执行的回调(计数加转移), 不额外创建协程;
+ * 任何一个是异常时立即以该异常完成, 不等其余的
+ */
+template<class T>
+Future<std::vector<T> > WhenAll(std::vector<Future<T> >& futures) {
+    struct Context {
+        Promise<std::vector<T> > promise;
+        std::vector<typename FutureState<T>::ptr> states;
+        std::atomic<size_t> left;
+        std::atomic<bool> done = {false};
+    };
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<std::vector<T> > rt = ctx->promise.getFuture();
+    ctx->left = futures.size();
+    for(auto& i : futures) {
+        AWCOTN_ASSERT2(i.valid(), "WhenAll on invalid future");
+        ctx->states.push_back(std::move(i.m_state));
+    }
+    futures.clear();
+    if(ctx->states.empty()) {
+        ctx->promise.setValue(std::vector<T>());
+        return rt;
+    }
+    for(auto& s : ctx->states) {
+        FutureState<T>* state = s.get();
+        state->addCallback([ctx, state](){
+            if(state->hasException()) {
+                if(!ctx->done.exchange(true)) {
+                    ctx->promise.setException(state->getException());
+                }
+            }
+            if(--ctx->left == 0 && !ctx->done.exchange(true)) {
+                std::vector<T> values;
+                values.reserve(ctx->states.size());
+                for(auto& i : ctx->states) {
+                    values.push_back(i->take());
+                }
+                ctx->promise.setValue(std::move(values));
+            }
+        }, nullptr);
+    }
+    return rt;
+}
+
+Future<void> WhenAll(std::vector<Future<void> >& futures);
+
+/**
+ * @brief 第一个成功完成的结果及其下标
+ * @details 全部是异常时以最后一个异常完成
+ */
+template<class T>
+Future<std::pair<size_t, T> > WhenAny(std::vector<Future<T> >& futures) {
+    struct Context {
+        Promise<std::pair<size_t, T> > promise;
+        std::atomic<size_t> left;
+        std::atomic<bool> done = {false};
+    };
+    AWCOTN_ASSERT2(!futures.empty(), "WhenAny on empty vector");
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<std::pair<size_t, T> > rt = ctx->promise.getFuture();
+    ctx->left = futures.size();
+    for(size_t i = 0; i < futures.size(); ++i) {
+        AWCOTN_ASSERT2(futures[i].valid(), "WhenAny on invalid future");
+        typename FutureState<T>::ptr s = std::move(futures[i].m_state);
+        FutureState<T>* state = s.get();
+        state->addCallback([ctx, s, i](){
+            bool last = --ctx->left == 0;
+            if(s->hasException()) {
+                if(last && !ctx->done.exchange(true)) {
+                    ctx->promise.setException(s->getException());
+                }
+            } else if(!ctx->done.exchange(true)) {
+                ctx->promise.setValue(std::make_pair(i, s->take()));
+            }
+        }, nullptr);
+    }
+    futures.clear();
+    return rt;
+}
+
+//Future<void>版本, 结果是第一个成功完成的下标
+Future<size_t> WhenAny(std::vector<Future<void> >& futures);
+
+}
+
+#endif
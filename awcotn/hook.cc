@@ -2,6 +2,8 @@
 #include <dlfcn.h>
 #include <cstdarg>
 #include <sys/ioctl.h>
+#include <linux/io_uring.h>
+#include <string.h>
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "config.h"
@@ -144,7 +146,7 @@ retry:
                 }
                 t->cancelled = ETIMEDOUT;
                 iom->cancelEvent(fd, (awcotn::IOManager::Event)event); 
-            }, winfo);
+            }, winfo, false, true);
         }
 
         // 添加IO事件到事件循环
@@ -177,6 +179,56 @@ retry:
     return n;
 }
 
+static io_uring_sqe make_sqe(uint8_t opcode, const void* addr, size_t len, uint32_t msg_flags) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.addr = (uint64_t)(uintptr_t)addr;
+    sqe.len = std::min<size_t>(len, UINT32_MAX);
+    sqe.msg_flags = msg_flags;
+    return sqe;
+}
+
+//当前协程可以用io_uring后端提交操作
+static bool uring_usable(awcotn::IOManager* iom) {
+    return iom && iom->getBackend() == awcotn::IOManager::URING_BACKEND
+        && !awcotn::Fiber::GetThis()->isSharedStack();
+}
+
+/**
+ * @brief io_uring后端: 由内核执行IO操作, 协程挂起到操作完成, 不再先等就绪再调用一次
+ * @param[in] sqe 填好opcode/addr/len等的sqe
+ * @param[out] n 操作的结果, 失败时为-1并设置errno
+ * @return 不适用时返回false, 调用者走do_io:
+ *         没有使用io_uring后端, 当前是共享栈协程(缓冲区和操作状态可能在栈上, 挂起后被覆盖),
+ *         fd不是hook管理的阻塞socket, 内核返回EAGAIN(老内核对O_NONBLOCK的fd不等待), 操作被取消(close或提交的线程退出)
+ */
+static bool uring_io(int fd, io_uring_sqe sqe, int timeout_so, ssize_t& n) {
+    if(!awcotn::t_hook_enable) {
+        return false;
+    }
+    awcotn::IOManager* iom = awcotn::IOManager::GetThis();
+    if(!uring_usable(iom)) {
+        return false;
+    }
+    awcotn::FdCtx::ptr ctx = awcotn::FdMgr::GetInstance()->get(fd, false);
+    if(!ctx || ctx->isClosed() || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return false;
+    }
+    sqe.fd = fd;
+    int rt = iom->submitIo(sqe, ctx->getTimeout(timeout_so));
+    if(rt == -EAGAIN || rt == -ECANCELED) {
+        return false;
+    }
+    if(rt < 0) {
+        errno = -rt;
+        n = -1;
+    } else {
+        n = rt;
+    }
+    return true;
+}
+
 extern "C" {
 #define XX(name) name ## _fun name ## _f = nullptr;
     HOOK_FUN(XX);
@@ -190,8 +242,8 @@ unsigned int sleep(unsigned int seconds) {
     awcotn::IOManager* iom = awcotn::IOManager::GetThis();
     
     iom->addTimer(seconds * 1000, std::bind((void(awcotn::Scheduler::*)
-    (awcotn::Fiber::ptr, int thread))&awcotn::IOManager::schedule
-    ,iom, fiber, -1));
+    (awcotn::Fiber::ptr, int thread, awcotn::Scheduler::Priority))&awcotn::IOManager::schedule
+    ,iom, fiber, -1, awcotn::Scheduler::DEFAULT_PRIORITY), false, true);
     awcotn::Fiber::YieldToHold();
     return 0;
 }
@@ -204,8 +256,8 @@ int usleep(useconds_t usec) {
     awcotn::IOManager* iom = awcotn::IOManager::GetThis();
     
     iom->addTimer(usec / 1000, std::bind((void(awcotn::Scheduler::*)
-                (awcotn::Fiber::ptr, int thread))&awcotn::IOManager::schedule
-                ,iom, fiber, -1));
+                (awcotn::Fiber::ptr, int thread, awcotn::Scheduler::Priority))&awcotn::IOManager::schedule
+                ,iom, fiber, -1, awcotn::Scheduler::DEFAULT_PRIORITY), false, true);
     awcotn::Fiber::YieldToHold();
     return 0;
 }
@@ -218,8 +270,8 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
     awcotn::IOManager* iom = awcotn::IOManager::GetThis();
     
     iom->addTimer(req->tv_sec * 1000 + req->tv_nsec / 1000000, std::bind((void(awcotn::Scheduler::*)
-                    (awcotn::Fiber::ptr, int thread))&awcotn::IOManager::schedule
-                    ,iom, fiber, -1));
+                    (awcotn::Fiber::ptr, int thread, awcotn::Scheduler::Priority))&awcotn::IOManager::schedule
+                    ,iom, fiber, -1, awcotn::Scheduler::DEFAULT_PRIORITY), false, true);
     awcotn::Fiber::YieldToHold();
     return 0;
 }
@@ -255,14 +307,41 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
+    awcotn::IOManager* iom = awcotn::IOManager::GetThis();
+    if(uring_usable(iom)) {
+        uint64_t begin = awcotn::GetCurrentMS();
+        io_uring_sqe sqe = make_sqe(IORING_OP_CONNECT, addr, 0, 0);
+        sqe.fd = fd;
+        sqe.off = addrlen;
+        int rt = iom->submitIo(sqe, timeout_ms);
+        if(rt != -EAGAIN && rt != -ECANCELED) {
+            if(rt < 0) {
+                errno = -rt;
+                return -1;
+            }
+            return 0;
+        }
+        //与uring_io一致: 内核不等待或操作被取消(提交的线程退出)时, 用剩余的超时时间走下面的流程
+        if(timeout_ms != (uint64_t)-1) {
+            uint64_t used = awcotn::GetCurrentMS() - begin;
+            if(used >= timeout_ms) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            timeout_ms -= used;
+        }
+    }
+
     int n = connect_f(fd, addr, addrlen);
     if(n == 0) {
         return 0;
-    } else if(n != -1 || errno != EINPROGRESS) {
+    } else if(n == -1 && errno == EISCONN) {
+        //被取消的CONNECT已经连上
+        return 0;
+    } else if(n != -1 || (errno != EINPROGRESS && errno != EALREADY)) {
         return n;
     }
 
-    awcotn::IOManager* iom = awcotn::IOManager::GetThis();
     awcotn::Timer::ptr timer = nullptr;
 
     std::shared_ptr<timer_info> tinfo(new timer_info);
@@ -277,7 +356,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
                 }
                 t->cancelled = ETIMEDOUT;
                 iom->cancelEvent(fd, awcotn::IOManager::WRITE);
-        }, winfo);
+        }, winfo, false, true);
     }
 
     AWCOTN_LOG_INFO(g_logger) << "connect addEvent(" << fd << ", WRITE)";
@@ -317,8 +396,16 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen){
 }
 
  int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen){
-    int fd = do_io(sockfd, accept_f, "accept", awcotn::IOManager::READ, SO_RCVTIMEO,
-                   addr, addrlen); 
+    io_uring_sqe sqe = make_sqe(IORING_OP_ACCEPT, addr, 0, 0);
+    sqe.addr2 = (uint64_t)(uintptr_t)addrlen;
+    ssize_t n = 0;
+    int fd = 0;
+    if(uring_io(sockfd, sqe, SO_RCVTIMEO, n)) {
+        fd = n;
+    } else {
+        fd = do_io(sockfd, accept_f, "accept", awcotn::IOManager::READ, SO_RCVTIMEO,
+                   addr, addrlen);
+    }
     if(fd >= 0) {
         awcotn::FdMgr::GetInstance()->get(fd, true);
     }
@@ -326,6 +413,11 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen){
  }
 
 ssize_t read(int fd, void* buf, size_t count) {
+    //hook的fd是socket, 用RECV: 不受O_NONBLOCK影响
+    ssize_t n = 0;
+    if(uring_io(fd, make_sqe(IORING_OP_RECV, buf, count, 0), SO_RCVTIMEO, n)) {
+        return n;
+    }
     return do_io(fd, read_f, "read", awcotn::IOManager::READ, SO_RCVTIMEO,
                  buf, count);
 }
@@ -335,6 +427,11 @@ ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
                  iov, iovcnt);
 }
 ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+    ssize_t n = 0;
+    if(!(flags & MSG_DONTWAIT)
+            && uring_io(sockfd, make_sqe(IORING_OP_RECV, buf, len, flags), SO_RCVTIMEO, n)) {
+        return n;
+    }
     return do_io(sockfd, recv_f, "recv", awcotn::IOManager::READ, SO_RCVTIMEO,
                  buf, len, flags);
 }
@@ -351,6 +448,10 @@ ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
 }
 
 ssize_t write(int fd, const void* buf, size_t count) {
+    ssize_t n = 0;
+    if(uring_io(fd, make_sqe(IORING_OP_SEND, buf, count, 0), SO_SNDTIMEO, n)) {
+        return n;
+    }
     return do_io(fd, write_f, "write", awcotn::IOManager::WRITE, SO_SNDTIMEO,
                  buf, count);
 }
@@ -361,6 +462,11 @@ ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
 }
 
 ssize_t send(int sockfd, const void* buf, size_t len, int flags) {
+    ssize_t n = 0;
+    if(!(flags & MSG_DONTWAIT)
+            && uring_io(sockfd, make_sqe(IORING_OP_SEND, buf, len, flags), SO_SNDTIMEO, n)) {
+        return n;
+    }
     return do_io(sockfd, send_f, "send", awcotn::IOManager::WRITE, SO_SNDTIMEO,
                  buf, len, flags);
 }
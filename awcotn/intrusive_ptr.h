@@ -0,0 +1,140 @@
+#ifndef __AWCOTN_INTRUSIVE_PTR_H__
+#define __AWCOTN_INTRUSIVE_PTR_H__
+
+#include <stddef.h>
+#include <functional>
+#include <utility>
+
+namespace awcotn {
+
+/**
+ * @brief 侵入式引用计数智能指针
+ * @details
+ * 引用计数保存在对象内部, 通过ADL查找的自由函数操作:
+ *     void intrusive_ptr_add_ref(T* p);
+ *     void intrusive_ptr_release(T* p);   //计数归零时释放对象
+ *     long intrusive_ptr_use_count(const T* p);
+ * 与std::shared_ptr相比:
+ * 1. 没有单独的控制块, 从裸指针构造不需要分配内存, 也不需要shared_from_this
+ * 2. 指针只有一个字, 移动构造/赋值不修改计数
+ * 接口保持与std::shared_ptr常用部分一致, 原有代码可以直接替换
+ */
+template<class T>
+class IntrusivePtr {
+public:
+    typedef T element_type;
+
+    IntrusivePtr()
+        : m_ptr(nullptr) {
+    }
+
+    IntrusivePtr(std::nullptr_t)
+        : m_ptr(nullptr) {
+    }
+
+    explicit IntrusivePtr(T* p)
+        : m_ptr(p) {
+        if(m_ptr) {
+            intrusive_ptr_add_ref(m_ptr);
+        }
+    }
+
+    IntrusivePtr(const IntrusivePtr& rhs)
+        : m_ptr(rhs.m_ptr) {
+        if(m_ptr) {
+            intrusive_ptr_add_ref(m_ptr);
+        }
+    }
+
+    IntrusivePtr(IntrusivePtr&& rhs)
+        : m_ptr(rhs.m_ptr) {
+        rhs.m_ptr = nullptr;
+    }
+
+    ~IntrusivePtr() {
+        if(m_ptr) {
+            intrusive_ptr_release(m_ptr);
+        }
+    }
+
+    IntrusivePtr& operator=(const IntrusivePtr& rhs) {
+        IntrusivePtr(rhs).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr& operator=(IntrusivePtr&& rhs) {
+        IntrusivePtr(std::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    void reset() {
+        IntrusivePtr().swap(*this);
+    }
+
+    void reset(T* p) {
+        IntrusivePtr(p).swap(*this);
+    }
+
+    void swap(IntrusivePtr& rhs) {
+        std::swap(m_ptr, rhs.m_ptr);
+    }
+
+    T* get() const { return m_ptr; }
+
+    T& operator*() const { return *m_ptr; }
+
+    T* operator->() const { return m_ptr; }
+
+    explicit operator bool() const { return m_ptr != nullptr; }
+
+    long use_count() const {
+        return m_ptr ? intrusive_ptr_use_count(m_ptr) : 0;
+    }
+private:
+    T* m_ptr;
+};
+
+template<class T, class U>
+bool operator==(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b) {
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b) {
+    return a.get() != b.get();
+}
+
+template<class T>
+bool operator==(const IntrusivePtr<T>& a, std::nullptr_t) {
+    return !a;
+}
+
+template<class T>
+bool operator!=(const IntrusivePtr<T>& a, std::nullptr_t) {
+    return (bool)a;
+}
+
+template<class T>
+bool operator<(const IntrusivePtr<T>& a, const IntrusivePtr<T>& b) {
+    return std::less<T*>()(a.get(), b.get());
+}
+
+}
+
+namespace std {
+
+template<class T>
+struct hash<awcotn::IntrusivePtr<T> > {
+    size_t operator()(const awcotn::IntrusivePtr<T>& p) const {
+        return hash<T*>()(p.get());
+    }
+};
+
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include "iomanager.h"
+#include "config.h"
 #include "macro.h"
 #include "log.h"
+#include "uring.h"
+#include <poll.h>
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -11,6 +14,43 @@ namespace awcotn {
 
 static awcotn::Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
 
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Lookup<std::string>("iomanager.backend", "epoll"
+            , "default iomanager backend: epoll or io_uring");
+
+static ConfigVar<uint32_t>::ptr g_uring_entries =
+    Config::Lookup<uint32_t>("iomanager.uring.entries", 256
+            , "io_uring submission queue entries");
+
+static ConfigVar<uint32_t>::ptr g_uring_batch =
+    Config::Lookup<uint32_t>("iomanager.uring.batch", 16
+            , "submit pending sqes after this many sqes or tasks");
+
+/**
+ * @brief io_uring的user_data: 低3位为类型, 其余为指针(FdContext和UringOp至少8字节对齐)
+ * @details POLL_READ/POLL_WRITE的高16位为FdContext中事件的代数(用户态指针不超过48位)
+ */
+enum UringTag {
+    URING_OP         = 0,   //UringOp, 操作本身
+    URING_TIMEOUT    = 1,   //UringOp, 链接在操作后面的超时
+    URING_POLL_READ  = 2,   //FdContext, addEvent(READ)
+    URING_POLL_WRITE = 3,   //FdContext, addEvent(WRITE)
+    URING_TICKLE     = 4,   //tickle管道
+    URING_IGNORE     = 5    //取消操作本身的结果
+};
+static const uint64_t URING_TAG_MASK = 7;
+static const int URING_GEN_SHIFT = 48;
+static const uint64_t URING_PTR_MASK = ((1ull << URING_GEN_SHIFT) - 1) & ~URING_TAG_MASK;
+
+//事件当前poll的user_data, 调用者持有fd_ctx->mutex
+static uint64_t PollUserData(void* fd_ctx, IOManager::Event event, uint16_t gen) {
+    return (uint64_t)(uintptr_t)fd_ctx | (event == IOManager::READ ? URING_POLL_READ : URING_POLL_WRITE)
+        | ((uint64_t)gen << URING_GEN_SHIFT);
+}
+
+//本线程上次提交之后执行的任务数
+static thread_local uint32_t t_uring_ticks = 0;
+
 /**
  * @brief 获取指定事件类型对应的事件上下文
  * @param event 事件类型(READ/WRITE)
@@ -35,6 +75,7 @@ void IOManager::FdContext::resetContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.nonBlocking = false;
 }
 
 /**
@@ -46,7 +87,11 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     AWCOTN_ASSERT(events & event);
     events = (Event)(events & ~event);
     EventContext& ctx = getContext(event);  
-    if(ctx.cb) {
+    if(ctx.cb && ctx.nonBlocking) {
+        ctx.scheduler->scheduleInline(std::move(ctx.cb));
+        ctx.cb = nullptr;
+        ctx.nonBlocking = false;
+    } else if(ctx.cb) {
         ctx.scheduler->schedule(&ctx.cb);
     } else {
         ctx.scheduler->schedule(&ctx.fiber);
@@ -60,6 +105,7 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
  * @param threads 线程数量
  * @param use_caller 是否使用调用者线程
  * @param name 调度器名称
+ * @param backend IO多路复用后端, io_uring不可用时退回epoll
  * @details 
  * 创建epoll实例，并设置通知机制用于唤醒idle线程
  * 
@@ -67,30 +113,55 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
  * 整个IOManager只创建一个epoll实例(m_epfd)，
  * 所有工作线程的idle协程都监听这同一个epoll实例，
  * 从而实现多线程协同处理IO事件的高效模型。
+ * io_uring后端同样只有一个ring(m_ring), 所有idle协程等待它的完成队列
  */
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) 
-    : Scheduler(threads, use_caller, name) {
-    // 创建epoll实例，参数5000只是一个提示，不是实际限制
-    m_epfd = epoll_create(5000);
-    AWCOTN_ASSERT(m_epfd > 0);   
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name
+                     , size_t max_threads, Backend backend)
+    : Scheduler(threads, use_caller, name, max_threads) {
+    if(backend == DEFAULT_BACKEND) {
+        backend = g_iomanager_backend->getValue() == "io_uring" ? URING_BACKEND : EPOLL_BACKEND;
+    }
+    if(backend == URING_BACKEND) {
+        m_ring = new IoUring;
+        if(m_ring->init(std::max<uint32_t>(g_uring_entries->getValue(), 8))) {
+            m_backend = URING_BACKEND;
+            m_uringBatch = std::max<uint32_t>(g_uring_batch->getValue(), 1);
+        } else {
+            AWCOTN_LOG_WARN(g_logger) << "io_uring unavailable (" << errno << ") ("
+                << strerror(errno) << "), fall back to epoll";
+            delete m_ring;
+            m_ring = nullptr;
+        }
+    }
 
     // 创建管道用于通知/唤醒idle线程
     int rt = pipe(m_tickleFds);
     AWCOTN_ASSERT(!rt);
-
-    // 配置epoll监听管道的读端，设置为边缘触发模式(EPOLLET)
-    epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = m_tickleFds[0];
-
-    // 设置管道读端为非阻塞模式
     rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
     AWCOTN_ASSERT(rt == 0);
 
-    // 将管道读端添加到epoll实例
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-    AWCOTN_ASSERT(!rt);
+    if(m_ring) {
+        // io_uring后端: 管道读端用POLL_ADD监听, 每次触发后重新注册
+        {
+            Spinlock::Lock lock(m_sqLock);
+            armPoll(m_tickleFds[0], POLLIN, URING_TICKLE);
+        }
+        flushSubmit();
+    } else {
+        // 创建epoll实例，参数5000只是一个提示，不是实际限制
+        m_epfd = epoll_create(5000);
+        AWCOTN_ASSERT(m_epfd > 0);
+
+        // 配置epoll监听管道的读端，设置为边缘触发模式(EPOLLET)
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = m_tickleFds[0];
+
+        // 将管道读端添加到epoll实例
+        rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+        AWCOTN_ASSERT(!rt);
+    }
 
     // 初始化文件描述符上下文数组
     contextResize(32);
@@ -106,7 +177,12 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
 IOManager::~IOManager() {
     AWCOTN_LOG_INFO(g_logger) << "IOManager::~IOManager";
     stop();
-    close(m_epfd);
+    if(m_epfd > 0) {
+        close(m_epfd);
+    }
+    if(m_ring) {
+        delete m_ring;
+    }
     close(m_tickleFds[0]);
     close(m_tickleFds[1]);
 
@@ -132,15 +208,32 @@ void IOManager::contextResize(size_t size) {
     }
 }
 
+/**
+ * @brief 获取fd的上下文, fd超出数组大小时扩容
+ */
+IOManager::FdContext* IOManager::getFdContext(int fd) {
+    RWMutexType::ReadLock lock(m_mutex);
+    if(fd < (int)m_fdContexts.size()) {
+        return m_fdContexts[fd];
+    }
+    lock.unlock();
+    RWMutexType::WriteLock lock2(m_mutex);
+    if(fd >= (int)m_fdContexts.size()) {
+        contextResize(fd * 1.5);
+    }
+    return m_fdContexts[fd];
+}
+
 /**
  * @brief 向IO事件监听器添加事件
  * @param fd 文件描述符
  * @param event 待添加的事件类型(READ/WRITE)
  * @param cb 事件发生时的回调函数，如不传入，则使用当前协程
+ * @param non_blocking cb不会阻塞, 触发后在调度协程上直接执行
  * @return 成功返回0，出错返回-1
  * @details 该函数将一个文件描述符的指定事件注册到epoll中，并设置对应的回调
  */
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+int IOManager::addEvent(int fd, Event event, Task cb, bool non_blocking) {
     // 获取文件描述符对应的上下文对象
     FdContext* fd_ctx = nullptr;
     // 读锁保护，尝试从已有列表获取fd上下文
@@ -167,34 +260,42 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
         AWCOTN_ASSERT(!(fd_ctx->events & event));
     }
 
-    // 根据文件描述符当前状态确定epoll操作类型
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    // - 如果fd_ctx->events已有值(非0)，表示该fd已注册到epoll中，需要修改(MOD)
-    // - 如果fd_ctx->events为0，表示该fd未注册，需要添加(ADD)
+    if(m_ring) {
+        // io_uring后端: 每个事件一个一次性的POLL_ADD, 不需要epoll_ctl
+        uint16_t& gen = event == READ ? fd_ctx->readGen : fd_ctx->writeGen;
+        ++gen;
+        Spinlock::Lock lock3(m_sqLock);
+        armPoll(fd, event == READ ? POLLIN : POLLOUT, PollUserData(fd_ctx, event, gen));
+    } else {
+        // 根据文件描述符当前状态确定epoll操作类型
+        int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        // - 如果fd_ctx->events已有值(非0)，表示该fd已注册到epoll中，需要修改(MOD)
+        // - 如果fd_ctx->events为0，表示该fd未注册，需要添加(ADD)
     
-    // 创建epoll事件结构体用于配置
-    epoll_event epevent;
+        // 创建epoll事件结构体用于配置
+        epoll_event epevent;
     
-    // 设置要监听的事件类型，包含三部分:
-    epevent.events = EPOLLET | fd_ctx->events | event;
-    // - EPOLLET: 设置边缘触发模式(Edge Triggered)，只在状态变化时触发一次，
-    //   区别于水平触发模式(Level Triggered)会持续触发直到处理完毕
-    // - fd_ctx->events: 保留该fd已有的事件监听设置
-    // - event: 添加新的事件类型(如EPOLLIN、EPOLLOUT等)
+        // 设置要监听的事件类型，包含三部分:
+        epevent.events = EPOLLET | (uint32_t)fd_ctx->events | (uint32_t)event;
+        // - EPOLLET: 设置边缘触发模式(Edge Triggered)，只在状态变化时触发一次，
+        //   区别于水平触发模式(Level Triggered)会持续触发直到处理完毕
+        // - fd_ctx->events: 保留该fd已有的事件监听设置
+        // - event: 添加新的事件类型(如EPOLLIN、EPOLLOUT等)
     
-    // 设置用户数据，将fd上下文对象与事件关联
-    epevent.data.ptr = fd_ctx;
-    // - 当事件触发时，epoll_wait返回该指针，使程序能找回完整的上下文信息
-    // - 这比仅存储fd号更灵活，可以关联到复杂的数据结构
+        // 设置用户数据，将fd上下文对象与事件关联
+        epevent.data.ptr = fd_ctx;
+        // - 当事件触发时，epoll_wait返回该指针，使程序能找回完整的上下文信息
+        // - 这比仅存储fd号更灵活，可以关联到复杂的数据结构
     
-    // 执行epoll_ctl系统调用，将事件添加到epoll实例
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        // 如果操作失败，记录错误并返回
-        AWCOTN_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-            << op << ", " << fd << ", " << epevent.events << "):"
-            << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return -1;
+        // 执行epoll_ctl系统调用，将事件添加到epoll实例
+        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        if(rt) {
+            // 如果操作失败，记录错误并返回
+            AWCOTN_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                << op << ", " << fd << ", " << epevent.events << "):"
+                << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return -1;
+        }
     }
     
     // 增加待处理事件计数
@@ -214,12 +315,17 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     if(cb) {
         // 如果提供了回调函数，保存回调函数
         event_ctx.cb.swap(cb);
+        event_ctx.nonBlocking = non_blocking;
     } else {
         // 否则，使用当前协程作为回调
         event_ctx.fiber = Fiber::GetThis();
         // 确保当前协程处于运行状态
         AWCOTN_ASSERT(event_ctx.fiber->getState() == Fiber::EXEC);
     }
+    // 不在本调度器的线程中(没有idle和onTaskDone替它提交)时立即提交
+    if(m_ring && (Scheduler::GetThis() != this || m_ring->getPending() >= m_uringBatch)) {
+        flushSubmit();
+    }
     return 0;
 }
 
@@ -243,12 +349,20 @@ bool IOManager::delEvent(int fd, Event event) {
         return false;
     }
 
+    if(m_ring) {
+        removePollEvent(fd_ctx, event);
+        m_pendingEventCount--;
+        fd_ctx->events = (Event)(fd_ctx->events & ~event);
+        fd_ctx->resetContext(fd_ctx->getContext(event));
+        return true;
+    }
+
     // 计算删除事件后的事件集合
     Event new_events = (Event)(fd_ctx->events & ~event);
     // 根据剩余事件决定epoll操作：有则修改，无则删除
     int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
     epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
+    epevent.events = EPOLLET | (uint32_t)new_events;
     epevent.data.ptr = fd_ctx;
 
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
@@ -288,12 +402,19 @@ bool IOManager::cancelEvent(int fd, Event event) {
         return false;
     }
 
+    if(m_ring) {
+        removePollEvent(fd_ctx, event);
+        m_pendingEventCount--;
+        fd_ctx->triggerEvent(event);
+        return true;
+    }
+
     // 计算取消事件后的事件集合
     Event new_events = (Event)(fd_ctx->events & ~event);
     // 根据剩余事件决定epoll操作：有则修改，无则删除
     int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
     epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
+    epevent.events = EPOLLET | (uint32_t)new_events;
     epevent.data.ptr = fd_ctx;
 
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
@@ -327,6 +448,9 @@ bool IOManager::cancelAll(int fd) {
     lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if(m_ring) {
+        return cancelAllUring(fd_ctx);
+    }
     if(!fd_ctx->events) {
         return false;
     }
@@ -372,7 +496,7 @@ IOManager* IOManager::GetThis() {
  * @details 通过向tickle管道写入数据唤醒epoll_wait阻塞的线程
  */
 void IOManager::tickle() {
-    if(hasIdleThreads()) {
+    if(!hasIdleThreads()) {
         return;
     }
     int rt = write(m_tickleFds[1], "T", 1);
@@ -384,17 +508,17 @@ void IOManager::tickle() {
  * @return 如果调度器应该停止返回true，否则返回false
  */
 bool IOManager::stopping() {
-    uint64_t timeout = getNextTimer();
+    uint64_t timeout = 0;
     return stopping(timeout);
 }
 
 /**
  * @brief 检查调度器是否应该停止
- * @param timeout 下一个定时器的超时时间
+ * @param[out] timeout 下一个定时器的超时时间, 没有定时器时为~0ull
  * @return 如果调度器应该停止返回true，否则返回false
  * @details 当没有定时器、没有待处理事件且调度器状态为停止时返回true
  */
-bool IOManager::stopping(uint64_t timeout) {
+bool IOManager::stopping(uint64_t& timeout) {
     timeout = getNextTimer();
     return timeout == ~0ull
         && m_pendingEventCount == 0
@@ -419,6 +543,10 @@ bool IOManager::stopping(uint64_t timeout) {
  * 这使得多线程共享epoll实例的设计更加高效。
  */
 void IOManager::idle() {
+    if(m_ring) {
+        idleUring();
+        return;
+    }
     // 分配一个长度为64的epoll_event数组，用于存储从epoll_wait返回的事件
     // 使用()初始化确保所有元素被零初始化
     epoll_event* events = new epoll_event[64]();
@@ -435,6 +563,10 @@ void IOManager::idle() {
             AWCOTN_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
             break;
         }
+        if(retireIdle()) {
+            AWCOTN_LOG_INFO(g_logger) << "name=" << getName() << " idle retire exit";
+            break;
+        }
 
         int rt = 0; // 存储epoll_wait返回的事件数量
         while(true) {
@@ -463,12 +595,20 @@ void IOManager::idle() {
             }
         } 
 
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs); // 获取所有过期的定时器回调函数
+        std::vector<Task> cbs;
+        std::vector<Task> inline_cbs;
+        listExpiredCb(cbs, &inline_cbs); // 获取所有过期的定时器回调函数
         if(!cbs.empty()) {
             schedule(cbs.begin(), cbs.end()); // 调度执行这些回调函数
             cbs.clear(); // 清空回调函数列表
         }
+        if(!inline_cbs.empty()) {
+            // 不会阻塞的回调(如唤醒sleep的协程)在调度协程上直接执行
+            scheduleInline(inline_cbs.begin(), inline_cbs.end());
+        }
+
+        // 回收长时间挂起的协程栈中未使用的物理页, 内部限制扫描频率
+        Fiber::TrimParkedStacks();
         
         // 处理所有返回的事件，rt是返回的事件数量
         for(int i = 0; i < rt; i++) {
@@ -507,6 +647,8 @@ void IOManager::idle() {
             if((fd_ctx->events & real_events) == NONE) {
                 continue;
             }
+            // 错误/挂起时映射成了读写两种事件, 只触发实际注册了的
+            real_events &= fd_ctx->events;
             
             // 计算剩余事件：从fd_ctx的事件中移除已触发的事件
             int left_events = (fd_ctx->events & ~real_events);
@@ -556,58 +698,312 @@ void IOManager::onTimerInsertedAtFront() {
 }
 
 /**
- * @brief 协程间调用，处理调用者与被调用者的同步问题
+ * @brief io_uring后端的idle: 提交积攒的sqe并等待完成, 一次系统调用
+ * @details 与epoll一样所有线程等待同一个ring; 取cqe由m_cqLock保护, 取出后在锁外处理
+ */
+void IOManager::idleUring() {
+    static const unsigned MAX_CQES = 64;
+    std::vector<io_uring_cqe> cqes(MAX_CQES);
+    while(true) {
+        uint64_t next_timeout = 0;
+        if(stopping(next_timeout)) {
+            AWCOTN_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+            break;
+        }
+        if(retireIdle()) {
+            AWCOTN_LOG_INFO(g_logger) << "name=" << getName() << " idle retire exit";
+            break;
+        }
+
+        static const uint64_t MAX_TIMEOUT = 1000;
+        t_uring_ticks = 0;
+        int rt = m_ring->enter(1, std::min(next_timeout, MAX_TIMEOUT));
+        if(rt < 0 && rt != -EINTR && rt != -ETIME && rt != -EBUSY) {
+            AWCOTN_LOG_ERROR(g_logger) << "io_uring_enter(" << m_ring->getFd() << "):"
+                << rt << " (" << strerror(-rt) << ")";
+        }
+
+        std::vector<Task> cbs;
+        std::vector<Task> inline_cbs;
+        listExpiredCb(cbs, &inline_cbs);
+        if(!cbs.empty()) {
+            schedule(cbs.begin(), cbs.end());
+            cbs.clear();
+        }
+        if(!inline_cbs.empty()) {
+            scheduleInline(inline_cbs.begin(), inline_cbs.end());
+        }
+
+        Fiber::TrimParkedStacks();
+
+        while(true) {
+            unsigned n = 0;
+            {
+                Spinlock::Lock lock(m_cqLock);
+                n = m_ring->reap(&cqes[0], MAX_CQES);
+            }
+            for(unsigned i = 0; i < n; ++i) {
+                onCompletion(cqes[i].user_data, cqes[i].res);
+            }
+            if(n < MAX_CQES) {
+                break;
+            }
+        }
+
+        Fiber::ptr cur = Fiber::GetThis();
+        auto raw_ptr = cur.get();
+        cur.reset();
+        raw_ptr->swapOut();
+    }
+}
+
+void IOManager::onCompletion(uint64_t user_data, int res) {
+    void* ptr = (void*)(uintptr_t)(user_data & URING_PTR_MASK);
+    switch(user_data & URING_TAG_MASK) {
+        case URING_OP: {
+            UringOp* op = (UringOp*)ptr;
+            op->res = res;
+            finishOp(op);
+            break;
+        }
+        case URING_TIMEOUT: {
+            UringOp* op = (UringOp*)ptr;
+            if(res == -ETIME) {
+                op->timedOut = true;
+            }
+            finishOp(op);
+            break;
+        }
+        case URING_POLL_READ:
+        case URING_POLL_WRITE: {
+            FdContext* fd_ctx = (FdContext*)ptr;
+            Event event = (user_data & URING_TAG_MASK) == URING_POLL_READ ? READ : WRITE;
+            uint16_t gen = (uint16_t)(user_data >> URING_GEN_SHIFT);
+            FdContext::MutexType::Lock lock(fd_ctx->mutex);
+            // 事件已经删除/取消, 或者是之前注册后被删除的poll(删除后又addEvent时代数不同)
+            if(!(fd_ctx->events & event)
+                    || gen != (event == READ ? fd_ctx->readGen : fd_ctx->writeGen)) {
+                break;
+            }
+            if(res == -ECANCELED) {
+                // 当前的poll被取消但事件还在, 是提交它的线程退出时内核取消了poll, 重新注册
+                Spinlock::Lock lock2(m_sqLock);
+                armPoll(fd_ctx->fd, event == READ ? POLLIN : POLLOUT, user_data);
+                break;
+            }
+            // 出错(POLLERR/POLLHUP或res < 0)时也触发, 由协程读写时得到具体错误
+            fd_ctx->triggerEvent(event);
+            --m_pendingEventCount;
+            break;
+        }
+        case URING_TICKLE: {
+            uint8_t dummy[256];
+            while(read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
+            Spinlock::Lock lock(m_sqLock);
+            armPoll(m_tickleFds[0], POLLIN, URING_TICKLE);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief 操作和它的超时都完成后唤醒等待的协程
+ * @details 唤醒之后op所在的协程栈随时可能失效, 不能再访问op
+ */
+void IOManager::finishOp(UringOp* op) {
+    if(--op->refs > 0) {
+        return;
+    }
+    --op->fdCtx->inflight;
+    Scheduler* scheduler = op->scheduler;
+    Fiber::ptr fiber;
+    fiber.swap(op->fiber);
+    scheduler->schedule(&fiber);
+    --m_pendingEventCount;
+}
+
+io_uring_sqe* IOManager::getSqe(unsigned n) {
+    while(!m_ring->hasSpace(n)) {
+        // 提交队列满了, 先把已有的提交给内核
+        int rt = m_ring->enter();
+        if(rt <= 0) {
+            if(rt < 0 && rt != -EINTR && rt != -EAGAIN && rt != -EBUSY) {
+                AWCOTN_LOG_ERROR(g_logger) << "io_uring_enter(" << m_ring->getFd() << "):"
+                    << rt << " (" << strerror(-rt) << ")";
+            }
+            sched_yield();
+        }
+    }
+    return m_ring->getSqe();
+}
+
+void IOManager::armPoll(int fd, uint32_t poll_events, uint64_t user_data) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_events;
+    sqe->user_data = user_data;
+    m_ring->commit();
+}
+
+void IOManager::removePollEvent(FdContext* fd_ctx, Event event) {
+    {
+        Spinlock::Lock lock(m_sqLock);
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = PollUserData(fd_ctx, event, event == READ ? fd_ctx->readGen : fd_ctx->writeGen);
+        sqe->user_data = URING_IGNORE;
+        m_ring->commit();
+    }
+    // poll持有file的引用, 尽快提交, 否则close后连接不会真正关闭
+    flushSubmit();
+}
+
+bool IOManager::cancelAllUring(FdContext* fd_ctx) {
+    if(!fd_ctx->events && !fd_ctx->inflight) {
+        return false;
+    }
+    {
+        Spinlock::Lock lock(m_sqLock);
+        if(fd_ctx->events & READ) {
+            io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = PollUserData(fd_ctx, READ, fd_ctx->readGen);
+            sqe->user_data = URING_IGNORE;
+        }
+        if(fd_ctx->events & WRITE) {
+            io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = PollUserData(fd_ctx, WRITE, fd_ctx->writeGen);
+            sqe->user_data = URING_IGNORE;
+        }
+        if(fd_ctx->inflight) {
+            // 正在执行的操作以-ECANCELED完成
+            io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd_ctx->fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = URING_IGNORE;
+        }
+        m_ring->commit();
+    }
+    flushSubmit();
+    if(fd_ctx->events & READ) {
+        fd_ctx->triggerEvent(READ);
+        m_pendingEventCount --;
+    }
+    if(fd_ctx->events & WRITE) {
+        fd_ctx->triggerEvent(WRITE);
+        m_pendingEventCount --;
+    }
+    return true;
+}
+
+void IOManager::flushSubmit() {
+    t_uring_ticks = 0;
+    if(!m_ring->getPending()) {
+        return;
+    }
+    int rt = m_ring->enter();
+    if(rt < 0 && rt != -EINTR && rt != -EAGAIN && rt != -EBUSY) {
+        AWCOTN_LOG_ERROR(g_logger) << "io_uring_enter(" << m_ring->getFd() << "):"
+            << rt << " (" << strerror(-rt) << ")";
+    }
+}
+
+/**
+ * @brief 工作线程执行完一个任务
+ * @details 任务中提交的sqe先积攒起来, 积攒了m_uringBatch个或者本线程又执行了m_uringBatch个任务后
+ *          一起提交; 线程没有任务时idle在等待的同一次系统调用中提交
+ */
+void IOManager::onTaskDone() {
+    if(m_ring && m_ring->getPending() && ++t_uring_ticks >= m_uringBatch) {
+        flushSubmit();
+    }
+}
+
+/**
+ * @brief 提交一个操作并挂起当前协程, 直到操作完成
+ * @details 操作和超时的sqe都在当前协程栈上的op中收尾, 两个cqe都到达后才唤醒协程,
+ *          所以协程恢复后内核不会再访问op和ts
+ */
+int IOManager::submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms) {
+    AWCOTN_ASSERT(m_ring);
+    UringOp op;
+    op.fdCtx = getFdContext(sqe.fd);
+    op.scheduler = Scheduler::GetThis();
+    op.fiber = Fiber::GetThis();
+    AWCOTN_ASSERT(op.fiber->getState() == Fiber::EXEC);
+    AWCOTN_ASSERT2(!op.fiber->isSharedStack(), "submitIo on shared-stack fiber");
+    bool has_timeout = timeout_ms != (uint64_t)-1;
+    __kernel_timespec ts;
+    if(has_timeout) {
+        op.refs = 2;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = timeout_ms % 1000 * 1000000;
+    }
+    ++op.fdCtx->inflight;
+    ++m_pendingEventCount;
+    {
+        Spinlock::Lock lock(m_sqLock);
+        io_uring_sqe* s = getSqe(has_timeout ? 2 : 1);
+        *s = sqe;
+        s->user_data = (uint64_t)(uintptr_t)&op | URING_OP;
+        if(has_timeout) {
+            s->flags |= IOSQE_IO_LINK;
+            s = getSqe();
+            s->opcode = IORING_OP_LINK_TIMEOUT;
+            s->fd = -1;
+            s->addr = (uint64_t)(uintptr_t)&ts;
+            s->len = 1;
+            s->user_data = (uint64_t)(uintptr_t)&op | URING_TIMEOUT;
+        }
+        m_ring->commit();
+    }
+    if(Scheduler::GetThis() != this || m_ring->getPending() >= m_uringBatch) {
+        flushSubmit();
+    }
+    Fiber::YieldToHold();
+    if(op.timedOut && op.res == -ECANCELED) {
+        return -ETIMEDOUT;
+    }
+    return op.res;
+}
+
+/**
+ * @brief 协程间调用
  * @param callee 被调用协程
  * @return 返回被调用协程
  * @details 
- *   使用共享状态解决A调用B，B先返回而A还未挂起的问题
+ *   通过Scheduler::CallFiber直接切换到callee, callee挂起或结束后调用者在本线程继续执行,
+ *   不经过调度协程和任务队列; 不能直接切换时调度callee并等待它结束
  */
 Fiber::ptr IOManager::call(Fiber::ptr callee) {
     AWCOTN_ASSERT(callee);
+    AWCOTN_ASSERT(GetThis());
+    AWCOTN_ASSERT(Fiber::GetThis()->getState() == Fiber::EXEC);
     
-    // 获取当前调用者协程
-    Fiber::ptr caller = Fiber::GetThis();
-    AWCOTN_ASSERT(caller && caller->getState() == Fiber::EXEC);
-    
-    // 获取当前调度器
-    auto scheduler = GetThis();
-    AWCOTN_ASSERT(scheduler);
-    
-    // 检查被调用协程状态
     if(callee->getState() == Fiber::TERM || 
        callee->getState() == Fiber::EXCEPT) {
         // 如果被调用协程已完成或异常，直接返回
         return callee;
     }
     
-    // 创建共享状态，用于协程间同步
-    auto cb_info = std::make_shared<CallBackInfo>();
-    cb_info->caller = caller;
-    cb_info->callee = callee;
-    cb_info->scheduler = scheduler;
-    
-    // 包装被调用协程，在其执行完成后设置标志
-    scheduler->schedule([cb_info](){
-        // 执行被调用协程
-        cb_info->callee->swapIn();
-        
-        // 被调用协程执行完成，设置完成标志
-        cb_info->is_callee_done = true;
-        
-        // 如果调用者协程已经挂起，则重新调度调用者
-        if(cb_info->caller->getState() != Fiber::EXEC) {
-            cb_info->scheduler->schedule(&cb_info->caller);
-        }
-    });
-    
-    // 重要：在挂起前先检查被调用协程是否已经完成
-    // 这是解决"B协程先返回而A协程尚未挂起"问题的关键
-    if(!cb_info->is_callee_done) {
-        // 被调用协程未完成，挂起调用者协程
-        caller->swapOut();
+    if(Scheduler::CallFiber(callee)) {
+        return callee;
+    }
+
+    // callee绑定了其它线程等情况
+    GetThis()->schedule(callee);
+    while(callee->getState() != Fiber::TERM
+            && callee->getState() != Fiber::EXCEPT) {
+        Fiber::YieldToReady();
     }
-    // 如果被调用协程已在设置标志前完成，调用者无需挂起
-    
     return callee;
 }
 
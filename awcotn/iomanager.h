@@ -2,9 +2,16 @@
 #define __AWCOTN_IOMANAGER_H__
 #include "scheduler.h"
 #include "timer.h"
+#ifdef AWCOTN_COROUTINE
+#include "coroutine.h"
+#endif
+
+struct io_uring_sqe;
 
 namespace awcotn {
 
+class IoUring;
+
 class IOManager : public Scheduler, public TimerManager {    
 public:
     typedef std::shared_ptr<IOManager> ptr;
@@ -17,15 +24,17 @@ public:
     };
 
     /**
-     * @brief 用于协程调用处理的回调信息结构
+     * @brief IO多路复用的后端
+     * @details
+     * EPOLL_BACKEND: fd就绪后由协程自己再调用一次read/write
+     * URING_BACKEND: 由io_uring执行hook的read/recv/write/send/accept/connect, 完成后唤醒协程;
+     *                addEvent用POLL_ADD代替epoll_ctl. sqe积攒后在空闲等待时或每执行若干任务后一起提交
+     * DEFAULT_BACKEND: 由配置iomanager.backend决定("epoll"/"io_uring"), 内核不支持io_uring时退回epoll
      */
-    struct CallBackInfo {
-        Fiber::ptr caller;      // 调用者协程
-        Fiber::ptr callee;      // 被调用协程
-        bool is_callee_done;    // 被调用协程是否完成
-        Scheduler* scheduler;   // 关联的调度器
-
-        CallBackInfo() : is_callee_done(false), scheduler(nullptr) {}
+    enum Backend {
+        DEFAULT_BACKEND = 0,
+        EPOLL_BACKEND   = 1,
+        URING_BACKEND   = 2
     };
 
 private:
@@ -34,7 +43,8 @@ private:
         struct EventContext {
             Scheduler* scheduler = nullptr; //事件执行的调度器
             Fiber::ptr fiber;               //事件协程
-            std::function<void()> cb;       //事件的回调函数
+            Task cb;                        //事件的回调函数
+            bool nonBlocking = false;       //回调不会阻塞, 触发后在调度协程上直接执行
         };
         EventContext& getContext(Event event);
         void resetContext(EventContext& ctx);
@@ -46,19 +56,52 @@ private:
         int fd;
         Event events = NONE;
         MutexType mutex;
+        //io_uring后端正在执行的操作数量, close时需要取消
+        std::atomic<int> inflight = {0};
+        //io_uring后端每次addEvent加一, 区分当前的poll和已经删除的poll迟到的完成
+        uint16_t readGen = 0;
+        uint16_t writeGen = 0;
+    };
+
+    //io_uring后端提交的一个操作, 在等待它的协程栈上
+    struct UringOp {
+        FdContext* fdCtx = nullptr;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        int res = 0;
+        bool timedOut = false;
+        //还没有收到的cqe数量(操作本身和超时各一个)
+        std::atomic<int> refs = {1};
     };
 
 public:
-    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+              , size_t max_threads = 0, Backend backend = DEFAULT_BACKEND);
     ~IOManager() noexcept override;
 
-    //0 success. -1 error
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    /**
+     * @param[in] non_blocking cb不会阻塞(不会让出), 触发后不创建回调协程直接执行(scheduleInline)
+     * @return 0 success. -1 error
+     */
+    int addEvent(int fd, Event event, Task cb = nullptr, bool non_blocking = false);
     bool delEvent(int fd, Event event);
     bool cancelEvent(int fd, Event event);
 
     bool cancelAll(int fd);
 
+    //实际使用的后端
+    Backend getBackend() const { return m_backend; }
+
+    /**
+     * @brief io_uring后端: 提交一个操作并挂起当前协程, 直到操作完成
+     * @param[in] sqe 填好opcode/fd/addr/len等的sqe, user_data和flags中的IOSQE_IO_LINK由这里设置
+     * @param[in] timeout_ms 超时时间, -1表示不超时; 超时后内核取消操作
+     * @return cqe的res(失败为-errno), 超时返回-ETIMEDOUT
+     * @pre 当前协程不是共享栈协程: 操作状态, 超时时间和sqe指向的缓冲区在挂起期间都要保持有效,
+     *      共享栈协程挂起后栈内容会被其它协程覆盖
+     */
+    int submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms = -1);
+
     static IOManager* GetThis();
     
     /**
@@ -67,24 +110,66 @@ public:
      * @return 返回被调用协程
      * @details 
      *   1. 如果callee已完成，直接返回
-     *   2. 如果callee未完成，挂起caller，等待callee完成
-     *   3. 防止caller尚未挂起，而callee已返回的情况
+     *   2. 否则直接切换到callee执行, callee挂起或结束后caller继续执行
+     *   3. 不能在本线程直接切换时(如callee绑定了其它线程), 调度callee并等待它结束
      */
     Fiber::ptr call(Fiber::ptr callee);
 
+#ifdef AWCOTN_COROUTINE
+    /**
+     * @brief C++20协程等待fd可读/可写: int rt = co_await iom.readable(fd)
+     * @param[in] timeout_ms 超时时间, -1表示不超时
+     * @details 见CoEventAwaiter, 协程在注册事件时所在的调度器上恢复
+     */
+    CoEventAwaiter readable(int fd, uint64_t timeout_ms = -1) {
+        return CoEventAwaiter(this, fd, READ, timeout_ms);
+    }
+    CoEventAwaiter writable(int fd, uint64_t timeout_ms = -1) {
+        return CoEventAwaiter(this, fd, WRITE, timeout_ms);
+    }
+    //C++20协程等待ms毫秒: co_await iom.sleepFor(ms)
+    CoSleepAwaiter sleepFor(uint64_t ms) { return CoSleepAwaiter(this, ms); }
+#endif
+
 protected:
     void tickle() override;
     bool stopping() override;
-    bool stopping(uint64_t timeout);
+    //timeout返回距离下一个定时器的时间
+    bool stopping(uint64_t& timeout);
     void idle() override;
+    void onTaskDone() override;
     void onTimerInsertedAtFront() override;
 
     void contextResize(size_t size);
 
 private:
+    FdContext* getFdContext(int fd);
+    //等待io_uring的完成事件, 由idle调用
+    void idleUring();
+    //处理一个cqe
+    void onCompletion(uint64_t user_data, int res);
+    void finishOp(UringOp* op);
+    //取sqe, 提交队列满时先提交; 调用者持有m_sqLock
+    io_uring_sqe* getSqe(unsigned n = 1);
+    void armPoll(int fd, uint32_t poll_events, uint64_t user_data);
+    //删除addEvent注册的POLL_ADD并立即提交, 调用者持有fd_ctx->mutex
+    void removePollEvent(FdContext* fd_ctx, Event event);
+    //取消fd上的poll和正在执行的操作, 触发注册的事件, 调用者持有fd_ctx->mutex
+    bool cancelAllUring(FdContext* fd_ctx);
+    //提交积攒的sqe
+    void flushSubmit();
+
+private:
+    Backend m_backend = EPOLL_BACKEND;
     int m_epfd = 0;
     int m_tickleFds[2];
 
+    IoUring* m_ring = nullptr;
+    Spinlock m_sqLock;
+    Spinlock m_cqLock;
+    //积攒了这么多sqe, 或者工作线程执行了这么多任务后提交
+    uint32_t m_uringBatch = 16;
+
     std::atomic<size_t> m_pendingEventCount = {0};  //待处理事件数量
     RWMutexType m_mutex;
     std::vector<FdContext*> m_fdContexts;
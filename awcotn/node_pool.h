@@ -0,0 +1,183 @@
+#ifndef __AWCOTN_NODE_POOL_H__
+#define __AWCOTN_NODE_POOL_H__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "mutex.h"
+
+namespace awcotn {
+
+/**
+ * @brief 固定大小节点的内存池, 用于调度队列的任务节点和链表节点
+ * @details
+ * 1. 每个线程一个空闲链表, 分配释放不加锁
+ * 2. 线程链表超过2 * BATCH时搬BATCH个到全局链表(加锁), 线程链表为空时从全局链表搬一批
+ *    节点在A线程分配在B线程释放也能在线程间流转, 稳定运行后不再调用operator new
+ * 3. 全局链表超过MAX_GLOBAL时直接释放
+ * 4. 线程退出时把空闲链表归还到全局链表
+ */
+template<size_t Size>
+class NodePool {
+public:
+    static const size_t BATCH = 64;
+    static const size_t MAX_GLOBAL = 65536;
+
+    static void* Alloc() {
+        ThreadCache& cache = GetThreadCache();
+        if(!cache.head) {
+            GetGlobal().take(cache);
+            if(!cache.head) {
+                return ::operator new(NodeSize);
+            }
+        }
+        FreeNode* node = cache.head;
+        cache.head = node->next;
+        --cache.count;
+        return node;
+    }
+
+    static void Free(void* p) {
+        ThreadCache& cache = GetThreadCache();
+        FreeNode* node = static_cast<FreeNode*>(p);
+        node->next = cache.head;
+        cache.head = node;
+        if(++cache.count > 2 * BATCH) {
+            GetGlobal().give(cache, BATCH);
+        }
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static const size_t NodeSize = Size < sizeof(FreeNode) ? sizeof(FreeNode) : Size;
+
+    struct ThreadCache {
+        FreeNode* head = nullptr;
+        size_t count = 0;
+
+        ~ThreadCache() {
+            GetGlobal().give(*this, count);
+        }
+    };
+
+    class Global {
+    public:
+        typedef Mutex MutexType;
+
+        //从全局链表搬最多BATCH个到线程链表
+        void take(ThreadCache& cache) {
+            MutexType::Lock lock(m_mutex);
+            for(size_t i = 0; i < BATCH && m_head; ++i) {
+                FreeNode* node = m_head;
+                m_head = node->next;
+                --m_count;
+                node->next = cache.head;
+                cache.head = node;
+                ++cache.count;
+            }
+        }
+
+        //从线程链表搬n个到全局链表, 超过上限的释放
+        void give(ThreadCache& cache, size_t n) {
+            FreeNode* release = nullptr;
+            {
+                MutexType::Lock lock(m_mutex);
+                for(size_t i = 0; i < n && cache.head; ++i) {
+                    FreeNode* node = cache.head;
+                    cache.head = node->next;
+                    --cache.count;
+                    if(m_count < MAX_GLOBAL) {
+                        node->next = m_head;
+                        m_head = node;
+                        ++m_count;
+                    } else {
+                        node->next = release;
+                        release = node;
+                    }
+                }
+            }
+            while(release) {
+                FreeNode* node = release;
+                release = node->next;
+                ::operator delete(node);
+            }
+        }
+    private:
+        MutexType m_mutex;
+        FreeNode* m_head = nullptr;
+        size_t m_count = 0;
+    };
+
+    static ThreadCache& GetThreadCache() {
+        static thread_local ThreadCache s_cache;
+        return s_cache;
+    }
+
+    //不析构, 其它线程退出时可能还在归还节点
+    static Global& GetGlobal() {
+        static Global* s_global = new Global;
+        return *s_global;
+    }
+};
+
+/**
+ * @brief 在NodePool上构造对象
+ */
+template<class T, class... Args>
+T* NewNode(Args&&... args) {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned node");
+    void* p = NodePool<sizeof(T)>::Alloc();
+    return new (p) T(std::forward<Args>(args)...);
+}
+
+/**
+ * @brief 析构NewNode构造的对象并归还到NodePool
+ */
+template<class T>
+void DeleteNode(T* p) {
+    p->~T();
+    NodePool<sizeof(T)>::Free(p);
+}
+
+/**
+ * @brief 单个元素从NodePool分配的分配器, 用于std::list等基于节点的容器
+ * @details 无状态, 任意两个实例相等, 容器之间可以splice
+ */
+template<class T>
+class NodeAllocator {
+public:
+    typedef T value_type;
+
+    NodeAllocator() {}
+
+    template<class U>
+    NodeAllocator(const NodeAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if(n == 1) {
+            return static_cast<T*>(NodePool<sizeof(T)>::Alloc());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if(n == 1) {
+            NodePool<sizeof(T)>::Free(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+template<class T, class U>
+bool operator==(const NodeAllocator<T>&, const NodeAllocator<U>&) { return true; }
+
+template<class T, class U>
+bool operator!=(const NodeAllocator<T>&, const NodeAllocator<U>&) { return false; }
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "numa.h"
+#include "log.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+
+namespace awcotn {
+
+static Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
+
+static bool ReadFile(const std::string& path, std::string& content) {
+    std::ifstream ifs(path);
+    if(!ifs) {
+        return false;
+    }
+    std::getline(ifs, content);
+    return true;
+}
+
+/**
+ * @brief 拓扑信息, 进程内只读取一次
+ */
+struct Topology {
+    std::vector<int> online;
+    std::vector<std::vector<int> > nodeCpus;
+    std::map<int, int> cpuNode;
+
+    Topology() {
+        std::string str;
+        if(!ReadFile("/sys/devices/system/cpu/online", str)
+                || !Numa::ParseCpuList(str, online) || online.empty()) {
+            online.clear();
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            for(long i = 0; i < n; ++i) {
+                online.push_back(i);
+            }
+        }
+        //节点编号可能不连续, 按编号顺序压缩
+        for(int node = 0; node < 1024; ++node) {
+            std::string path = "/sys/devices/system/node/node"
+                + std::to_string(node) + "/cpulist";
+            std::vector<int> cpus;
+            if(!ReadFile(path, str)) {
+                continue;
+            }
+            if(!Numa::ParseCpuList(str, cpus) || cpus.empty()) {
+                continue;
+            }
+            for(int cpu : cpus) {
+                cpuNode[cpu] = nodeCpus.size();
+            }
+            nodeCpus.push_back(cpus);
+        }
+        if(nodeCpus.empty()) {
+            nodeCpus.push_back(online);
+            for(int cpu : online) {
+                cpuNode[cpu] = 0;
+            }
+        }
+        AWCOTN_LOG_INFO(g_logger) << "numa nodes=" << nodeCpus.size()
+            << " online cpus=" << online.size();
+    }
+};
+
+static Topology& GetTopology() {
+    static Topology s_topology;
+    return s_topology;
+}
+
+size_t Numa::NodeCount() {
+    return GetTopology().nodeCpus.size();
+}
+
+int Numa::NodeOfCpu(int cpu) {
+    auto& topo = GetTopology();
+    auto it = topo.cpuNode.find(cpu);
+    return it == topo.cpuNode.end() ? 0 : it->second;
+}
+
+const std::vector<int>& Numa::CpusOfNode(int node) {
+    static const std::vector<int> s_empty;
+    auto& topo = GetTopology();
+    if(node < 0 || node >= (int)topo.nodeCpus.size()) {
+        return s_empty;
+    }
+    return topo.nodeCpus[node];
+}
+
+const std::vector<int>& Numa::OnlineCpus() {
+    return GetTopology().online;
+}
+
+int Numa::CurrentNode() {
+    if(NodeCount() == 1) {
+        return 0;
+    }
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : NodeOfCpu(cpu);
+}
+
+bool Numa::ParseCpuList(const std::string& str, std::vector<int>& cpus) {
+    cpus.clear();
+    const char* p = str.c_str();
+    while(*p) {
+        while(*p == ' ' || *p == ',' || *p == '\n') {
+            ++p;
+        }
+        if(!*p) {
+            break;
+        }
+        char* end = nullptr;
+        long begin = strtol(p, &end, 10);
+        if(end == p || begin < 0) {
+            return false;
+        }
+        long last = begin;
+        p = end;
+        if(*p == '-') {
+            ++p;
+            last = strtol(p, &end, 10);
+            if(end == p || last < begin) {
+                return false;
+            }
+            p = end;
+        }
+        for(long i = begin; i <= last; ++i) {
+            cpus.push_back(i);
+        }
+        if(*p && *p != ',' && *p != '\n' && *p != ' ') {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,42 @@
+#ifndef __AWCOTN_NUMA_H__
+#define __AWCOTN_NUMA_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace awcotn {
+
+/**
+ * @brief CPU/NUMA拓扑
+ * @details
+ * 第一次使用时从/sys/devices/system/node读取, 不依赖libnuma
+ * 读取失败(非NUMA内核或容器中没有sysfs)时视为只有一个节点, 包含所有在线CPU
+ */
+class Numa {
+public:
+    //节点数, 至少为1
+    static size_t NodeCount();
+
+    //CPU所在的节点, 未知的CPU返回0
+    static int NodeOfCpu(int cpu);
+
+    //节点上的CPU, 节点不存在返回空
+    static const std::vector<int>& CpusOfNode(int node);
+
+    //所有在线CPU
+    static const std::vector<int>& OnlineCpus();
+
+    //当前线程正在运行的CPU所在的节点
+    static int CurrentNode();
+
+    /**
+     * @brief 解析CPU列表, 格式同/sys的cpulist, 如"0-3,8,10-11"
+     * @return 格式错误返回false
+     */
+    static bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+};
+
+}
+
+#endif
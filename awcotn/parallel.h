@@ -0,0 +1,123 @@
+#ifndef __AWCOTN_PARALLEL_H__
+#define __AWCOTN_PARALLEL_H__
+
+#include <algorithm>
+#include <vector>
+#include "macro.h"
+#include "spawn_scope.h"
+
+namespace awcotn {
+
+/**
+ * @brief 数据并行: 把[begin, end)按grain切成块, 递归二分后分给调度器的工作线程
+ * @details
+ * 1. 每次二分时右半部分作为子任务提交(工作线程中进入本地队列, 空闲线程窃取时先拿到大块),
+ *    左半部分继续在当前协程中切分, 最后当前协程自己执行最左边的一块
+ * 2. 调用者执行完自己的块后挂起等待, 所在线程接着执行本地队列中剩下的块, 不阻塞线程;
+ *    在普通线程中调用时块在调度器中执行, 调用者阻塞等待
+ * 3. grain为每块的元素个数, 为0时按线程数自动选择(每个线程约8块)
+ * 4. 某一块抛出异常后还没开始的块不再执行, 等待已经开始的块结束后把第一个异常抛给调用者
+ * 5. 子任务的栈统计入口为调用者传入的fn(entry), 不同调用点的块不共用建议栈大小
+ */
+template<class F>
+struct ParallelChunks {
+    SpawnScope* scope;
+    F* fn;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    const std::type_info* entry;
+
+    //执行第[lo, hi)块的子任务
+    struct Part {
+        ParallelChunks* self;
+        size_t lo;
+        size_t hi;
+
+        void operator()() { self->run(lo, hi); }
+        const std::type_info* entryType() const { return self->entry; }
+    };
+
+    //执行第[lo, hi)块
+    void run(size_t lo, size_t hi) {
+        while(hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            scope->spawn(Part{this, mid, hi});
+            hi = mid;
+        }
+        if(scope->failed()) {
+            return;
+        }
+        size_t b = begin + lo * grain;
+        (*fn)(b, std::min(end, b + grain), lo);
+    }
+};
+
+//grain为0时的默认块大小
+inline size_t ParallelGrain(Scheduler* scheduler, size_t n, size_t grain) {
+    AWCOTN_ASSERT2(scheduler, "parallel call without scheduler");
+    if(grain) {
+        return grain;
+    }
+    size_t chunks = std::max<size_t>(scheduler->getThreadCount(), 1) * 8;
+    return std::max<size_t>((n + chunks - 1) / chunks, 1);
+}
+
+//fn(lo, hi, chunk)按块执行, 第chunk块为[lo, hi); entry为栈统计的入口
+template<class F>
+void ParallelChunked(Scheduler* scheduler, size_t begin, size_t end, size_t grain, F& fn
+                     ,const std::type_info* entry) {
+    if(begin >= end) {
+        return;
+    }
+    grain = ParallelGrain(scheduler, end - begin, grain);
+    size_t chunks = (end - begin + grain - 1) / grain;
+    ParallelChunks<F> root{nullptr, &fn, begin, end, grain, entry};
+    SpawnScope::Run([&root, chunks](SpawnScope& scope){
+        root.scope = &scope;
+        root.run(0, chunks);
+    }, scheduler);
+}
+
+/**
+ * @brief 并行执行fn(lo, hi), 各块覆盖[begin, end)且互不重叠
+ * @param[in] scheduler 执行的调度器
+ * @param[in] grain 每块的元素个数, 0表示自动选择
+ */
+template<class F>
+void ParallelFor(Scheduler* scheduler, size_t begin, size_t end, size_t grain, F&& fn) {
+    auto body = [&fn](size_t lo, size_t hi, size_t){ fn(lo, hi); };
+    ParallelChunked(scheduler, begin, end, grain, body, Task::EntryTypeOf(fn));
+}
+
+/**
+ * @brief 并行归约: 每块的结果由fn(lo, hi)计算, 再按块的顺序用reduce合并
+ * @details 合并顺序固定, reduce只需要满足结合律; 每块的结果保存在数组中, 块数为(end - begin) / grain
+ * @return 没有元素时返回identity, 否则返回reduce(...reduce(reduce(identity, r0), r1)..., rn)
+ */
+template<class T, class F, class R>
+T ParallelReduce(Scheduler* scheduler, size_t begin, size_t end, size_t grain
+                 ,T identity, F&& fn, R&& reduce) {
+    if(begin >= end) {
+        return identity;
+    }
+    grain = ParallelGrain(scheduler, end - begin, grain);
+    //包一层结构体, 避免T为bool时vector<bool>按位存储, 不同块写同一个字
+    struct Slot {
+        T value;
+    };
+    std::vector<Slot> partial((end - begin + grain - 1) / grain, Slot{identity});
+    auto body = [&fn, &partial](size_t lo, size_t hi, size_t chunk){
+        partial[chunk].value = fn(lo, hi);
+    };
+    ParallelChunked(scheduler, begin, end, grain, body, Task::EntryTypeOf(fn));
+    T rt = std::move(identity);
+    for(auto& i : partial) {
+        rt = reduce(std::move(rt), std::move(i.value));
+    }
+    return rt;
+}
+
+}
+
+#endif
@@ -3,6 +3,15 @@
 #include "macro.h"
 #include "thread.h"
 #include "hook.h"
+#include "config.h"
+#include "stack_profile.h"
+#include "numa.h"
+#include <algorithm>
+#include <map>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 namespace awcotn {
 
 static awcotn::Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
@@ -10,9 +19,295 @@ static awcotn::Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 static thread_local Fiber* t_scheduler_fiber = nullptr;
 
-Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
+static ConfigVar<uint32_t>::ptr g_fiber_pool_high_watermark =
+    Config::Lookup<uint32_t>("scheduler.fiber_pool.high_watermark", 64
+            , "max terminated fibers kept per worker for callback reuse");
+
+static ConfigVar<uint32_t>::ptr g_fiber_pool_low_watermark =
+    Config::Lookup<uint32_t>("scheduler.fiber_pool.low_watermark", 16
+            , "terminated fibers kept per worker after trimming the pool");
+
+static ConfigVar<uint32_t>::ptr g_local_queue_size =
+    Config::Lookup<uint32_t>("scheduler.local_queue_size", 256
+            , "capacity of per worker work-stealing queue");
+
+static uint32_t s_fiber_pool_high = 0;
+static uint32_t s_fiber_pool_low = 0;
+
+struct _FiberPoolIniter {
+    _FiberPoolIniter() {
+        s_fiber_pool_high = g_fiber_pool_high_watermark->getValue();
+        s_fiber_pool_low = g_fiber_pool_low_watermark->getValue();
+
+        g_fiber_pool_high_watermark->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.fiber_pool.high_watermark changed from "
+                                     << old_value << " to " << new_value;
+            s_fiber_pool_high = new_value;
+        });
+        g_fiber_pool_low_watermark->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.fiber_pool.low_watermark changed from "
+                                     << old_value << " to " << new_value;
+            s_fiber_pool_low = new_value;
+        });
+    }
+};
+
+static _FiberPoolIniter s_fiber_pool_initer;
+
+static ConfigVar<uint32_t>::ptr g_elastic_grow_queue_depth =
+    Config::Lookup<uint32_t>("scheduler.elastic.grow_queue_depth", 64
+            , "queued tasks that trigger adding a worker when no worker is idle");
+
+static ConfigVar<uint32_t>::ptr g_elastic_grow_wait_ms =
+    Config::Lookup<uint32_t>("scheduler.elastic.grow_wait_ms", 10
+            , "queue wait time of a task that triggers adding a worker");
+
+static ConfigVar<uint32_t>::ptr g_elastic_grow_interval_ms =
+    Config::Lookup<uint32_t>("scheduler.elastic.grow_interval_ms", 10
+            , "min interval between adding two workers");
+
+static ConfigVar<uint32_t>::ptr g_elastic_retire_idle_ms =
+    Config::Lookup<uint32_t>("scheduler.elastic.retire_idle_ms", 30000
+            , "idle time after which a worker above the min count exits");
+
+static uint32_t s_grow_queue_depth = 0;
+static uint32_t s_grow_wait_ms = 0;
+static uint32_t s_grow_interval_ms = 0;
+static uint32_t s_retire_idle_ms = 0;
+
+struct _ElasticIniter {
+    _ElasticIniter() {
+        s_grow_queue_depth = g_elastic_grow_queue_depth->getValue();
+        s_grow_wait_ms = g_elastic_grow_wait_ms->getValue();
+        s_grow_interval_ms = g_elastic_grow_interval_ms->getValue();
+        s_retire_idle_ms = g_elastic_retire_idle_ms->getValue();
+
+        g_elastic_grow_queue_depth->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.elastic.grow_queue_depth changed from "
+                                     << old_value << " to " << new_value;
+            s_grow_queue_depth = new_value;
+        });
+        g_elastic_grow_wait_ms->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.elastic.grow_wait_ms changed from "
+                                     << old_value << " to " << new_value;
+            s_grow_wait_ms = new_value;
+        });
+        g_elastic_grow_interval_ms->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.elastic.grow_interval_ms changed from "
+                                     << old_value << " to " << new_value;
+            s_grow_interval_ms = new_value;
+        });
+        g_elastic_retire_idle_ms->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.elastic.retire_idle_ms changed from "
+                                     << old_value << " to " << new_value;
+            s_retire_idle_ms = new_value;
+        });
+    }
+};
+
+static _ElasticIniter s_elastic_initer;
+
+static ConfigVar<std::vector<uint32_t> >::ptr g_priority_weights =
+    Config::Lookup("scheduler.priority.weights", std::vector<uint32_t>{16, 4, 1}
+            , "weighted round robin weights of latency, normal and background tasks");
+
+static uint32_t s_priority_weights[Scheduler::PRIORITY_COUNT];
+
+static void SetPriorityWeights(const std::vector<uint32_t>& weights) {
+    for(size_t i = 0; i < Scheduler::PRIORITY_COUNT; ++i) {
+        //权重至少为1, 低优先级不会饿死
+        s_priority_weights[i] = (i < weights.size() && weights[i]) ? weights[i] : 1;
+    }
+}
+
+struct _PriorityIniter {
+    _PriorityIniter() {
+        SetPriorityWeights(g_priority_weights->getValue());
+
+        g_priority_weights->addListener([](const std::vector<uint32_t>& old_value
+                                            , const std::vector<uint32_t>& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "scheduler.priority.weights changed";
+            SetPriorityWeights(new_value);
+        });
+    }
+};
+
+static _PriorityIniter s_priority_initer;
+
+/**
+ * @brief 工作线程私有的回调协程池
+ * @details
+ * 缓存已结束(TERM/EXCEPT)的协程对象, schedule的回调直接reset复用,
+ * 避免每个挂起过(READY/HOLD)的回调都重新构造协程和分配栈
+ * 按栈大小分级缓存, 开启fiber.stack_profile.adaptive时回调按入口的建议栈大小取协程
+ * 每级数量超过high watermark时释放到low watermark
+ * 只在所属线程的Scheduler::run中使用, 不需要加锁
+ */
+class FiberPool {
+public:
+    FiberPool(std::atomic<uint64_t>& hits, std::atomic<uint64_t>& misses)
+        : m_hits(hits)
+        , m_misses(misses) {
+    }
+
+    Fiber::ptr get(Task& cb) {
+        size_t stacksize = Fiber::GetDefaultStackSize();
+        const std::type_info* entry = cb.entryType();
+        size_t suggest = entry ? StackProfile::SuggestStackSize(*entry) : 0;
+        if(suggest && suggest < stacksize) {
+            stacksize = suggest;
+        }
+        auto& fibers = m_fibers[stacksize];
+        if(fibers.empty()) {
+            ++m_misses;
+            return Fiber::ptr(new Fiber(std::move(cb), stacksize));
+        }
+        ++m_hits;
+        Fiber::ptr fiber;
+        fiber.swap(fibers.back());
+        fibers.pop_back();
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+
+    /**
+     * @brief 回收已结束的协程
+     * @details 只回收没有其他持有者且栈大小是池中已有级别的协程, 其余直接释放
+     */
+    void put(Fiber::ptr& fiber) {
+        auto it = m_fibers.end();
+        if(fiber.use_count() != 1
+                || fiber->isSharedStack()
+                || (it = m_fibers.find(fiber->getStackSize())) == m_fibers.end()) {
+            fiber.reset();
+            return;
+        }
+        auto& fibers = it->second;
+        fiber->reset(nullptr);
+        fibers.push_back(nullptr);
+        fibers.back().swap(fiber);
+        if(fibers.size() > s_fiber_pool_high) {
+            size_t low = std::min(s_fiber_pool_low, s_fiber_pool_high);
+            fibers.resize(low);
+        }
+    }
+private:
+    std::map<size_t, std::vector<Fiber::ptr> > m_fibers;
+    std::atomic<uint64_t>& m_hits;
+    std::atomic<uint64_t>& m_misses;
+};
+
+/**
+ * @brief 工作线程状态
+ * @details
+ * use_caller时0号分配给调用线程, 其余在创建线程时分配, 线程退出后可以被新线程复用
+ * threadId在Scheduler::run开始时设置, 之前提交的指定线程任务放入全局队列
+ */
+struct Scheduler::Worker {
+    Worker(Scheduler* s, size_t idx, size_t capacity)
+        : scheduler(s)
+        , index(idx) {
+        for(size_t i = 0; i < PRIORITY_COUNT; ++i) {
+            local[i].reset(new WorkStealingQueue<FiberAndThread*>(capacity));
+            credits[i] = 0;
+            for(auto& n : waitHist[i]) {
+                n = 0;
+            }
+        }
+    }
+
+    //所有优先级的本地队列都为空
+    bool localEmpty() const {
+        for(auto& q : local) {
+            if(!q->empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Scheduler* scheduler;
+    size_t index;
+    std::atomic<int> threadId = {-1};
+    //已分配给线程
+    std::atomic<bool> inUse = {false};
+    //运行本Worker的线程, 调用线程为空
+    Thread::ptr thread;
+    //setAffinity分配的NUMA节点, -1表示未知
+    std::atomic<int> node = {-1};
+    //弹性模式下开始空闲的时间, 0表示不在空闲
+    uint64_t idleSinceMs = 0;
+    //空闲太久, 线程退出
+    bool retired = false;
+    //即将进入idle, 其它线程投递信箱后需要tickle
+    std::atomic<bool> idle = {false};
+    //基类idle中在futex上休眠时为1, 作为futex字
+    std::atomic<int32_t> parked = {0};
+    //本地队列, 按优先级分开
+    std::unique_ptr<WorkStealingQueue<FiberAndThread*> > local[PRIORITY_COUNT];
+    //加权轮转: 本轮各优先级剩余的权重, 只有所属线程访问
+    uint32_t credits[PRIORITY_COUNT];
+    //各优先级的排队时间直方图, 只有所属线程写
+    std::atomic<uint64_t> waitHist[PRIORITY_COUNT][WAIT_BUCKETS];
+
+    //信箱: 其它线程投递的指定本线程执行的任务
+    Mutex mailboxMutex;
+    TaskList mailbox;
+    std::atomic<size_t> mailboxSize = {0};
+
+    //run next槽: 本线程提交给自己的任务, 只有所属线程访问
+    FiberAndThread runNext;
+    bool hasRunNext = false;
+
+    //正在执行的任务协程, YieldTo直接切换后更新为接手的协程
+    Fiber::ptr current;
+    //YieldTo切出的协程, 切换完成后由OnYieldTo处理
+    Fiber::ptr yieldFrom;
+    //CallFiber: returnFrom第一次切出后继续执行returnTo
+    Fiber* returnFrom = nullptr;
+    Fiber::ptr returnTo;
+};
+
+//当前线程的工作线程状态, 新线程在进入run之前由创建者设置
+static thread_local Scheduler::Worker* t_worker = nullptr;
+
+//窃取时随机选择起始线程
+static uint32_t NextRandom() {
+    static thread_local uint32_t s_seed = 0;
+    if(!s_seed) {
+        s_seed = (uint32_t)GetThreadId() * 2654435761u | 1;
+    }
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+//休眠的最长时间, 唤醒都是精确的, 超时只是兜底
+static const int MAX_PARK_MS = 1000;
+
+static void FutexWait(std::atomic<int32_t>* addr, int32_t expect, int timeout_ms) {
+    timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAIT_PRIVATE
+            , expect, &ts, nullptr, 0);
+}
+
+static void FutexWake(std::atomic<int32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAKE_PRIVATE
+            , count, nullptr, nullptr, 0);
+}
+
+Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name
+                     , size_t max_threads)
     : m_name(name) {
     AWCOTN_ASSERT(threads > 0);
+    if(max_threads > threads) {
+        m_elastic = true;
+    } else {
+        max_threads = threads;
+    }
 
     if(use_caller) {
         Fiber::GetThis();
@@ -30,7 +325,22 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
     } else {
         m_rootThread = -1;
     } 
+    for(auto& n : m_globalTasks) {
+        n = 0;
+    }
     m_threadCount = threads;
+    m_minThreads = threads;
+    m_maxThreads = max_threads - (use_caller ? 1 : 0);
+
+    //按最大线程数分配, 运行中m_workers不再变化, 可以无锁遍历
+    size_t capacity = g_local_queue_size->getValue();
+    for(size_t i = 0; i < m_maxThreads + (use_caller ? 1 : 0); ++i) {
+        m_workers.push_back(new Worker(this, i, capacity));
+    }
+    if(use_caller) {
+        m_workers[0]->threadId = m_rootThread;
+        m_workers[0]->inUse = true;
+    }
 }
 
 Scheduler::~Scheduler() {
@@ -39,6 +349,15 @@ Scheduler::~Scheduler() {
     if(GetThis() == this) {
         t_scheduler = nullptr;
     }
+    for(auto w : m_workers) {
+        FiberAndThread* task = nullptr;
+        for(auto& q : w->local) {
+            while(q->pop(task)) {
+                DeleteNode(task);
+            }
+        }
+        delete w;
+    }
 }
 
 Scheduler* Scheduler::GetThis() {
@@ -58,11 +377,8 @@ void Scheduler::start() {
 
     AWCOTN_ASSERT(m_threads.empty());
 //    AWCOTN_LOG_INFO(g_logger) << m_threadCount;
-    m_threads.resize(m_threadCount);
     for (size_t i = 0; i < m_threadCount; ++i) {
-        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this)
-                            , m_name + "_" + std::to_string(i)));
-        m_threadIds.push_back(m_threads[i]->getId());
+        spawnNoLock();
     }
     lock.unlock();
 
@@ -78,7 +394,7 @@ void Scheduler::stop() {
     AWCOTN_LOG_INFO(g_logger) << "Scheduler stop";
     m_autoStop = true;
     if(m_rootFiber
-            && m_threadCount == 0
+            && m_liveThreads == 0
             && (m_rootFiber->getState() == Fiber::TERM
                 || m_rootFiber->getState() == Fiber::INIT)) {
         AWCOTN_LOG_INFO(g_logger) << this << " stopped";
@@ -98,7 +414,7 @@ void Scheduler::stop() {
 
 
     m_stopping = true;
-    for(size_t i = 0; i < m_threadCount; ++i) {
+    for(size_t i = 0; i < m_liveThreads; ++i) {
         tickle();
     }
 
@@ -140,6 +456,582 @@ void Scheduler::setThis() {
     t_scheduler = this;
 }
 
+bool Scheduler::spawnNoLock() {
+    //回收已经退出的线程
+    for(int id : m_retiredThreads) {
+        for(auto it = m_threads.begin(); it != m_threads.end(); ++it) {
+            if((*it)->getId() == id) {
+                (*it)->join();
+                m_threads.erase(it);
+                break;
+            }
+        }
+        m_threadIds.erase(std::remove(m_threadIds.begin(), m_threadIds.end(), id)
+                , m_threadIds.end());
+    }
+    m_retiredThreads.clear();
+
+    //退出中的线程减少了m_liveThreads但可能还没有释放Worker
+    Worker* worker = nullptr;
+    for(auto w : m_workers) {
+        if(!w->inUse) {
+            worker = w;
+            break;
+        }
+    }
+    if(!worker) {
+        return false;
+    }
+    worker->inUse = true;
+    ++m_liveThreads;
+    Thread::ptr thr(new Thread([this, worker](){
+                t_worker = worker;
+                run();
+            }, m_name + "_" + std::to_string(worker->index)));
+    m_threads.push_back(thr);
+    m_threadIds.push_back(thr->getId());
+    worker->thread = thr;
+    if(!m_affinityCpus.empty()) {
+        applyAffinityNoLock(worker);
+    }
+    size_t peak = m_peakThreads;
+    while(m_liveThreads > peak
+            && !m_peakThreads.compare_exchange_weak(peak, m_liveThreads)) {
+    }
+    return true;
+}
+
+//cpus涉及的NUMA节点, 按第一次出现的顺序
+static std::vector<int> NodesOfCpus(const std::vector<int>& cpus) {
+    std::vector<int> nodes;
+    for(int cpu : cpus) {
+        int node = Numa::NodeOfCpu(cpu);
+        if(std::find(nodes.begin(), nodes.end(), node) == nodes.end()) {
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+
+void Scheduler::setAffinity(const std::vector<int>& cpus, bool numa_group) {
+    MutexType::Lock lock(m_mutex);
+    m_affinityCpus = cpus.empty() ? Numa::OnlineCpus() : cpus;
+    m_numaGroup = numa_group;
+    m_numaSteal = NodesOfCpus(m_affinityCpus).size() > 1;
+    for(auto w : m_workers) {
+        applyAffinityNoLock(w);
+    }
+}
+
+void Scheduler::applyAffinityNoLock(Worker* worker) {
+    if(m_rootThread != -1 && worker->index == 0) {
+        return;
+    }
+    size_t k = worker->index - (m_rootThread != -1 ? 1 : 0);
+    std::vector<int> cpus;
+    int node = 0;
+    if(!m_numaGroup) {
+        int cpu = m_affinityCpus[k % m_affinityCpus.size()];
+        cpus.push_back(cpu);
+        node = Numa::NodeOfCpu(cpu);
+    } else {
+        //按节点分组, 第k个线程分配到第k % 节点数个节点
+        std::vector<int> nodes = NodesOfCpus(m_affinityCpus);
+        node = nodes[k % nodes.size()];
+        for(int cpu : m_affinityCpus) {
+            if(Numa::NodeOfCpu(cpu) == node) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    worker->node = node;
+    if(worker->thread) {
+        worker->thread->setAffinity(cpus);
+    }
+}
+
+void Scheduler::maybeGrow(const FiberAndThread& ft) {
+    if(m_idleThreadCount > 0 || m_liveThreads >= m_maxThreads) {
+        return;
+    }
+    uint64_t now = GetCurrentMS();
+    if(m_queuedTasks < s_grow_queue_depth
+            && (!ft.queuedUs || now - ft.queuedUs / 1000 < s_grow_wait_ms)) {
+        return;
+    }
+    uint64_t last = m_lastGrowMs;
+    if(now - last < s_grow_interval_ms
+            || !m_lastGrowMs.compare_exchange_strong(last, now)) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    if(m_stopping || m_liveThreads >= m_maxThreads) {
+        return;
+    }
+    if(spawnNoLock()) {
+        ++m_growCount;
+        AWCOTN_LOG_INFO(g_logger) << m_name << " add worker, threads=" << getThreadCount()
+            << " queued=" << m_queuedTasks;
+    }
+}
+
+bool Scheduler::retireIdle() {
+    Worker* worker = t_worker;
+    if(!m_elastic || !worker || worker->scheduler != this
+            || awcotn::GetThreadId() == m_rootThread || m_stopping) {
+        return false;
+    }
+    if(!worker->idleSinceMs || GetCurrentMS() - worker->idleSinceMs < s_retire_idle_ms) {
+        return false;
+    }
+    //共享栈上还有未结束的协程, 线程退出后无法恢复
+    if(worker->mailboxSize > 0 || worker->hasRunNext || !worker->localEmpty()
+            || Fiber::GetSharedStackFibers() > 0) {
+        return false;
+    }
+    size_t live = m_liveThreads;
+    while(live > m_minThreads) {
+        if(m_liveThreads.compare_exchange_weak(live, live - 1)) {
+            worker->retired = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::releaseWorker(Worker* worker) {
+    //先注销线程id, 之后不会再有任务投递进来
+    worker->threadId = -1;
+    TaskList pinned;
+    {
+        MutexType::Lock lock(worker->mailboxMutex);
+        pinned.swap(worker->mailbox);
+        worker->mailboxSize = 0;
+    }
+    if(worker->hasRunNext) {
+        pinned.push_back(std::move(worker->runNext));
+        worker->runNext.reset();
+        worker->hasRunNext = false;
+    }
+    TaskList tasks[PRIORITY_COUNT];
+    while(!pinned.empty()) {
+        auto& l = tasks[pinned.front().priority];
+        l.splice(l.end(), pinned, pinned.begin());
+    }
+    FiberAndThread* task = nullptr;
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        while(worker->local[i]->pop(task)) {
+            tasks[i].push_back(std::move(*task));
+            DeleteNode(task);
+        }
+    }
+    {
+        //剩余任务已经计入m_queuedTasks, 直接移到全局队列
+        MutexType::Lock lock(m_mutex);
+        for(int i = 0; i < PRIORITY_COUNT; ++i) {
+            m_globalTasks[i] += tasks[i].size();
+            m_fibers[i].splice(m_fibers[i].end(), tasks[i]);
+        }
+        m_retiredThreads.push_back(awcotn::GetThreadId());
+        worker->thread.reset();
+    }
+    worker->idleSinceMs = 0;
+    worker->retired = false;
+    worker->inUse = false;
+    ++m_retireCount;
+    AWCOTN_LOG_INFO(g_logger) << m_name << " retire worker, threads=" << getThreadCount();
+    tickle();
+}
+
+void Scheduler::prepareTask(FiberAndThread& ft) {
+    ft.queuedUs = GetCurrentUS();
+    if(ft.fiber) {
+        //共享栈协程的栈帧在所属线程的共享栈上, 只能回到该线程执行
+        if(ft.fiber->getBoundThread() != -1) {
+            ft.thread = ft.fiber->getBoundThread();
+        }
+        //协程之后被唤醒时沿用这次的优先级
+        if(ft.priority == DEFAULT_PRIORITY) {
+            ft.priority = ft.fiber->getPriority();
+        } else {
+            ft.fiber->setPriority(ft.priority);
+        }
+        ft.fiber->markScheduled();
+    }
+    if(ft.priority < 0 || ft.priority >= PRIORITY_COUNT) {
+        ft.priority = NORMAL;
+    }
+}
+
+bool Scheduler::scheduleNoLock(FiberAndThread&& ft) {
+    bool need_tickle = !hasGlobalTasks();
+    int priority = ft.priority;
+    m_fibers[priority].push_back(std::move(ft));
+    ++m_globalTasks[priority];
+    ++m_queuedTasks;
+    return need_tickle;
+}
+
+bool Scheduler::hasGlobalTasks() const {
+    for(auto& n : m_globalTasks) {
+        if(n > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Scheduler::Worker* Scheduler::findWorker(int thread) {
+    for(auto w : m_workers) {
+        if(w->threadId == thread) {
+            return w;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::postMailbox(Worker* target, FiberAndThread&& ft) {
+    ++m_queuedTasks;
+    {
+        MutexType::Lock lock(target->mailboxMutex);
+        target->mailbox.push_back(std::move(ft));
+        ++target->mailboxSize;
+    }
+    //与run中先置idle再检查信箱配对, 两边至少有一边看到对方
+    //目标在futex上休眠时直接唤醒它, 否则(如在epoll_wait中)只能tickle
+    if(target != t_worker && target->idle && !unpark(target)) {
+        tickle();
+    }
+}
+
+void Scheduler::submit(FiberAndThread&& ft, bool yield) {
+    Worker* worker = t_worker;
+    if(worker && worker->scheduler != this) {
+        worker = nullptr;
+    }
+    prepareTask(ft);
+    if(ft.thread != -1) {
+        Worker* target = (worker && worker->threadId == ft.thread)
+                            ? worker : findWorker(ft.thread);
+        if(target == worker && worker && !yield) {
+            //run next槽被占用时, 旧任务进入信箱(已计入m_queuedTasks)
+            if(worker->hasRunNext) {
+                --m_queuedTasks;
+                postMailbox(worker, std::move(worker->runNext));
+                worker->runNext.reset();
+            }
+            ++m_queuedTasks;
+            worker->runNext = std::move(ft);
+            worker->hasRunNext = true;
+            return;
+        }
+        if(target) {
+            postMailbox(target, std::move(ft));
+            return;
+        }
+    } else if(worker && !yield) {
+        auto& local = worker->local[ft.priority];
+        FiberAndThread* task = NewNode<FiberAndThread>(std::move(ft));
+        ++m_queuedTasks;
+        if(local->push(task)) {
+            wakeIdle();
+            return;
+        }
+        //本地队列满了放入全局队列
+        --m_queuedTasks;
+        ft = std::move(*task);
+        DeleteNode(task);
+    }
+    bool need_tickle = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        need_tickle = scheduleNoLock(std::move(ft));
+    }
+    if(need_tickle) {
+        tickle();
+    }
+}
+
+void Scheduler::wakeIdle() {
+    if(m_idleThreadCount > 0 && !m_wakePending.exchange(true)) {
+        tickle();
+    }
+}
+
+bool Scheduler::checkRunnable(FiberAndThread* task, FiberAndThread& ft) {
+    if(task->fiber && task->fiber->getState() == Fiber::EXEC) {
+        //协程在别的线程上还没有切出完成, 放回全局队列稍后再取
+        {
+            MutexType::Lock lock(m_mutex);
+            scheduleNoLock(std::move(*task));
+        }
+        DeleteNode(task);
+        return false;
+    }
+    ft = std::move(*task);
+    DeleteNode(task);
+    return true;
+}
+
+bool Scheduler::takeLocal(Worker* worker, FiberAndThread& ft, int priority) {
+    auto& local = worker->local[priority];
+    //空队列的pop也有一次全屏障, 先检查, 所属线程看到空就一定是空
+    FiberAndThread* task = nullptr;
+    if(local->empty() || !local->pop(task)) {
+        return false;
+    }
+    ++m_activeThreadCount;
+    --m_queuedTasks;
+    if(!checkRunnable(task, ft)) {
+        --m_activeThreadCount;
+        return false;
+    }
+    return true;
+}
+
+bool Scheduler::takePinned(Worker* worker, FiberAndThread& ft, bool mailbox_only) {
+    if(!mailbox_only && worker->hasRunNext) {
+        ++m_activeThreadCount;
+        --m_queuedTasks;
+        ft = std::move(worker->runNext);
+        worker->runNext.reset();
+        worker->hasRunNext = false;
+        return true;
+    }
+    if(worker->mailboxSize == 0) {
+        return false;
+    }
+    MutexType::Lock lock(worker->mailboxMutex);
+    for(auto it = worker->mailbox.begin(); it != worker->mailbox.end(); ++it) {
+        //调度时还在别的线程上执行(尚未切出完成)的协程留在信箱稍后再取
+        if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+            continue;
+        }
+        ++m_activeThreadCount;
+        --m_queuedTasks;
+        ft = std::move(*it);
+        worker->mailbox.erase(it);
+        --worker->mailboxSize;
+        return true;
+    }
+    return false;
+}
+
+void Scheduler::wakeIdlePinned(Worker* self) {
+    for(auto w : m_workers) {
+        if(w != self && w->idle && w->mailboxSize > 0 && !unpark(w)) {
+            tickle();
+            return;
+        }
+    }
+}
+
+bool Scheduler::hasWork(Worker* worker) {
+    if(worker->hasRunNext || worker->mailboxSize > 0 || hasGlobalTasks()) {
+        return true;
+    }
+    for(auto w : m_workers) {
+        if(!w->localEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::park(Worker* worker, int timeout_ms) {
+    worker->parked = 1;
+    //置位后再检查一次, 与unpark配对: 提交者先入队再看parked, 两边至少有一边看到对方
+    if(hasWork(worker) || stopping()) {
+        worker->parked = 0;
+        return;
+    }
+    FutexWait(&worker->parked, 1, timeout_ms);
+    worker->parked = 0;
+}
+
+bool Scheduler::unpark(Worker* worker) {
+    if(worker->parked.exchange(0) != 1) {
+        return false;
+    }
+    FutexWake(&worker->parked, 1);
+    return true;
+}
+
+bool Scheduler::steal(Worker* worker, FiberAndThread& ft, int priority) {
+    size_t n = m_workers.size();
+    if(n <= 1) {
+        return false;
+    }
+    size_t start = NextRandom() % n;
+    //分布在多个NUMA节点时, 第一轮只从同一节点的线程窃取, 第二轮再从其它节点窃取
+    int node = worker->node;
+    bool by_node = m_numaSteal && node >= 0;
+    for(int pass = by_node ? 0 : 1; pass < 2; ++pass) {
+        for(size_t i = 0; i < n; ++i) {
+            Worker* victim = m_workers[(start + i) % n];
+            if(victim == worker) {
+                continue;
+            }
+            if(by_node && (victim->node == node) != (pass == 0)) {
+                continue;
+            }
+            FiberAndThread* task = nullptr;
+            if(!victim->local[priority]->steal(task)) {
+                continue;
+            }
+            ++m_activeThreadCount;
+            --m_queuedTasks;
+            if(checkRunnable(task, ft)) {
+                return true;
+            }
+            --m_activeThreadCount;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::takeGlobal(Worker* worker, FiberAndThread& ft, bool& tickle_me, int priority) {
+    if(m_globalTasks[priority] == 0) {
+        return false;
+    }
+    bool found = false;
+    auto& fibers = m_fibers[priority];
+    MutexType::Lock lock(m_mutex);
+    //除了取出的任务, 再按线程数均分搬一批到本地队列
+    size_t batch = worker ? fibers.size() / m_workers.size() : 0;
+    batch = std::min(batch, worker ? worker->local[priority]->capacity() / 2 : 0);
+    auto it = fibers.begin();
+    while(it != fibers.end()) {
+        if(it->thread != -1 && it->thread != awcotn::GetThreadId()) {
+            //弹性模式下指定的线程可能已经退出, 没有绑定共享栈的任务改由任意线程执行
+            if(m_elastic && !findWorker(it->thread)
+                    && !(it->fiber && it->fiber->getBoundThread() != -1)) {
+                it->thread = -1;
+            } else {
+                ++it;
+                tickle_me = true;
+                continue;
+            }
+        }
+        AWCOTN_ASSERT(it->fiber || it->cb);
+        if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+            ++it;
+            continue;
+        }
+        if(!found) {
+            ft = std::move(*it);
+            found = true;
+            ++m_activeThreadCount;
+        } else if(batch > 0 && it->thread == -1) {
+            FiberAndThread* task = NewNode<FiberAndThread>(std::move(*it));
+            if(!worker->local[priority]->push(task)) {
+                *it = std::move(*task);
+                DeleteNode(task);
+                break;
+            }
+            --batch;
+        } else {
+            break;
+        }
+        it = fibers.erase(it);
+        --m_globalTasks[priority];
+        if(found && batch == 0) {
+            break;
+        }
+    }
+    if(found) {
+        --m_queuedTasks;
+    }
+    tickle_me = tickle_me || !fibers.empty();
+    return found;
+}
+
+bool Scheduler::takeByPriority(Worker* worker, FiberAndThread& ft, bool& tickle_me, bool steal_only) {
+    //本轮还有权重的优先级在前, 权重用完的在后, 各自按优先级从高到低
+    int order[PRIORITY_COUNT];
+    size_t n = 0;
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        if(worker->credits[i]) {
+            order[n++] = i;
+        }
+    }
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        if(!worker->credits[i]) {
+            order[n++] = i;
+        }
+    }
+    for(int priority : order) {
+        if(steal_only) {
+            if(!steal(worker, ft, priority)) {
+                continue;
+            }
+        } else if(!takeLocal(worker, ft, priority)) {
+            if(!takeGlobal(worker, ft, tickle_me, priority)) {
+                continue;
+            }
+            //从全局队列取到任务说明还有积压, 继续唤醒空闲线程
+            if(m_queuedTasks > 0) {
+                wakeIdle();
+            }
+        }
+        //取到权重已用完的优先级, 说明还有权重的优先级都没有任务, 开始新的一轮
+        if(!worker->credits[priority]) {
+            for(int i = 0; i < PRIORITY_COUNT; ++i) {
+                worker->credits[i] = s_priority_weights[i];
+            }
+        }
+        --worker->credits[priority];
+        return true;
+    }
+    return false;
+}
+
+void Scheduler::recordWait(Worker* worker, const FiberAndThread& ft) {
+    uint64_t now = GetCurrentUS();
+    uint64_t wait = now > ft.queuedUs ? now - ft.queuedUs : 0;
+    size_t bucket = 0;
+    while(wait && bucket < WAIT_BUCKETS - 1) {
+        wait >>= 1;
+        ++bucket;
+    }
+    //只有所属线程写, 不需要原子加
+    auto& n = worker->waitHist[ft.priority][bucket];
+    n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> Scheduler::getWaitHistogram(Priority priority) const {
+    std::vector<uint64_t> hist(WAIT_BUCKETS, 0);
+    if(priority < 0 || priority >= PRIORITY_COUNT) {
+        return hist;
+    }
+    for(auto w : m_workers) {
+        for(size_t i = 0; i < WAIT_BUCKETS; ++i) {
+            hist[i] += w->waitHist[priority][i].load(std::memory_order_relaxed);
+        }
+    }
+    return hist;
+}
+
+uint64_t Scheduler::getWaitPercentile(Priority priority, double percent) const {
+    std::vector<uint64_t> hist = getWaitHistogram(priority);
+    uint64_t total = 0;
+    for(auto n : hist) {
+        total += n;
+    }
+    if(!total) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(total * percent / 100);
+    uint64_t count = 0;
+    for(size_t i = 0; i < WAIT_BUCKETS; ++i) {
+        count += hist[i];
+        if(count >= target && count > 0) {
+            return 1ull << i;
+        }
+    }
+    return 1ull << (WAIT_BUCKETS - 1);
+}
+
 /**
  * @brief 调度器运行函数，负责协程调度循环
  * @details 
@@ -162,6 +1054,99 @@ void Scheduler::setThis() {
  * 4. 状态管理：
  *    - 让空闲协程单独处理idle状态，简化状态转换逻辑
  */
+Fiber::ptr Scheduler::runFiber(Worker* worker, Fiber::ptr fiber) {
+    Fiber::ptr finished;
+    while(fiber) {
+        if(worker) {
+            worker->current = fiber;
+        }
+        // 切换到任务协程, 返回切出后的状态
+        Fiber::State state = fiber->swapIn();
+        if(worker) {
+            // 期间经过YieldTo直接切换时, 切回来的是最后接手的协程
+            fiber = std::move(worker->current);
+        }
+        Fiber::ptr next;
+        if(worker && worker->returnFrom == fiber.get()) {
+            // CallFiber的被调用协程切出, 调用者接着在本线程执行
+            worker->returnFrom = nullptr;
+            next = std::move(worker->returnTo);
+        }
+
+        //HOLD的协程可能已经被唤醒并在别的线程上执行, 只按切出时的状态处理
+        if(state == Fiber::READY) {
+            submit(FiberAndThread(std::move(fiber), -1), true);
+        } else if(state == Fiber::TERM || state == Fiber::EXCEPT) {
+            finished = std::move(fiber);
+        } else if(state == Fiber::EXEC) {
+            //切出前没有设置状态, EXEC期间不会被别的线程切入
+            fiber->setState(Fiber::HOLD);
+        }
+        fiber = std::move(next);
+    }
+    --m_activeThreadCount;
+    return finished;
+}
+
+bool Scheduler::YieldTo(Fiber::ptr next, bool ready) {
+    Scheduler* sc = GetThis();
+    AWCOTN_ASSERT(sc && next);
+    Worker* worker = t_worker;
+    Fiber* cur = Fiber::GetThis().get();
+    if(!worker || worker->scheduler != sc || worker->current.get() != cur
+            || !cur->canSwapTo(next.get())) {
+        //不在工作线程的任务协程中, 或next不能在本线程切入
+        sc->schedule(std::move(next));
+        if(!ready) {
+            Fiber::YieldToHold();
+        }
+        return false;
+    }
+    next->markScheduled();
+    //切换路径上不持有引用: 当前协程的引用交给OnYieldTo处理
+    worker->yieldFrom = std::move(worker->current);
+    worker->current = std::move(next);
+    cur->swapTo(worker->current.get(), ready ? Fiber::READY : Fiber::HOLD
+            , &Scheduler::OnYieldTo, sc);
+    return true;
+}
+
+void Scheduler::OnYieldTo(Fiber* prev, Fiber::State state, void* arg) {
+    Scheduler* sc = static_cast<Scheduler*>(arg);
+    Worker* worker = t_worker;
+    Fiber::ptr fiber = std::move(worker->yieldFrom);
+    AWCOTN_ASSERT(fiber.get() == prev);
+    if(state == Fiber::READY) {
+        sc->submit(FiberAndThread(std::move(fiber), -1), true);
+    }
+    //HOLD的协程由等待的一方持有引用并负责唤醒
+
+    if(worker->returnFrom == prev) {
+        //CallFiber的被调用协程直接切换到了别的协程, 调用者放回本地队列
+        worker->returnFrom = nullptr;
+        sc->submit(FiberAndThread(std::move(worker->returnTo), -1));
+    }
+}
+
+bool Scheduler::InTaskFiber() {
+    Worker* worker = t_worker;
+    return worker && worker->current && worker->current == Fiber::GetThis();
+}
+
+bool Scheduler::CallFiber(Fiber::ptr callee) {
+    Scheduler* sc = GetThis();
+    Worker* worker = t_worker;
+    Fiber* cur = Fiber::GetThis().get();
+    if(!sc || !worker || worker->scheduler != sc || worker->current.get() != cur
+            || worker->returnFrom || !cur->canSwapTo(callee.get())) {
+        return false;
+    }
+    worker->returnTo = worker->current;
+    worker->returnFrom = callee.get();
+    YieldTo(std::move(callee), false);
+    return true;
+}
+
 void Scheduler::run() {
     set_hook_enable(true);
     setThis();
@@ -172,74 +1157,97 @@ void Scheduler::run() {
 
     // 创建专门的空闲协程，用于处理线程无任务可调度的情况
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
-    Fiber::ptr cb_fiber;
+    FiberPool fiber_pool(m_fiberPoolHits, m_fiberPoolMisses);
+
+    Worker* worker = nullptr;
+    if(m_rootThread != -1 && awcotn::GetThreadId() == m_rootThread) {
+        worker = m_workers[0];
+    } else if(t_worker && t_worker->scheduler == this) {
+        worker = t_worker;
+        worker->threadId = awcotn::GetThreadId();
+    }
+    t_worker = worker;
 
     FiberAndThread ft;
+    uint64_t tick = 0;
     while(true) {
         ft.reset();
         bool tickle_me = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_fibers.begin();
-            while(it != m_fibers.end()) {
-                if(it->thread != -1 && it->thread != awcotn::GetThreadId()) {
-                    ++it;
-                    tickle_me = true;
-                    continue;
+        bool found = false;
+        if(worker) {
+            if(++tick % 61 == 0) {
+                found = takePinned(worker, ft, true);
+                for(int i = 0; !found && i < PRIORITY_COUNT; ++i) {
+                    found = takeGlobal(worker, ft, tickle_me, i);
                 }
-                AWCOTN_ASSERT(it->fiber || it->cb);
-                if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
-                    ++it;
-                    continue;
+            }
+            found = found || takePinned(worker, ft, false)
+                    || takeByPriority(worker, ft, tickle_me, false);
+            if(!found) {
+                found = takePinned(worker, ft, true)
+                        || takeByPriority(worker, ft, tickle_me, true);
+                //从信箱或其它线程取到任务说明还有积压, 继续唤醒空闲线程
+                if(found && m_queuedTasks > 0) {
+                    wakeIdle();
                 }
-                ft = *it;
-                m_fibers.erase(it);
-                ++m_activeThreadCount;
-                AWCOTN_LOG_INFO(g_logger) << "find fiber=" << m_fibers.size();
-                break;
             }
-            tickle_me = tickle_me || !m_fibers.empty();
+            if(found) {
+                recordWait(worker, ft);
+            }
+        } else {
+            for(int i = 0; !found && i < PRIORITY_COUNT; ++i) {
+                found = takeGlobal(worker, ft, tickle_me, i);
+            }
         }
 
         if(tickle_me) {
             tickle();
         }
 
+        if(m_elastic && found) {
+            if(worker) {
+                worker->idleSinceMs = 0;
+            }
+            maybeGrow(ft);
+        }
+
         // 执行调度的协程(如果有)
         if(ft.fiber && (ft.fiber->getState() != Fiber::TERM
                         && ft.fiber->getState() != Fiber::EXCEPT)) {
-            
-            ft.fiber->swapIn();  // 切换到任务协程
-            --m_activeThreadCount;
-
-            if(ft.fiber->getState() == Fiber::READY) {
-                schedule(ft.fiber);
-            } else if(ft.fiber->getState() != Fiber::TERM
-                    && ft.fiber->getState() != Fiber::EXCEPT) {
-                ft.fiber->setState (Fiber::HOLD);
-            }
+            Fiber::ptr finished = runFiber(worker, std::move(ft.fiber));
             ft.reset();
-        } else if(ft.cb) {
-            // 执行回调函数(如果有)
-            if(cb_fiber) {
-                cb_fiber->reset(ft.cb);
-            } else {
-                cb_fiber.reset(new Fiber(ft.cb));
+            if(finished) {
+                // 挂起过的回调协程结束后回到本线程的协程池
+                fiber_pool.put(finished);
+            }
+            onTaskDone();
+        } else if(ft.cb && ft.runInline) {
+            // 不会阻塞的回调直接在调度协程上执行
+            {
+                Fiber::NoYieldScope scope;
+                try {
+                    ft.cb();
+                } catch (std::exception& e) {
+                    AWCOTN_LOG_ERROR(g_logger) << "inline task except: " << e.what()
+                        << std::endl << awcotn::BacktraceToString();
+                } catch (...) {
+                    AWCOTN_LOG_ERROR(g_logger) << "inline task except"
+                        << std::endl << awcotn::BacktraceToString();
+                }
             }
             ft.reset();
-            
-            cb_fiber->swapIn(); 
             --m_activeThreadCount;
-            if(cb_fiber->getState() == Fiber::READY) {
-                schedule(cb_fiber);
-                cb_fiber.reset();
-            } else if(cb_fiber->getState() == Fiber::EXCEPT
-                    || cb_fiber->getState() == Fiber::TERM) {
-                cb_fiber->reset(nullptr);
-            } else {
-                cb_fiber->setState(Fiber::HOLD);
-                cb_fiber.reset();
+            onTaskDone();
+        } else if(ft.cb) {
+            // 执行回调函数(如果有), 协程优先从协程池复用
+            Fiber::ptr cb_fiber = fiber_pool.get(ft.cb);
+            cb_fiber->setPriority(ft.priority);
+            ft.reset();
+            Fiber::ptr finished = runFiber(worker, std::move(cb_fiber));
+            if(finished) {
+                fiber_pool.put(finished);
             }
+            onTaskDone();
         } else {
             // 没有任务时，执行空闲协程
             // 这里体现了空闲协程的重要性 - 在IOManager中会实现为epoll_wait等待IO事件
@@ -247,8 +1255,25 @@ void Scheduler::run() {
                 AWCOTN_LOG_INFO(g_logger) << "idle fiber term";
                 break;
             }
+            if(m_elastic && worker && !worker->idleSinceMs) {
+                worker->idleSinceMs = GetCurrentMS();
+            }
+            if(worker) {
+                //先置idle再检查信箱, 与postMailbox配对避免丢失唤醒
+                worker->idle = true;
+                if(worker->mailboxSize > 0) {
+                    worker->idle = false;
+                    continue;
+                }
+                //tickle被不相关的线程消费了, 继续传递给信箱有任务的空闲线程
+                wakeIdlePinned(worker);
+            }
             ++m_idleThreadCount;
             idle_fiber->swapIn();  // 切换到空闲协程
+            if(worker) {
+                worker->idle = false;
+            }
+            m_wakePending = false;
             if(idle_fiber->getState() != Fiber::TERM
                     && idle_fiber->getState() != Fiber::EXCEPT) {
                 idle_fiber->setState(Fiber::HOLD);
@@ -256,22 +1281,36 @@ void Scheduler::run() {
             --m_idleThreadCount;
         }
     }
+    if(worker && worker->retired) {
+        releaseWorker(worker);
+    }
+    t_worker = nullptr;
 }
 
+/**
+ * @brief 唤醒一个在futex上休眠的工作线程
+ * @details 每次只唤醒一个, 被唤醒的线程取到任务后如果还有积压再唤醒下一个
+ */
 void Scheduler::tickle() {
-    AWCOTN_LOG_INFO(g_logger) << "tickle";
+    size_t n = m_workers.size();
+    size_t start = NextRandom() % n;
+    for(size_t i = 0; i < n; ++i) {
+        if(unpark(m_workers[(start + i) % n])) {
+            return;
+        }
+    }
 }
 
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
     return m_autoStop && m_stopping
-        && m_fibers.empty() && m_activeThreadCount == 0;
+        && m_queuedTasks == 0 && m_activeThreadCount == 0;
 }
 
 /**
  * @brief 空闲协程执行函数
  * @details 
- * 在基类Scheduler中，空闲协程只是简单地让出执行权，等待被再次调度
+ * 在基类Scheduler中，空闲协程在工作线程自己的futex上休眠，由tickle精确唤醒，醒来后让出执行权
  * 在子类IOManager中，此函数被重写为调用epoll_wait等待IO事件
  * 
  * 空闲协程的价值：
@@ -282,8 +1321,30 @@ bool Scheduler::stopping() {
 void Scheduler::idle() {
     AWCOTN_LOG_INFO(g_logger) << "idle";
 
-    AWCOTN_LOG_INFO(g_logger) << m_autoStop << " - " << m_stopping << " - " << m_fibers.empty() << " - " << m_activeThreadCount;
-    while(!stopping()) {
+    AWCOTN_LOG_INFO(g_logger) << m_autoStop << " - " << m_stopping << " - " << m_queuedTasks << " - " << m_activeThreadCount;
+    Worker* worker = t_worker;
+    if(worker && worker->scheduler != this) {
+        worker = nullptr;
+    }
+    //弹性模式下休眠不超过退出线程的空闲时间, 醒来检查是否退出
+    int park_ms = MAX_PARK_MS;
+    if(m_elastic && s_retire_idle_ms < (uint32_t)park_ms) {
+        park_ms = s_retire_idle_ms ? s_retire_idle_ms : 1;
+    }
+    while(true) {
+        if(stopping()) {
+            //最后一个任务结束时其它线程可能已经休眠, 唤醒它们退出
+            for(auto w : m_workers) {
+                unpark(w);
+            }
+            break;
+        }
+        if(retireIdle()) {
+            break;
+        }
+        if(worker) {
+            park(worker, park_ms);
+        }
         awcotn::Fiber::YieldToHold();
     }
 }
@@ -5,15 +5,66 @@
 #include "macro.h"
 #include "fiber.h"
 #include "thread.h"
+#include "work_stealing_queue.h"
+#include "node_pool.h"
+#include "task.h"
 #include <atomic>
+#include <list>
+#include <vector>
 
 namespace awcotn {
+
+/**
+ * @brief 协程调度器
+ * @details
+ * 任务队列:
+ * 1. 每个工作线程一个有界工作窃取队列(Chase-Lev), 工作线程内提交的任务直接放入,
+ *    不加锁; 本线程的任务后进先出执行
+ * 2. 每个工作线程一个信箱(加锁), 存放指定该线程执行的任务, 只有所属线程取,
+ *    其它线程完全不用看到这些任务; 本线程提交给自己的任务放入run next槽, 下一次调度直接执行
+ * 3. 全局注入队列(加锁), 存放非工作线程提交的任务、本地队列溢出的任务和YieldToReady的任务
+ * 4. 工作线程取任务顺序: run next -> 本地队列 -> 信箱 -> 全局队列 -> 从其它线程窃取 -> idle
+ *    每61次调度优先检查一次信箱和全局队列, 避免它们饿死
+ * 弹性线程数: max_threads大于threads时, 没有空闲线程且积压任务数或任务排队时间超过阈值时增加线程,
+ * 线程空闲超过scheduler.elastic.retire_idle_ms后退出, 线程数保持在[threads, max_threads]
+ * CPU亲和性: setAffinity把工作线程绑定到CPU或按NUMA节点分组, 窃取时优先选择同一节点的线程
+ * 优先级: 本地队列和全局队列按优先级分开, 每个工作线程按scheduler.priority.weights加权轮转选择优先级,
+ *        权重用完的优先级只在更高权重的优先级都没有任务时执行, 低优先级不会饿死
+ *        指定线程的任务(run next槽和信箱)不区分优先级
+ */
 class Scheduler {
 public:
     typedef std::shared_ptr<Scheduler> ptr;
     typedef Mutex MutexType;
 
-    Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+    //工作线程状态, 定义在scheduler.cc
+    struct Worker;
+
+    /**
+     * @brief 任务优先级
+     */
+    enum Priority {
+        //延迟敏感的任务, 如请求处理
+        LATENCY = 0,
+        NORMAL = 1,
+        //后台批量任务, 如缓存刷新
+        BACKGROUND = 2,
+        PRIORITY_COUNT = 3,
+        //协程沿用自己的优先级, 回调为NORMAL
+        DEFAULT_PRIORITY = -1
+    };
+
+    //排队时间直方图的桶数, 第i个桶为[2^(i-1), 2^i)us, 第0个桶为不到1us, 最后一个桶不设上限
+    static const size_t WAIT_BUCKETS = 24;
+
+    /**
+     * @param[in] threads 线程数(含use_caller的调用线程), 弹性模式下为最少线程数
+     * @param[in] use_caller 是否使用调用线程执行任务
+     * @param[in] name 名称
+     * @param[in] max_threads 大于threads时开启弹性线程数, 为最多线程数
+     */
+    Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+              , size_t max_threads = 0);
     virtual ~Scheduler();
 
     const std::string& getName() const { return m_name; }
@@ -24,74 +75,151 @@ public:
     void start();
     void stop();
 
+    //回调协程池命中/未命中次数
+    uint64_t getFiberPoolHits() const { return m_fiberPoolHits; }
+    uint64_t getFiberPoolMisses() const { return m_fiberPoolMisses; }
+
+    /**
+     * @brief 设置工作线程的CPU亲和性, start之后也可以调用, 之后增加的线程同样生效
+     * @param[in] cpus 可用的CPU, 为空表示所有在线CPU
+     * @param[in] numa_group false时第i个线程绑定到cpus[i % cpus.size()]一个CPU;
+     *            true时线程轮流分配到cpus所在的各个NUMA节点, 绑定到该节点内的这些CPU
+     * @details use_caller的调用线程不修改亲和性
+     */
+    void setAffinity(const std::vector<int>& cpus, bool numa_group = false);
+
+    //当前线程数(含调用线程)
+    size_t getThreadCount() const { return m_liveThreads + (m_rootThread != -1 ? 1 : 0); }
+    //线程数峰值(含调用线程)
+    size_t getPeakThreadCount() const { return m_peakThreads + (m_rootThread != -1 ? 1 : 0); }
+    //弹性模式下增加/退出线程的次数
+    uint64_t getThreadGrowCount() const { return m_growCount; }
+    uint64_t getThreadRetireCount() const { return m_retireCount; }
+
+    /**
+     * @brief 指定优先级的任务排队时间直方图, 各工作线程合计
+     * @details 从入队到被工作线程取出的时间, 共WAIT_BUCKETS个桶
+     */
+    std::vector<uint64_t> getWaitHistogram(Priority priority) const;
+
+    /**
+     * @brief 按直方图估算的排队时间百分位数(us, 取所在桶的上界), 没有数据返回0
+     * @param[in] percent 百分位, 如99
+     */
+    uint64_t getWaitPercentile(Priority priority, double percent) const;
+
+    /**
+     * @param[in] thread 指定执行的线程id, -1表示任意线程
+     * @param[in] priority 优先级, 协程的优先级会被修改为该值
+     */
     template<class FiberOrCb>
-    void schedule(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            need_tickle = scheduleNoLock(fc, thread);
+    void schedule(FiberOrCb fc, int thread = -1, Priority priority = DEFAULT_PRIORITY) {
+        FiberAndThread ft(std::move(fc), thread);
+        ft.priority = priority;
+        if(ft.fiber || ft.cb) {
+            submit(std::move(ft));
         }
-        if(need_tickle) {
-            tickle();
-        } 
     }
     template<class InputIterator>
     void schedule(InputIterator begin, InputIterator end) {
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            while(begin != end) {
-                need_tickle = scheduleNoLock(&*begin, -1) || need_tickle;
-                ++begin;
-            }
-        }
-        if(need_tickle) {
-            tickle();
+        scheduleBatch(begin, end, false);
+    }
+
+    /**
+     * @brief 提交不会阻塞的回调, 在工作线程的调度协程上直接执行
+     * @details
+     * 不需要从协程池取回调协程, 也没有切入切出的两次上下文切换, 适合定时器到期等很短的回调
+     * 回调中不能让出(包括hook后会阻塞的调用), 否则断言失败; 回调看到的协程局部变量属于调度协程
+     */
+    void scheduleInline(Task cb, int thread = -1, Priority priority = DEFAULT_PRIORITY) {
+        FiberAndThread ft(std::move(cb), thread);
+        ft.priority = priority;
+        ft.runInline = true;
+        if(ft.cb) {
+            submit(std::move(ft));
         }
     }
+    template<class InputIterator>
+    void scheduleInline(InputIterator begin, InputIterator end) {
+        scheduleBatch(begin, end, true);
+    }
+
+    /**
+     * @brief 当前协程把执行权直接交给next, 不经过调度协程和任务队列
+     * @details
+     * 用于唤醒等待者后立刻让它执行的场景(channel交接、锁释放、IOManager::call),
+     * 只有一次上下文切换, 省去调度协程的切入切出和一次入队出队
+     * next必须不在任何任务队列中(通常是刚从等待队列取出的HOLD协程)
+     * 不在工作线程的任务协程中, 或者next不能在本线程切入(绑定了其它线程,
+     * 与当前协程使用同一个共享栈等)时, 改为schedule(next)
+     * @param[in] next 接手执行的协程
+     * @param[in] ready true时当前协程放回调度队列, 稍后继续执行;
+     *            false时当前协程挂起(HOLD), 由等待的事件负责唤醒
+     * @return 是否直接切换. 返回false且ready为true时当前协程没有让出
+     */
+    static bool YieldTo(Fiber::ptr next, bool ready = true);
+
+    /**
+     * @brief 直接切换到callee执行, callee第一次切出(挂起或结束)后当前协程在本线程继续执行
+     * @details 当前协程期间为HOLD. 条件与YieldTo相同, 另外不支持嵌套(callee中再CallFiber)
+     * @return 条件不满足时不切换, 返回false
+     */
+    static bool CallFiber(Fiber::ptr callee);
+
+    //当前是否在调度器的任务协程中(可以挂起等待, 由调度器唤醒)
+    static bool InTaskFiber();
 
 protected:
     virtual void tickle();
     void run();
     virtual bool stopping();
     virtual void idle();
+    //工作线程每执行完一个任务后在调度协程上调用, 子类用于批量处理积攒的工作(如提交io_uring)
+    virtual void onTaskDone() {}
 
     void setThis();
 
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
-private:
-    template<class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = m_fibers.empty();
-        FiberAndThread ft(fc, thread);
-        if(ft.fiber || ft.cb) {
-            m_fibers.push_back(ft);
-        }
-        return need_tickle;
-    }
+    /**
+     * @brief 弹性模式下空闲太久的线程是否退出, 由idle调用
+     * @details 返回true时idle应当返回, 线程在run结束后把剩余任务移到全局队列并退出
+     */
+    bool retireIdle();
+
 private:
     struct FiberAndThread {
         Fiber::ptr fiber;
-        std::function<void()> cb;
+        Task cb;
         int thread;
+        //优先级, prepareTask之后不再是DEFAULT_PRIORITY
+        int priority = DEFAULT_PRIORITY;
+        //入队时间(us), 用于排队时间统计和弹性模式下判断排队是否太久
+        uint64_t queuedUs = 0;
+        //不会阻塞的回调, 在调度协程上直接执行
+        bool runInline = false;
 
         FiberAndThread(Fiber::ptr f, int thr)
-            : fiber(f), thread(thr) {}
+            : fiber(std::move(f)), thread(thr) {}
 
         FiberAndThread(Fiber::ptr* f, int thr)
             :  thread(thr) {
             fiber.swap(*f);
         } 
 
-        FiberAndThread(std::function<void()> f, int thr)
-            : cb(f), thread(thr) {}
+        FiberAndThread(Task f, int thr)
+            : cb(std::move(f)), thread(thr) {}
 
-        FiberAndThread(std::function<void()>* f, int thr)
+        FiberAndThread(Task* f, int thr)
             : thread(thr) {
             cb.swap(*f);
         }
 
+        FiberAndThread(std::function<void()>* f, int thr)
+            : cb(std::move(*f)), thread(thr) {
+            *f = nullptr;
+        }
+
         FiberAndThread()
             : thread(-1) {}
 
@@ -99,15 +227,110 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            priority = DEFAULT_PRIORITY;
+            queuedUs = 0;
+            runInline = false;
         }
     }; 
 
-    
+    //全局队列和信箱, 链表节点从NodePool分配
+    typedef std::list<FiberAndThread, NodeAllocator<FiberAndThread> > TaskList;
+
+    template<class InputIterator>
+    void scheduleBatch(InputIterator begin, InputIterator end, bool run_inline) {
+        bool need_tickle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            while(begin != end) {
+                FiberAndThread ft(&*begin, -1);
+                ft.runInline = run_inline && ft.cb;
+                if(ft.fiber || ft.cb) {
+                    prepareTask(ft);
+                    need_tickle = scheduleNoLock(std::move(ft)) || need_tickle;
+                }
+                ++begin;
+            }
+        }
+        if(need_tickle) {
+            tickle();
+        }
+    }
+
+    /**
+     * @brief 提交任务
+     * @details
+     * 指定线程的任务放入该线程的信箱(本线程提交的放入run next槽),
+     * 工作线程内的其它任务放入本地队列, 其余放入全局队列
+     * @param[in] yield 是否是刚让出执行的协程, 是则放到队尾, 不进入run next槽和本地队列
+     */
+    void submit(FiberAndThread&& ft, bool yield = false);
+    //放入全局队列, 需持有m_mutex并已经prepareTask, 返回是否需要tickle
+    bool scheduleNoLock(FiberAndThread&& ft);
+    //放入指定工作线程的信箱, 目标线程空闲时tickle
+    void postMailbox(Worker* target, FiberAndThread&& ft);
+    //按线程id查找已经开始运行的工作线程
+    Worker* findWorker(int thread);
+    //任务入队前的处理: 共享栈协程绑定线程, 确定优先级, 记录调度时间
+    void prepareTask(FiberAndThread& ft);
+    //有空闲线程且没有正在唤醒的线程时tickle
+    void wakeIdle();
+
+    //从指定优先级的全局队列取一个本线程可执行的任务, 并搬一批到本地队列
+    bool takeGlobal(Worker* worker, FiberAndThread& ft, bool& tickle_me, int priority);
+    //从指定优先级的本地队列取任务
+    bool takeLocal(Worker* worker, FiberAndThread& ft, int priority);
+    //按加权轮转的顺序从本地队列/全局队列(或窃取)取任务
+    bool takeByPriority(Worker* worker, FiberAndThread& ft, bool& tickle_me, bool steal_only);
+    //记录取出的任务的排队时间
+    void recordWait(Worker* worker, const FiberAndThread& ft);
+    //从run next槽或信箱取指定本线程的任务
+    bool takePinned(Worker* worker, FiberAndThread& ft, bool mailbox_only);
+    //唤醒信箱里还有任务的空闲线程(tickle可能被其它线程消费掉了)
+    void wakeIdlePinned(Worker* self);
+    //全局队列是否有任务, 不加锁
+    bool hasGlobalTasks() const;
+    //是否有本线程可以执行的任务
+    bool hasWork(Worker* worker);
+    //基类idle中休眠, 直到unpark或超时
+    void park(Worker* worker, int timeout_ms);
+    //唤醒在futex上休眠的工作线程, 没有休眠返回false
+    bool unpark(Worker* worker);
+    //创建一个工作线程, 需持有m_mutex, 没有空闲的Worker返回false
+    bool spawnNoLock();
+    //积压时增加工作线程
+    void maybeGrow(const FiberAndThread& ft);
+    //退出的线程释放Worker, 剩余任务移到全局队列
+    void releaseWorker(Worker* worker);
+    //按setAffinity的设置绑定工作线程, 需持有m_mutex
+    void applyAffinityNoLock(Worker* worker);
+    //从其它工作线程指定优先级的本地队列窃取任务
+    bool steal(Worker* worker, FiberAndThread& ft, int priority);
+    //取出的任务如果还在执行(尚未切出完成), 放回全局队列, 返回false
+    bool checkRunnable(FiberAndThread* task, FiberAndThread& ft);
+    /**
+     * @brief 在调度协程上执行任务协程, 切回后按状态重新入队或挂起
+     * @return 结束(TERM/EXCEPT)的协程, 由调用方放回协程池
+     */
+    Fiber::ptr runFiber(Worker* worker, Fiber::ptr fiber);
+    //YieldTo切换完成后在接手的协程上调用, 处理切出的协程
+    static void OnYieldTo(Fiber* prev, Fiber::State state, void* arg);
+
 
 private:
     MutexType m_mutex;
     std::vector<Thread::ptr> m_threads;
-    std::list<FiberAndThread> m_fibers;
+    //全局队列, 按优先级分开
+    TaskList m_fibers[PRIORITY_COUNT];
+    //全局队列长度, 无锁读取用于跳过空队列
+    std::atomic<size_t> m_globalTasks[PRIORITY_COUNT];
+    std::vector<Worker*> m_workers;
+    //已经退出等待join的线程
+    std::vector<int> m_retiredThreads;
+    //setAffinity的设置, m_mutex保护
+    std::vector<int> m_affinityCpus;
+    bool m_numaGroup = false;
+    //工作线程分布在多个NUMA节点上, 窃取时按节点区分
+    std::atomic<bool> m_numaSteal = {false};
     Fiber::ptr m_rootFiber;
     std::string m_name;
 
@@ -116,6 +339,21 @@ protected:
     size_t m_threadCount = 0;
     std::atomic<size_t> m_activeThreadCount = {0};
     std::atomic<size_t> m_idleThreadCount = {0};
+    //所有队列中的任务数
+    std::atomic<size_t> m_queuedTasks = {0};
+    //已经tickle但被唤醒的线程还没开始取任务
+    std::atomic<bool> m_wakePending = {false};
+    std::atomic<uint64_t> m_fiberPoolHits = {0};
+    std::atomic<uint64_t> m_fiberPoolMisses = {0};
+    //弹性线程数, 不含调用线程
+    bool m_elastic = false;
+    size_t m_minThreads = 0;
+    size_t m_maxThreads = 0;
+    std::atomic<size_t> m_liveThreads = {0};
+    std::atomic<size_t> m_peakThreads = {0};
+    std::atomic<uint64_t> m_lastGrowMs = {0};
+    std::atomic<uint64_t> m_growCount = {0};
+    std::atomic<uint64_t> m_retireCount = {0};
     bool m_stopping = 1;
     bool m_autoStop = 0;
     int m_rootThread = 0;
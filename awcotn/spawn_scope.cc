@@ -0,0 +1,43 @@
+#include "spawn_scope.h"
+#include "log.h"
+#include "macro.h"
+
+namespace awcotn {
+
+static Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
+
+SpawnScope::SpawnScope(Scheduler* scheduler)
+    : m_scheduler(scheduler) {
+    AWCOTN_ASSERT2(m_scheduler, "SpawnScope without scheduler");
+}
+
+SpawnScope::~SpawnScope() {
+    m_wg.wait();
+    if(m_exception) {
+        try {
+            std::rethrow_exception(m_exception);
+        } catch(const std::exception& e) {
+            AWCOTN_LOG_ERROR(g_logger) << "SpawnScope child exception not joined: " << e.what();
+        } catch(...) {
+            AWCOTN_LOG_ERROR(g_logger) << "SpawnScope child exception not joined";
+        }
+    }
+}
+
+void SpawnScope::join() {
+    m_wg.wait();
+    if(m_exception) {
+        std::exception_ptr e = m_exception;
+        m_exception = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void SpawnScope::setException(std::exception_ptr e) {
+    //done之前写入, join在WaitGroup::wait返回后读取
+    if(!m_failed.exchange(true)) {
+        m_exception = e;
+    }
+}
+
+}
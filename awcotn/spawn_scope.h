@@ -0,0 +1,120 @@
+#ifndef __AWCOTN_SPAWN_SCOPE_H__
+#define __AWCOTN_SPAWN_SCOPE_H__
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "task.h"
+
+namespace awcotn {
+
+/**
+ * @brief 结构化的fork/join, 作用域内spawn的子任务在作用域结束前全部完成
+ * @details
+ * 1. 子任务作为普通回调提交到调度器(使用回调协程池), 结束时WaitGroup::done, 只有一次原子减
+ * 2. join挂起等待全部子任务完成, 重新抛出第一个异常; 析构时也会等待, 但不抛出(没有取走的异常记录日志)
+ * 3. 有子任务失败后failed()返回true, 还在执行的子任务可以据此提前结束
+ * 4. 在工作线程中spawn时子任务进入本地队列, 其它线程通过窃取分担, 提交和完成都不加锁
+ * 5. Run(body): 执行body(scope)后join, body或子任务的第一个异常抛给调用者
+ */
+class SpawnScope : Noncopyable {
+public:
+    explicit SpawnScope(Scheduler* scheduler = Scheduler::GetThis());
+    ~SpawnScope();
+
+    template<class F>
+    void spawn(F&& f) {
+        m_wg.add(1);
+        m_scheduler->schedule(Task(Child<typename std::decay<F>::type>{this, std::forward<F>(f)}));
+    }
+
+    /**
+     * @brief 提交f(0) ... f(n - 1)
+     * @details 共用一份f, 由作用域持有到析构, 子任务只保存指针, 没有共享的引用计数
+     */
+    template<class F>
+    void spawnN(size_t n, F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        if(n == 0) {
+            return;
+        }
+        std::shared_ptr<Fn> fn = std::make_shared<Fn>(std::forward<F>(f));
+        m_shared.push_back(fn);
+        m_wg.add((int32_t)n);
+        for(size_t i = 0; i < n; ++i) {
+            m_scheduler->schedule(Task(Indexed<Fn>{this, fn.get(), i}));
+        }
+    }
+
+    //等待全部子任务完成, 有异常时抛出第一个
+    void join();
+
+    bool failed() const { return m_failed.load(std::memory_order_relaxed); }
+
+    template<class F>
+    static void Run(F&& body, Scheduler* scheduler = Scheduler::GetThis()) {
+        SpawnScope scope(scheduler);
+        try {
+            body(scope);
+        } catch(...) {
+            scope.setException(std::current_exception());
+        }
+        scope.join();
+    }
+
+private:
+    //只记录第一个异常
+    void setException(std::exception_ptr e);
+
+    template<class F>
+    struct Child {
+        SpawnScope* scope;
+        F fn;
+
+        void operator()() {
+            try {
+                fn();
+            } catch(...) {
+                scope->setException(std::current_exception());
+            }
+            scope->m_wg.done();
+        }
+
+        const std::type_info* entryType() const { return Task::EntryTypeOf(fn); }
+    };
+
+    template<class F>
+    struct Indexed {
+        SpawnScope* scope;
+        F* fn;
+        size_t index;
+
+        void operator()() {
+            try {
+                (*fn)(index);
+            } catch(...) {
+                scope->setException(std::current_exception());
+            }
+            scope->m_wg.done();
+        }
+
+        const std::type_info* entryType() const { return Task::EntryTypeOf(*fn); }
+    };
+
+private:
+    Scheduler* m_scheduler;
+    WaitGroup m_wg;
+    std::atomic<bool> m_failed = {false};
+    std::exception_ptr m_exception;
+    //spawnN共用的可调用对象, 只在创建作用域的协程中访问
+    std::vector<std::shared_ptr<void> > m_shared;
+};
+
+}
+
+#endif
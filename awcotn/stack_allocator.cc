@@ -0,0 +1,251 @@
+#include "stack_allocator.h"
+#include "config.h"
+#include "log.h"
+#include "mutex.h"
+#include "numa.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <new>
+
+namespace awcotn {
+
+static Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_stack_pool_thread_cache =
+    Config::Lookup<uint32_t>("fiber.stack_pool.thread_cache", 32
+            , "max free fiber stacks cached per thread");
+
+static ConfigVar<uint32_t>::ptr g_stack_pool_max_cached =
+    Config::Lookup<uint32_t>("fiber.stack_pool.max_cached", 256
+            , "max free fiber stacks cached in global list");
+
+static ConfigVar<bool>::ptr g_stack_pool_trim =
+    Config::Lookup<bool>("fiber.stack_pool.trim", true
+            , "release pages of cached free stacks except the top page");
+
+static uint32_t s_thread_cache = 0;
+static uint32_t s_max_cached = 0;
+static bool s_trim = true;
+static size_t s_page_size = 4096;
+
+struct _StackPoolIniter {
+    _StackPoolIniter() {
+        s_page_size = sysconf(_SC_PAGESIZE);
+        s_thread_cache = g_stack_pool_thread_cache->getValue();
+        s_max_cached = g_stack_pool_max_cached->getValue();
+        s_trim = g_stack_pool_trim->getValue();
+
+        g_stack_pool_thread_cache->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_pool.thread_cache changed from "
+                                     << old_value << " to " << new_value;
+            s_thread_cache = new_value;
+        });
+        g_stack_pool_max_cached->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_pool.max_cached changed from "
+                                     << old_value << " to " << new_value;
+            s_max_cached = new_value;
+        });
+        g_stack_pool_trim->addListener([](const bool& old_value, const bool& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_pool.trim changed from "
+                                     << old_value << " to " << new_value;
+            s_trim = new_value;
+        });
+    }
+};
+
+static _StackPoolIniter s_stack_pool_initer;
+
+static std::atomic<uint64_t> s_mapped_count {0};
+static std::atomic<uint64_t> s_trimmed_bytes {0};
+
+/**
+ * @brief 空闲栈, size为可用大小(页对齐, 不含保护页)
+ * @details node为放入全局链表时所在的NUMA节点, 保留的物理页在该节点上
+ */
+struct FreeStack {
+    void* ptr;
+    size_t size;
+    int node;
+};
+
+static size_t RoundSize(size_t size) {
+    return (size + s_page_size - 1) & ~(s_page_size - 1);
+}
+
+static void* MapStack(size_t size) {
+    size_t total = size + s_page_size;
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if(base == MAP_FAILED) {
+        AWCOTN_LOG_ERROR(g_logger) << "mmap fiber stack fail, size=" << total
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        throw std::bad_alloc();
+    }
+    if(mprotect(base, s_page_size, PROT_NONE)) {
+        AWCOTN_LOG_ERROR(g_logger) << "mprotect fiber stack guard page fail"
+            << " errno=" << errno << " errstr=" << strerror(errno);
+    }
+    ++s_mapped_count;
+    return (char*)base + s_page_size;
+}
+
+static void UnmapStack(void* vp, size_t size) {
+    munmap((char*)vp - s_page_size, size + s_page_size);
+    --s_mapped_count;
+}
+
+/**
+ * @brief 全局空闲链表
+ * @details 优先取当前线程所在NUMA节点放入的栈, 没有再取其它节点的
+ */
+class GlobalStackList {
+public:
+    typedef Mutex MutexType;
+
+    void* pop(size_t size) {
+        int node = Numa::CurrentNode();
+        MutexType::Lock lock(m_mutex);
+        auto found = m_stacks.rend();
+        for(auto it = m_stacks.rbegin(); it != m_stacks.rend(); ++it) {
+            if(it->size == size) {
+                found = it;
+                if(it->node == node) {
+                    break;
+                }
+            }
+        }
+        if(found == m_stacks.rend()) {
+            return nullptr;
+        }
+        void* vp = found->ptr;
+        m_stacks.erase(std::next(found).base());
+        return vp;
+    }
+
+    //返回false表示已达上限, 由调用者munmap
+    bool push(void* vp, size_t size) {
+        int node = Numa::CurrentNode();
+        MutexType::Lock lock(m_mutex);
+        if(m_stacks.size() >= s_max_cached) {
+            return false;
+        }
+        m_stacks.push_back({vp, size, node});
+        return true;
+    }
+
+    size_t size() {
+        MutexType::Lock lock(m_mutex);
+        return m_stacks.size();
+    }
+private:
+    MutexType m_mutex;
+    std::vector<FreeStack> m_stacks;
+};
+
+static GlobalStackList& GetGlobalList() {
+    static GlobalStackList s_list;
+    return s_list;
+}
+
+/**
+ * @brief 线程空闲链表, 只被所属线程访问, 不需要加锁
+ */
+static thread_local bool t_stack_cache_destroyed = false;
+
+struct ThreadStackCache {
+    std::vector<FreeStack> stacks;
+
+    ~ThreadStackCache() {
+        //之后析构的其它thread_local(如共享栈)还可能归还栈, 直接走全局链表
+        t_stack_cache_destroyed = true;
+        for(auto& i : stacks) {
+            if(!GetGlobalList().push(i.ptr, i.size)) {
+                UnmapStack(i.ptr, i.size);
+            }
+        }
+    }
+};
+
+static thread_local ThreadStackCache t_stack_cache;
+
+//线程链表中不回收物理页的栈数量
+static const size_t s_untrimmed_cached = 4;
+
+void* StackPool::Alloc(size_t size) {
+    size = RoundSize(size);
+    if(t_stack_cache_destroyed) {
+        void* vp = GetGlobalList().pop(size);
+        return vp ? vp : MapStack(size);
+    }
+    auto& stacks = t_stack_cache.stacks;
+    for(auto it = stacks.rbegin(); it != stacks.rend(); ++it) {
+        if(it->size == size) {
+            void* vp = it->ptr;
+            stacks.erase(std::next(it).base());
+            return vp;
+        }
+    }
+    void* vp = GetGlobalList().pop(size);
+    if(vp) {
+        return vp;
+    }
+    return MapStack(size);
+}
+
+void StackPool::Dealloc(void* vp, size_t size) {
+    size = RoundSize(size);
+    //线程链表中最近归还的几个栈马上会被复用, 不回收, 避免频繁创建销毁时每次都madvise和缺页
+    if(s_trim && size > s_page_size
+            && (t_stack_cache_destroyed || t_stack_cache.stacks.size() >= s_untrimmed_cached)) {
+        //栈顶一页是下次使用时最先访问的, 保留
+        Trim(vp, (char*)vp + size - s_page_size);
+    }
+    if(t_stack_cache_destroyed) {
+        if(!GetGlobalList().push(vp, size)) {
+            UnmapStack(vp, size);
+        }
+        return;
+    }
+    auto& stacks = t_stack_cache.stacks;
+    if(stacks.size() < s_thread_cache) {
+        stacks.push_back({vp, size, -1});
+        return;
+    }
+    if(!GetGlobalList().push(vp, size)) {
+        UnmapStack(vp, size);
+    }
+}
+
+size_t StackPool::Trim(void* stack, void* sp) {
+    uintptr_t begin = ((uintptr_t)stack + s_page_size - 1) & ~(uintptr_t)(s_page_size - 1);
+    uintptr_t end = (uintptr_t)sp & ~(uintptr_t)(s_page_size - 1);
+    if(end <= begin) {
+        return 0;
+    }
+    size_t len = end - begin;
+    if(madvise((void*)begin, len, MADV_DONTNEED)) {
+        AWCOTN_LOG_ERROR(g_logger) << "madvise fiber stack fail, len=" << len
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return 0;
+    }
+    s_trimmed_bytes += len;
+    return len;
+}
+
+uint64_t StackPool::GetTrimmedBytes() {
+    return s_trimmed_bytes;
+}
+
+uint64_t StackPool::GetMappedCount() {
+    return s_mapped_count;
+}
+
+uint64_t StackPool::GetGlobalCachedCount() {
+    return GetGlobalList().size();
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __AWCOTN_STACK_ALLOCATOR_H__
+#define __AWCOTN_STACK_ALLOCATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace awcotn {
+
+/**
+ * @brief 协程栈池
+ * @details
+ * 栈使用mmap分配, 最低地址处有一个PROT_NONE保护页, 栈溢出直接触发SIGSEGV,
+ * 不会静默踩坏堆内存, 因此可以放心使用较小的栈
+ *
+ * 释放的栈不立即munmap:
+ * 1. 先放回当前线程的空闲链表(无锁, O(1)), 上限 fiber.stack_pool.thread_cache
+ * 2. 线程链表满了放入全局链表(加锁), 上限 fiber.stack_pool.max_cached
+ * 3. 都满了才munmap
+ * 线程退出时其空闲链表归还到全局链表
+ *
+ * 放回池中的栈除栈顶一页外都madvise(MADV_DONTNEED)归还物理页(fiber.stack_pool.trim),
+ * 线程链表中最近归还的几个栈除外
+ * 物理页在首次访问的线程所在的NUMA节点上分配, 全局链表优先复用当前节点归还的栈
+ */
+class StackPool {
+public:
+    /**
+     * @brief 分配栈
+     * @param[in] size 可用栈大小, 内部按页对齐
+     * @return 栈可用区域的起始地址(保护页之上)
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief 归还栈
+     * @param[in] vp Alloc返回的地址
+     * @param[in] size Alloc时传入的大小
+     */
+    static void Dealloc(void* vp, size_t size);
+
+    /**
+     * @brief 归还栈上[stack, sp)之间整页的物理内存
+     * @details 虚拟地址仍然有效, 再次访问时缺页得到全零页
+     * @param[in] stack 栈起始地址(低地址)
+     * @param[in] sp 该地址及以上的内容保留
+     * @return 归还的字节数
+     */
+    static size_t Trim(void* stack, void* sp);
+
+    /**
+     * @brief 累计通过Trim归还的字节数
+     */
+    static uint64_t GetTrimmedBytes();
+
+    /**
+     * @brief 当前通过mmap映射着的栈数量(包括使用中和缓存中的)
+     */
+    static uint64_t GetMappedCount();
+
+    /**
+     * @brief 全局链表中缓存的栈数量
+     */
+    static uint64_t GetGlobalCachedCount();
+};
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include "stack_profile.h"
+#include "config.h"
+#include "log.h"
+#include "mutex.h"
+#include <cxxabi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+namespace awcotn {
+
+static Logger::ptr g_logger = AWCOTN_LOG_NAME("system");
+
+static ConfigVar<bool>::ptr g_stack_profile_paint =
+    Config::Lookup<bool>("fiber.stack_profile.paint", false
+            , "paint every fiber stack and record high-water marks");
+
+static ConfigVar<bool>::ptr g_stack_profile_adaptive =
+    Config::Lookup<bool>("fiber.stack_profile.adaptive", false
+            , "pick callback fiber stack size from recorded high-water marks");
+
+static ConfigVar<uint32_t>::ptr g_stack_profile_min_samples =
+    Config::Lookup<uint32_t>("fiber.stack_profile.min_samples", 32
+            , "samples per entry before suggesting a stack size");
+
+static ConfigVar<uint32_t>::ptr g_stack_profile_resample =
+    Config::Lookup<uint32_t>("fiber.stack_profile.resample", 64
+            , "paint one of every N runs after a size is suggested");
+
+static ConfigVar<uint32_t>::ptr g_stack_profile_min_size =
+    Config::Lookup<uint32_t>("fiber.stack_profile.min_size", 16 * 1024
+            , "smallest suggested stack size");
+
+static bool s_paint = false;
+static bool s_adaptive = false;
+static uint32_t s_min_samples = 0;
+static uint32_t s_resample = 0;
+static uint32_t s_min_size = 0;
+
+struct _StackProfileIniter {
+    _StackProfileIniter() {
+        s_paint = g_stack_profile_paint->getValue();
+        s_adaptive = g_stack_profile_adaptive->getValue();
+        s_min_samples = g_stack_profile_min_samples->getValue();
+        s_resample = g_stack_profile_resample->getValue();
+        s_min_size = g_stack_profile_min_size->getValue();
+
+        g_stack_profile_paint->addListener([](const bool& old_value, const bool& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_profile.paint changed from "
+                                     << old_value << " to " << new_value;
+            s_paint = new_value;
+        });
+        g_stack_profile_adaptive->addListener([](const bool& old_value, const bool& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_profile.adaptive changed from "
+                                     << old_value << " to " << new_value;
+            s_adaptive = new_value;
+        });
+        g_stack_profile_min_samples->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_profile.min_samples changed from "
+                                     << old_value << " to " << new_value;
+            s_min_samples = new_value;
+        });
+        g_stack_profile_resample->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_profile.resample changed from "
+                                     << old_value << " to " << new_value;
+            s_resample = new_value;
+        });
+        g_stack_profile_min_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            AWCOTN_LOG_INFO(g_logger) << "fiber.stack_profile.min_size changed from "
+                                     << old_value << " to " << new_value;
+            s_min_size = new_value;
+        });
+    }
+};
+
+static _StackProfileIniter s_stack_profile_initer;
+
+static const uint8_t s_paint_byte = 0xA5;
+
+//直方图分桶: 第i个桶统计 (1K << (i - 1), 1K << i] 的样本, 最后一个桶不设上限
+static const int s_bucket_count = 16;
+static const size_t s_bucket_base = 1024;
+
+static int BucketIndex(size_t used) {
+    int i = 0;
+    size_t limit = s_bucket_base;
+    while(used > limit && i < s_bucket_count - 1) {
+        limit <<= 1;
+        ++i;
+    }
+    return i;
+}
+
+static size_t RoundUpPow2(size_t v) {
+    size_t r = 1;
+    while(r < v) {
+        r <<= 1;
+    }
+    return r;
+}
+
+/**
+ * @brief 一个入口的统计
+ * @details 插入之后地址不变, 字段都是原子变量, 读写只需要表的读锁
+ */
+struct StackEntry {
+    std::atomic<uint64_t> samples {0};
+    std::atomic<uint64_t> maxUsed {0};
+    std::atomic<uint64_t> stackSize {0};
+    std::atomic<uint64_t> suggest {0};
+    std::atomic<uint64_t> runs {0};
+    std::atomic<uint64_t> buckets[s_bucket_count];
+
+    StackEntry() {
+        for(auto& i : buckets) {
+            i = 0;
+        }
+    }
+};
+
+class StackEntryTable {
+public:
+    typedef RWMutex RWMutexType;
+
+    StackEntry* find(const std::type_info& entry) {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_entries.find(std::type_index(entry));
+        return it == m_entries.end() ? nullptr : it->second;
+    }
+
+    StackEntry* get(const std::type_info& entry) {
+        StackEntry* e = find(entry);
+        if(e) {
+            return e;
+        }
+        RWMutexType::WriteLock lock(m_mutex);
+        auto& v = m_entries[std::type_index(entry)];
+        if(!v) {
+            v = new StackEntry;
+        }
+        return v;
+    }
+
+    void listAll(std::vector<std::pair<std::type_index, StackEntry*> >& out) {
+        RWMutexType::ReadLock lock(m_mutex);
+        out.assign(m_entries.begin(), m_entries.end());
+    }
+private:
+    RWMutexType m_mutex;
+    //进程内一直使用, 不释放
+    std::unordered_map<std::type_index, StackEntry*> m_entries;
+};
+
+static StackEntryTable& GetEntryTable() {
+    static StackEntryTable s_table;
+    return s_table;
+}
+
+bool StackProfile::ShouldPaint(const std::type_info& entry) {
+    if(s_paint) {
+        return true;
+    }
+    if(!s_adaptive) {
+        return false;
+    }
+    StackEntry* e = GetEntryTable().find(entry);
+    if(!e || e->samples < s_min_samples) {
+        return true;
+    }
+    return s_resample && (++e->runs % s_resample) == 0;
+}
+
+void StackProfile::Paint(void* stack, size_t size) {
+    memset(stack, s_paint_byte, size);
+}
+
+size_t StackProfile::MeasureUsed(const void* stack, size_t size) {
+    const uint8_t* p = (const uint8_t*)stack;
+    const uint8_t* end = p + size;
+    while(p < end && *p == s_paint_byte) {
+        ++p;
+    }
+    return end - p;
+}
+
+void StackProfile::Record(const std::type_info& entry, size_t used, size_t size) {
+    StackEntry* e = GetEntryTable().get(entry);
+    ++e->buckets[BucketIndex(used)];
+    e->stackSize = size;
+    uint64_t old_max = e->maxUsed;
+    while(used > old_max && !e->maxUsed.compare_exchange_weak(old_max, used)) {
+    }
+    uint64_t samples = ++e->samples;
+    if(samples >= s_min_samples) {
+        size_t max_used = e->maxUsed;
+        e->suggest = std::max((size_t)s_min_size, RoundUpPow2(max_used * 2));
+    }
+}
+
+size_t StackProfile::SuggestStackSize(const std::type_info& entry) {
+    if(!s_adaptive) {
+        return 0;
+    }
+    StackEntry* e = GetEntryTable().find(entry);
+    return e ? e->suggest.load() : 0;
+}
+
+static std::string DemangleName(const char* name) {
+    int status = 0;
+    char* s = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if(status != 0 || !s) {
+        return name;
+    }
+    std::string rt(s);
+    free(s);
+    return rt;
+}
+
+void StackProfile::Dump(std::ostream& os) {
+    std::vector<std::pair<std::type_index, StackEntry*> > entries;
+    GetEntryTable().listAll(entries);
+    for(auto& i : entries) {
+        StackEntry* e = i.second;
+        os << DemangleName(i.first.name())
+           << " samples=" << e->samples
+           << " max_used=" << e->maxUsed
+           << " stack_size=" << e->stackSize
+           << " suggest=" << e->suggest
+           << " histogram=[";
+        bool first = true;
+        size_t limit = s_bucket_base;
+        for(int j = 0; j < s_bucket_count; ++j, limit <<= 1) {
+            uint64_t n = e->buckets[j];
+            if(!n) {
+                continue;
+            }
+            if(!first) {
+                os << " ";
+            }
+            first = false;
+            if(j == s_bucket_count - 1) {
+                os << ">" << (limit >> 11) << "K:" << n;
+            } else {
+                os << "<=" << (limit >> 10) << "K:" << n;
+            }
+        }
+        os << "]" << std::endl;
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __AWCOTN_STACK_PROFILE_H__
+#define __AWCOTN_STACK_PROFILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <typeinfo>
+
+namespace awcotn {
+
+/**
+ * @brief 协程栈使用量统计
+ * @details
+ * 栈涂色: 分配/reset时把整个栈填成固定字节, 协程结束后从栈底向上找到第一个
+ * 被改写的位置, 得到这次执行的栈高水位(high-water mark)
+ *
+ * 统计按入口(Task::entryType, 每个lambda类型都不同)聚合, 每个入口一个按2的幂分桶的直方图;
+ * 函数指针, std::bind的结果, std::function等多个调用点共用的类型不能区分调用点,
+ * 栈较浅的回调会让栈较深的回调也用小栈, 这些回调不涂色也不给出建议栈大小
+ *
+ * 自适应栈大小(fiber.stack_profile.adaptive):
+ * 1. 入口样本数不足min_samples时每次都涂色采样
+ * 2. 样本足够后给出建议栈大小 = 2 * 最大高水位向上取2的幂, 不小于min_size
+ * 3. 之后每resample次涂色一次, 持续更新最大高水位
+ * Scheduler为回调创建协程时使用建议栈大小
+ */
+class StackProfile {
+public:
+    /**
+     * @brief 入口本次执行是否需要涂色采样
+     */
+    static bool ShouldPaint(const std::type_info& entry);
+
+    /**
+     * @brief 栈涂色
+     * @param[in] stack 栈起始地址(低地址)
+     * @param[in] size 栈大小
+     */
+    static void Paint(void* stack, size_t size);
+
+    /**
+     * @brief 测量涂色后栈的已用大小(高水位)
+     */
+    static size_t MeasureUsed(const void* stack, size_t size);
+
+    /**
+     * @brief 记录一次执行的栈高水位
+     * @param[in] entry 入口类型
+     * @param[in] used 已用大小
+     * @param[in] size 栈大小
+     */
+    static void Record(const std::type_info& entry, size_t used, size_t size);
+
+    /**
+     * @brief 入口的建议栈大小
+     * @return 未开启自适应或样本不足时返回0
+     */
+    static size_t SuggestStackSize(const std::type_info& entry);
+
+    /**
+     * @brief 输出各入口的高水位直方图
+     */
+    static void Dump(std::ostream& os);
+};
+
+}
+
+#endif
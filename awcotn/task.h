@@ -0,0 +1,269 @@
+#ifndef __AWCOTN_TASK_H__
+#define __AWCOTN_TASK_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+namespace awcotn {
+
+/**
+ * @brief 可调用对象的类型是否被多个调用点共用
+ * @details 函数指针, 成员函数指针, std::bind的结果等类型不能区分调用点, 栈统计不按类型分入口;
+ *          其它共用的类型(例如coroutine_handle)可以特化为true
+ */
+template<class F>
+struct TaskSharedEntry : std::integral_constant<bool, std::is_pointer<F>::value
+                                                     || std::is_member_pointer<F>::value
+                                                     || std::is_bind_expression<F>::value> {
+};
+
+/**
+ * @brief 只能移动的void()可调用对象, 替代调度路径上的std::function<void()>
+ * @details
+ * 1. 不超过INLINE_SIZE字节且移动不抛异常的可调用对象直接保存在对象内部, 不分配内存;
+ *    std::function只能内联两个指针大小的捕获, 更大的都要分配
+ * 2. 只能移动, 入队出队都不会拷贝捕获的对象, 也可以保存只能移动的可调用对象
+ * 3. 从std::function构造时target_type返回其内部可调用对象的类型, 与直接保存时一致
+ * 4. entryType是栈统计的入口: 能区分调用点的类型(lambda, 自定义函数对象)返回其类型,
+ *    TaskSharedEntry为true的类型和std::function返回nullptr;
+ *    包装其它可调用对象的类型可以定义entryType()成员, 用EntryTypeOf返回被包装回调的入口
+ * 接口与std::function<void()>常用部分一致, 原有代码可以直接替换
+ */
+class Task {
+private:
+    //F是可以无参调用的类型(不包括Task本身)
+    template<class F>
+    struct IsCallable {
+        template<class U>
+        static auto test(int) -> decltype(std::declval<U&>()(), std::true_type());
+        template<class U>
+        static std::false_type test(...);
+
+        typedef typename std::decay<F>::type D;
+        static const bool value = !std::is_same<D, Task>::value
+                                && !std::is_same<D, std::nullptr_t>::value
+                                && decltype(test<D>(0))::value;
+    };
+
+public:
+    //内联保存的最大字节数
+    static const size_t INLINE_SIZE = 64;
+
+    Task()
+        : m_ops(nullptr) {
+    }
+
+    Task(std::nullptr_t)
+        : m_ops(nullptr) {
+    }
+
+    template<class F, class = typename std::enable_if<IsCallable<F>::value>::type>
+    Task(F&& f)
+        : m_ops(nullptr) {
+        assign(std::forward<F>(f));
+    }
+
+    Task(Task&& rhs)
+        : m_ops(nullptr) {
+        moveFrom(rhs);
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        clear();
+    }
+
+    Task& operator=(Task&& rhs) {
+        if(this != &rhs) {
+            clear();
+            moveFrom(rhs);
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) {
+        clear();
+        return *this;
+    }
+
+    template<class F, class = typename std::enable_if<IsCallable<F>::value>::type>
+    Task& operator=(F&& f) {
+        clear();
+        assign(std::forward<F>(f));
+        return *this;
+    }
+
+    void swap(Task& rhs) {
+        Task tmp(std::move(rhs));
+        rhs = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    void operator()() {
+        m_ops->invoke(data());
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    //保存的可调用对象的类型, 为空返回typeid(void)
+    const std::type_info& target_type() const {
+        return m_ops ? m_ops->type(data()) : typeid(void);
+    }
+
+    //栈统计的入口类型, 为空或不能区分调用点时返回nullptr
+    const std::type_info* entryType() const {
+        return m_ops ? m_ops->entry(data()) : nullptr;
+    }
+
+    //可调用对象f作为入口时的类型, 包装其它可调用对象的类型用它实现entryType()
+    template<class F>
+    static const std::type_info* EntryTypeOf(const F& f) { return EntryOf(&f, 0); }
+
+    //是否保存在对象内部(没有分配内存)
+    bool isInline() const { return m_ops && m_ops->inlined; }
+
+private:
+    //可以内联保存
+    template<class D>
+    struct FitsInline {
+        static const bool value = sizeof(D) <= INLINE_SIZE
+                                && alignof(D) <= alignof(std::max_align_t)
+                                && std::is_nothrow_move_constructible<D>::value;
+    };
+
+    struct Ops {
+        void (*invoke)(void* p);
+        //移动到dst并析构src
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* p);
+        const std::type_info& (*type)(const void* p);
+        const std::type_info* (*entry)(const void* p);
+        bool inlined;
+    };
+
+    //直接保存在m_buf中
+    template<class F>
+    struct InlineOps {
+        static void invoke(void* p) { (*static_cast<F*>(p))(); }
+        static void move(void* dst, void* src) {
+            F* f = static_cast<F*>(src);
+            new (dst) F(std::move(*f));
+            f->~F();
+        }
+        static void destroy(void* p) { static_cast<F*>(p)->~F(); }
+        static const std::type_info& type(const void* p) { return TypeOf(static_cast<const F*>(p)); }
+        static const std::type_info* entry(const void* p) { return EntryOf(static_cast<const F*>(p), 0); }
+        static const Ops s_ops;
+    };
+
+    //m_buf中保存指向堆上对象的指针
+    template<class F>
+    struct HeapOps {
+        static F* get(void* p) { return *static_cast<F**>(p); }
+        static void invoke(void* p) { (*get(p))(); }
+        static void move(void* dst, void* src) { *static_cast<F**>(dst) = get(src); }
+        static void destroy(void* p) { delete get(p); }
+        static const std::type_info& type(const void* p) {
+            return TypeOf(*static_cast<F* const*>(p));
+        }
+        static const std::type_info* entry(const void* p) {
+            return EntryOf(*static_cast<F* const*>(p), 0);
+        }
+        static const Ops s_ops;
+    };
+
+    template<class F>
+    static const std::type_info& TypeOf(const F*) { return typeid(F); }
+    static const std::type_info& TypeOf(const std::function<void()>* f) { return f->target_type(); }
+
+    //有entryType()成员的包装类型转发给被包装的回调
+    template<class F>
+    static auto EntryOf(const F* f, int) -> decltype(f->entryType()) { return f->entryType(); }
+    template<class F>
+    static const std::type_info* EntryOf(const F*, long) {
+        return TaskSharedEntry<F>::value ? nullptr : &typeid(F);
+    }
+    //std::function擦除了类型, 内部可能是函数指针或bind的结果, 不分入口
+    template<class Sig>
+    static const std::type_info* EntryOf(const std::function<Sig>*, int) { return nullptr; }
+
+    template<class F>
+    void assign(F&& f) {
+        typedef typename std::decay<F>::type D;
+        if(IsNull(f)) {
+            return;
+        }
+        store<D>(std::forward<F>(f), std::integral_constant<bool, FitsInline<D>::value>());
+    }
+
+    template<class D, class F>
+    void store(F&& f, std::true_type) {
+        new (data()) D(std::forward<F>(f));
+        m_ops = &InlineOps<D>::s_ops;
+    }
+
+    template<class D, class F>
+    void store(F&& f, std::false_type) {
+        *static_cast<D**>(data()) = new D(std::forward<F>(f));
+        m_ops = &HeapOps<D>::s_ops;
+    }
+
+    //空的std::function和空函数指针按空Task处理
+    template<class F>
+    static bool IsNull(const F&) { return false; }
+    static bool IsNull(const std::function<void()>& f) { return !f; }
+    static bool IsNull(void (*f)()) { return f == nullptr; }
+
+    void moveFrom(Task& rhs) {
+        if(rhs.m_ops) {
+            rhs.m_ops->move(data(), rhs.data());
+            m_ops = rhs.m_ops;
+            rhs.m_ops = nullptr;
+        }
+    }
+
+    void clear() {
+        if(m_ops) {
+            const Ops* ops = m_ops;
+            m_ops = nullptr;
+            ops->destroy(data());
+        }
+    }
+
+    void* data() { return m_buf; }
+    const void* data() const { return m_buf; }
+
+private:
+    alignas(std::max_align_t) char m_buf[INLINE_SIZE];
+    const Ops* m_ops;
+};
+
+template<class F>
+const Task::Ops Task::InlineOps<F>::s_ops = {
+    &Task::InlineOps<F>::invoke,
+    &Task::InlineOps<F>::move,
+    &Task::InlineOps<F>::destroy,
+    &Task::InlineOps<F>::type,
+    &Task::InlineOps<F>::entry,
+    true
+};
+
+template<class F>
+const Task::Ops Task::HeapOps<F>::s_ops = {
+    &Task::HeapOps<F>::invoke,
+    &Task::HeapOps<F>::move,
+    &Task::HeapOps<F>::destroy,
+    &Task::HeapOps<F>::type,
+    &Task::HeapOps<F>::entry,
+    false
+};
+
+}
+
+#endif
@@ -76,11 +76,11 @@ void compare_call_methods() {
         AWCOTN_LOG_INFO(g_logger) << "1. call/back模式: 开始";
         
         // 创建协程但不执行
-        Fiber::ptr fiber_b = std::make_shared<Fiber>([]() {
+        Fiber::ptr fiber_b = Fiber::ptr(new Fiber([]() {
             AWCOTN_LOG_INFO(g_logger) << "call/back - 协程B: 执行";
             AWCOTN_LOG_INFO(g_logger) << "call/back - 协程B: 完成";
             // 此处会自动back()返回A
-        });
+        }));
         
         AWCOTN_LOG_INFO(g_logger) << "call/back - 协程A: 调用协程B";
         fiber_b->call();  // A阻塞直到B完成
@@ -60,6 +60,26 @@ void Thread::join() {
     }
 }
 
+bool Thread::setAffinity(const std::vector<int>& cpus) {
+    if(!m_thread || cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus) {
+        if(cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int rt = pthread_setaffinity_np(m_thread, sizeof(set), &set);
+    if(rt) {
+        AWCOTN_LOG_ERROR(g_logger) << "pthread_setaffinity_np fail, rt=" << rt
+            << " name=" << m_name;
+        return false;
+    }
+    return true;
+}
+
 void* Thread::run(void *arg) {
     Thread* thread = (Thread*)arg;
     t_thread = thread;
@@ -12,6 +12,7 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdint.h>
+#include <vector>
 #include "mutex.h"
 
 namespace awcotn {
@@ -25,6 +26,13 @@ public:
     const std::string& getName() const { return m_name; }
 
     void join();
+
+    /**
+     * @brief 设置线程可以运行的CPU
+     * @param[in] cpus CPU编号, 为空时不做修改
+     * @return 是否成功
+     */
+    bool setAffinity(const std::vector<int>& cpus);
     static Thread* GetThis();
     static const std::string& GetName();
     static void SetName(const std::string& name);
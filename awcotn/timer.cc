@@ -4,7 +4,7 @@
 
 namespace awcotn {
 
-bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) {
+bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const {
     if(!lhs && !rhs) {
         return false;
     } else if(!lhs) {
@@ -20,24 +20,34 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs)
     return false;
 }
     
-Timer::Timer(uint64_t ms, std::function<void()> cb, 
-             bool recurring, TimerManager* manager) 
+Timer::Timer(uint64_t ms, Task cb, 
+             bool recurring, TimerManager* manager, bool non_blocking) 
     : m_recurring(recurring)
+    , m_nonBlocking(non_blocking)
     , m_ms(ms)
     , m_next(ms + GetCurrentMS())
-    , m_manager(manager)
-    , m_cb(cb){
-    
+    , m_manager(manager) {
+    if(recurring) {
+        m_recurringCb = std::make_shared<Recurring>();
+        m_recurringCb->cb = std::move(cb);
+    } else {
+        m_cb = std::move(cb);
+    }
 }
 
 Timer::Timer(uint64_t next)
     : m_next(next) {
 }
 
+void Timer::clearCb() {
+    m_cb = nullptr;
+    m_recurringCb.reset();
+}
+
 bool Timer::cancel() {
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(m_cb) {
-        m_cb = nullptr;
+    if(hasCb()) {
+        clearCb();
         auto it = m_manager->m_timers.find(shared_from_this());
         m_manager->m_timers.erase(it);
         return true;
@@ -47,7 +57,7 @@ bool Timer::cancel() {
 
 bool Timer::refresh() {
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
+    if(!hasCb()) {
         return false;
     }
     auto it = m_manager->m_timers.find(shared_from_this());
@@ -68,7 +78,7 @@ bool Timer::reset(uint64_t ms, bool from_now) {
         return false;
     }
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
+    if(!hasCb()) {
         return false;
     }
     auto it = m_manager->m_timers.find(shared_from_this());
@@ -97,8 +107,8 @@ TimerManager::~TimerManager() {
 
 }
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
+Timer::ptr TimerManager::addTimer(uint64_t ms, Task cb, bool recurring, bool non_blocking) {
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this, non_blocking));
     RWMutexType::WriteLock lock(m_mutex);
     addTimer(timer, lock);
     // 如果不是最前面的定时器，可能需要重新设置定时器的触发时间
@@ -107,15 +117,39 @@ Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool re
     return timer;
 }
 
-static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
-    std::shared_ptr<void> tmp = weak_cond.lock();
-    if(tmp) {
-        cb();
+//执行一次循环定时器的回调, 结束(包括抛出异常)后允许下一次到期执行
+struct Timer::RecurringRun {
+    std::shared_ptr<Recurring> r;
+
+    void operator()() {
+        struct Done {
+            std::atomic<bool>& running;
+            ~Done() { running.store(false, std::memory_order_release); }
+        } done{r->running};
+        r->cb();
     }
-}
 
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring) {
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+    const std::type_info* entryType() const { return r->cb.entryType(); }
+};
+
+//条件定时器的回调, 条件对象已经释放时不执行
+struct OnTimer {
+    std::weak_ptr<void> weak_cond;
+    Task cb;
+
+    void operator()() {
+        std::shared_ptr<void> tmp = weak_cond.lock();
+        if(tmp) {
+            cb();
+        }
+    }
+
+    const std::type_info* entryType() const { return cb.entryType(); }
+};
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, Task cb, std::weak_ptr<void> weak_cond
+                                           , bool recurring, bool non_blocking) {
+    return addTimer(ms, OnTimer{weak_cond, std::move(cb)}, recurring, non_blocking);
 }
 
 uint64_t TimerManager::getNextTimer() {
@@ -132,7 +166,7 @@ uint64_t TimerManager::getNextTimer() {
     return next->m_next - now_ms;
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
+void TimerManager::listExpiredCb(std::vector<Task>& cbs, std::vector<Task>* inline_cbs) {
     uint64_t now_ms = GetCurrentMS();
     std::vector<Timer::ptr> expired;
     {
@@ -142,11 +176,15 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
         }
     }
     RWMutexType::WriteLock lock(m_mutex);
+    //释放读锁到拿到写锁之间, 定时器可能已被其它线程取消
+    if(m_timers.empty()) {
+        return;
+    }
 
     // 检查是否发生了时钟回拨
     // 如果发生了时钟回拨，则将所有定时器的触发时间都设置为当前时间
     bool rollover = delectClockRollover(now_ms);
-    if(!rollover && (*m_timers.begin())->m_next < now_ms) {
+    if(!rollover && (*m_timers.begin())->m_next > now_ms) {
         return;
     }
     
@@ -159,11 +197,17 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
     m_timers.erase(m_timers.begin(), it); 
     cbs.reserve(expired.size());
     for(auto& i : expired) {
-        cbs.push_back(i->m_cb);
+        std::vector<Task>& out = (inline_cbs && i->m_nonBlocking) ? *inline_cbs : cbs;
         if(i->m_recurring) {
+            //上一次的回调还没有执行完时跳过, 有状态的回调不会在两个线程上同时执行
+            const std::shared_ptr<Timer::Recurring>& r = i->m_recurringCb;
+            if(!r->running.exchange(true, std::memory_order_acquire)) {
+                out.push_back(Timer::RecurringRun{r});
+            }
             i->m_next = now_ms + i->m_ms;
             m_timers.insert(i);
         } else {
+            out.push_back(std::move(i->m_cb));
             i->m_cb = nullptr;
         }
     }
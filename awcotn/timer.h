@@ -1,8 +1,10 @@
 #ifndef __AWCOTN_TIMER_H__
 #define __AWCOTN_TIMER_H__
 
+#include <atomic>
 #include <memory>
 #include "thread.h"
+#include "task.h"
 #include <sys/epoll.h>
 #include <functional>
 #include <string>
@@ -26,21 +28,35 @@ public:
     bool reset(uint64_t ms, bool from_now);
 
 private:
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring = false, TimerManager* manager = nullptr);
+    Timer(uint64_t ms, Task cb, bool recurring = false, TimerManager* manager = nullptr
+          , bool non_blocking = false);
     Timer(uint64_t next);
 
+    //是否还有回调(未取消且未到期)
+    bool hasCb() const { return m_cb || m_recurringCb; }
+    void clearCb();
+
 private:
     bool m_recurring = false; // 是否是循环定时器
+    bool m_nonBlocking = false; // 回调不会阻塞, 到期后在调度协程上直接执行
     uint64_t m_ms; // 定时器的时间间隔
     uint64_t m_next; // 下次触发的时间
     TimerManager* m_manager; // 定时器管理器
 
-    std::function<void()> m_cb; // 定时器到期时执行的回调函数
+    //循环定时器的回调和执行状态, 每次到期共享同一个
+    struct Recurring {
+        Task cb;
+        std::atomic<bool> running {false}; // 上一次到期的回调还没有执行完
+    };
+    struct RecurringRun;
+
+    Task m_cb; // 一次性定时器到期时执行的回调函数, 到期时移出
+    std::shared_ptr<Recurring> m_recurringCb; // 循环定时器的回调函数
     
     bool m_cancelled; // 是否被取消
 private:
     struct Comparator {
-        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs);
+        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
     };
 };
 
@@ -52,12 +68,22 @@ public:
     TimerManager();
     virtual ~TimerManager();
 
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
-    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+    /**
+     * @param[in] recurring 循环定时器; 同一个回调不会并发执行,
+     *            上一次到期的回调还在队列中或还没有执行完时, 本次到期跳过
+     * @param[in] non_blocking 回调不会阻塞(不会让出), 到期后不创建回调协程直接执行
+     */
+    Timer::ptr addTimer(uint64_t ms, Task cb, bool recurring = false, bool non_blocking = false);
+    Timer::ptr addConditionTimer(uint64_t ms, Task cb, std::weak_ptr<void> weak_cond
+                                 , bool recurring = false, bool non_blocking = false);
 
 
     uint64_t getNextTimer();
-    void listExpiredCb(std::vector<std::function<void()>>& cbs);
+    /**
+     * @brief 取出到期定时器的回调
+     * @param[out] inline_cbs 不为空时non_blocking定时器的回调放入这里
+     */
+    void listExpiredCb(std::vector<Task>& cbs, std::vector<Task>* inline_cbs = nullptr);
     bool hasTimer();
 
 protected:
@@ -0,0 +1,168 @@
+#include "uring.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace awcotn {
+
+static int SysSetup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int SysEnter(int fd, unsigned to_submit, unsigned min_complete
+                    ,unsigned flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+IoUring::~IoUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if(m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool IoUring::init(unsigned entries, unsigned cq_factor) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * cq_factor;
+    int fd = SysSetup(entries, &p);
+    if(fd < 0) {
+        return false;
+    }
+    //超时等待需要EXT_ARG, 完成队列溢出时不能丢cqe
+    if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        close(fd);
+        errno = ENOSYS;
+        return false;
+    }
+    m_features = p.features;
+
+    m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE
+                    ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        close(fd);
+        return false;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE
+                        ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            close(fd);
+            return false;
+        }
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+                      ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    m_sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (unsigned*)(sq + p.sq_off.head);
+    m_sqTail = (unsigned*)(sq + p.sq_off.tail);
+    m_sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    m_sqEntries = *(unsigned*)(sq + p.sq_off.ring_entries);
+    m_sqArray = (unsigned*)(sq + p.sq_off.array);
+    m_sqeTail = *m_sqTail;
+
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (unsigned*)(cq + p.cq_off.head);
+    m_cqTail = (unsigned*)(cq + p.cq_off.tail);
+    m_cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    m_fd = fd;
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqeTail - head >= m_sqEntries) {
+        return nullptr;
+    }
+    unsigned idx = m_sqeTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    ++m_sqeTail;
+    return sqe;
+}
+
+bool IoUring::hasSpace(unsigned n) const {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    return m_sqeTail - head + n <= m_sqEntries;
+}
+
+void IoUring::commit() {
+    unsigned n = m_sqeTail - *m_sqTail;
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    m_pending += n;
+}
+
+int IoUring::enter(unsigned wait_nr, uint64_t timeout_ms) {
+    unsigned to_submit = m_pending.exchange(0);
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    void* parg = nullptr;
+    size_t argsz = 0;
+    if(wait_nr) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if(timeout_ms != (uint64_t)-1) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = timeout_ms % 1000 * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        parg = &arg;
+        argsz = sizeof(arg);
+    }
+    int rt = SysEnter(m_fd, to_submit, wait_nr, flags, parg, argsz);
+    if(rt < 0) {
+        rt = -errno;
+        //没有提交成功的由下一次enter提交
+        if(to_submit) {
+            m_pending += to_submit;
+        }
+    } else if((unsigned)rt < to_submit) {
+        m_pending += to_submit - rt;
+    }
+    return rt;
+}
+
+unsigned IoUring::reap(io_uring_cqe* cqes, unsigned n) {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    while(head != tail && count < n) {
+        cqes[count++] = m_cqes[head & m_cqMask];
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+}
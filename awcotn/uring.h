@@ -0,0 +1,88 @@
+#ifndef __AWCOTN_URING_H__
+#define __AWCOTN_URING_H__
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "noncopyable.h"
+
+namespace awcotn {
+
+/**
+ * @brief io_uring的最小封装, 直接使用系统调用和mmap的环形队列, 不依赖liburing
+ * @details
+ * 1. 提交队列(SQ)只支持单生产者: getSqe到commit之间由调用者加锁
+ * 2. 完成队列(CQ)只支持单消费者: reap由调用者加锁
+ * 3. enter可以在任意线程无锁调用, 内核把已经commit的sqe全部取走
+ */
+class IoUring : Noncopyable {
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    /**
+     * @brief 创建ring
+     * @param[in] entries 提交队列长度, 完成队列为它的cq_factor倍
+     * @return 失败(内核不支持或被禁用)返回false, errno为原因
+     */
+    bool init(unsigned entries, unsigned cq_factor = 8);
+    bool isValid() const { return m_fd >= 0; }
+    int getFd() const { return m_fd; }
+    uint32_t getFeatures() const { return m_features; }
+
+    /**
+     * @brief 取一个清零的sqe, 填好后调用commit
+     * @return 提交队列满了返回nullptr, 需要先enter
+     */
+    io_uring_sqe* getSqe();
+    //提交队列中是否还能放下n个sqe
+    bool hasSpace(unsigned n) const;
+    //把getSqe取出的sqe发布给内核(还需要enter才会提交)
+    void commit();
+    //已发布还没有enter的sqe数量(近似值)
+    unsigned getPending() const { return m_pending; }
+
+    /**
+     * @brief 提交已发布的sqe, wait_nr > 0时等待至少wait_nr个完成
+     * @param[in] timeout_ms 等待的超时时间, -1表示不超时
+     * @return 提交的sqe数量, 失败返回-errno(超时为-ETIME, 被信号中断为-EINTR)
+     */
+    int enter(unsigned wait_nr = 0, uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 取出已完成的cqe
+     * @return 取出的数量, 最多n个
+     */
+    unsigned reap(io_uring_cqe* cqes, unsigned n);
+
+private:
+    int m_fd = -1;
+    uint32_t m_features = 0;
+
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned* m_sqArray = nullptr;
+    //getSqe取出但还没有commit的位置
+    unsigned m_sqeTail = 0;
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    std::atomic<unsigned> m_pending = {0};
+};
+
+}
+
+#endif
@@ -50,6 +50,33 @@ uint64_t GetCurrentMS() {
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+static double CalibrateCyclesPerNs() {
+#if defined(__x86_64__)
+    //忙等10ms, 不能用sleep(可能被hook)
+    struct timespec begin_ts, ts;
+    clock_gettime(CLOCK_MONOTONIC, &begin_ts);
+    uint64_t begin = GetCycleCount();
+    uint64_t elapsed_ns = 0;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        elapsed_ns = (ts.tv_sec - begin_ts.tv_sec) * 1000000000ull
+                    + ts.tv_nsec - begin_ts.tv_nsec;
+    } while(elapsed_ns < 10 * 1000 * 1000);
+    return (double)(GetCycleCount() - begin) / elapsed_ns;
+#elif defined(__aarch64__)
+    uint64_t freq;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq / 1e9;
+#else
+    return 1.0;
+#endif
+}
+
+uint64_t CyclesToNs(uint64_t cycles) {
+    static double s_cycles_per_ns = CalibrateCyclesPerNs();
+    return cycles / s_cycles_per_ns;
+}
+
 uint64_t GetCurrentUS() {
     struct timeval tv;
     gettimeofday(&tv, NULL);
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <time.h>
 
 namespace awcotn {
 
@@ -24,6 +25,30 @@ uint64_t GetCurrentMS();
 //时间us
 uint64_t GetCurrentUS();
 
+/**
+ * @brief 读取CPU周期计数器
+ * @details x86-64使用rdtsc, aarch64使用cntvct_el0, 其它平台返回单调时钟ns
+ *          只用于计算时间差, 换算成时间用CyclesToNs
+ */
+inline uint64_t GetCycleCount() {
+#if defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+//周期数换算为ns, 第一次调用时校准(约10ms)
+uint64_t CyclesToNs(uint64_t cycles);
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef __AWCOTN_WORK_STEALING_QUEUE_H__
+#define __AWCOTN_WORK_STEALING_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "noncopyable.h"
+
+namespace awcotn {
+
+/**
+ * @brief 有界Chase-Lev工作窃取双端队列
+ * @details
+ * 只有所属线程调用push/pop, 在bottom端操作(后进先出, 缓存友好)
+ * 其它线程调用steal, 在top端用CAS竞争(先进先出)
+ * 容量固定为2的幂, 满了push返回false, 由调用者放到全局队列
+ * T必须是可以原子读写的类型(指针)
+ */
+template<class T>
+class WorkStealingQueue : Noncopyable {
+public:
+    /**
+     * @param[in] capacity 容量, 向上取整为2的幂
+     */
+    explicit WorkStealingQueue(size_t capacity) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_capacity = cap;
+        m_mask = cap - 1;
+        m_buffer.reset(new std::atomic<T>[cap]);
+    }
+
+    /**
+     * @brief 所属线程在bottom端放入
+     * @return 队列已满返回false
+     */
+    bool push(T v) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if(b - t >= (int64_t)m_capacity) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(v, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief 所属线程从bottom端取出
+     * @return 成功返回true
+     */
+    bool pop(T& v) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        v = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if(t == b) {
+            //最后一个元素, 和窃取者竞争
+            bool ok = m_top.compare_exchange_strong(t, t + 1
+                    , std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return ok;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 其它线程从top端窃取
+     * @return 队列为空或竞争失败返回false
+     */
+    bool steal(T& v) {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return false;
+        }
+        v = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(t, t + 1
+                , std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    //近似元素个数
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return m_capacity; }
+private:
+    //top和bottom分别被窃取者和所属线程频繁修改, 放在不同缓存行
+    std::atomic<int64_t> m_top {0};
+    char m_pad1[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom {0};
+    char m_pad2[64 - sizeof(std::atomic<int64_t>)];
+    size_t m_capacity;
+    size_t m_mask;
+    std::unique_ptr<std::atomic<T>[]> m_buffer;
+};
+
+}
+
+#endif
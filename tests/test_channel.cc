@@ -0,0 +1,313 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+typedef std::unique_ptr<int> Item;
+
+//parse -> process -> respond 三级流水线, 只能移动的数据, 最后一个生产者关闭下游
+void test_pipeline() {
+    const int parsers = 2;
+    const int processors = 4;
+    const int per_parser = 20000;
+    awcotn::Channel<Item> parsed(16);
+    awcotn::Channel<Item> processed(16);
+    std::atomic<int> parsers_left {parsers};
+    std::atomic<int> processors_left {processors};
+    std::atomic<size_t> max_buffered {0};
+    int64_t sum = 0;
+    int count = 0;
+    uint64_t begin = awcotn::GetCurrentUS();
+    {
+        awcotn::IOManager iom(4, false);
+        for(int p = 0; p < parsers; ++p) {
+            iom.schedule([&, p](){
+                for(int i = 1; i <= per_parser; ++i) {
+                    if(!parsed.send(Item(new int(i)))) {
+                        ++s_errors;
+                    }
+                    size_t n = parsed.size();
+                    size_t m = max_buffered;
+                    while(n > m && !max_buffered.compare_exchange_weak(m, n));
+                }
+                if(--parsers_left == 0) {
+                    parsed.close();
+                }
+            });
+        }
+        for(int p = 0; p < processors; ++p) {
+            iom.schedule([&](){
+                Item item;
+                while(parsed.recv(item)) {
+                    *item *= 2;
+                    processed.send(std::move(item));
+                }
+                if(--processors_left == 0) {
+                    processed.close();
+                }
+            });
+        }
+        iom.schedule([&](){
+            Item item;
+            while(processed.recv(item)) {
+                sum += *item;
+                ++count;
+            }
+        });
+    }
+    int64_t expect = (int64_t)parsers * per_parser * (per_parser + 1);
+    if(sum != expect || count != parsers * per_parser || max_buffered > parsed.capacity()) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "pipeline items=" << count << " max_buffered=" << max_buffered
+        << " time=" << awcotn::GetCurrentUS() - begin << "us";
+}
+
+void test_close() {
+    awcotn::Channel<int> ch(4);
+    ch.send(1);
+    ch.send(2);
+    ch.close();
+    int v = 0;
+    if(ch.send(3) || ch.trySend(3)) {
+        ++s_errors;
+    }
+    //关闭后剩余的数据仍然可以取出
+    if(!ch.recv(v) || v != 1 || !ch.tryRecv(v) || v != 2 || ch.recv(v) || ch.tryRecv(v)) {
+        ++s_errors;
+    }
+
+    //等待中的接收方和发送方被close唤醒
+    awcotn::Channel<int> empty(0);
+    std::atomic<int> woken {0};
+    {
+        awcotn::IOManager iom(2, false);
+        iom.schedule([&](){
+            int x;
+            if(!empty.recv(x)) {
+                ++woken;
+            }
+        });
+        iom.schedule([&](){
+            awcotn::Channel<int> full(1);
+            full.send(1);
+            iom.schedule([&full](){
+                usleep(5 * 1000);
+                full.close();
+            });
+            if(!full.send(2)) {
+                ++woken;
+            }
+        });
+        iom.schedule([&](){
+            usleep(5 * 1000);
+            empty.close();
+        });
+    }
+    if(woken != 2) {
+        ++s_errors;
+    }
+}
+
+void test_try() {
+    awcotn::Channel<Item> ch(1);
+    Item a(new int(1));
+    Item b(new int(2));
+    if(!ch.trySend(std::move(a)) || a) {
+        ++s_errors;
+    }
+    //满时不移动参数
+    if(ch.trySend(std::move(b)) || !b || *b != 2) {
+        ++s_errors;
+    }
+    Item out;
+    if(!ch.tryRecv(out) || *out != 1 || ch.tryRecv(out)) {
+        ++s_errors;
+    }
+}
+
+void test_select() {
+    awcotn::Channel<int> numbers(0);
+    awcotn::Channel<std::string> words(0);
+    awcotn::Channel<int> quit(0);
+    int got_numbers = 0;
+    int got_words = 0;
+    {
+        awcotn::IOManager iom(2, false);
+        iom.schedule([&](){
+            for(int i = 0; i < 1000; ++i) {
+                numbers.send(i);
+            }
+        });
+        iom.schedule([&](){
+            for(int i = 0; i < 1000; ++i) {
+                words.send("w");
+            }
+        });
+        iom.schedule([&](){
+            while(true) {
+                int n = 0;
+                std::string w;
+                int q = 0;
+                awcotn::ChannelSelect sel;
+                sel.recv(numbers, n).recv(words, w).recv(quit, q);
+                int idx = sel.wait();
+                if(idx == 0) {
+                    ++got_numbers;
+                } else if(idx == 1) {
+                    if(w != "w") {
+                        ++s_errors;
+                    }
+                    ++got_words;
+                } else {
+                    break;
+                }
+                if(got_numbers + got_words == 2000) {
+                    awcotn::ChannelSelect none;
+                    none.recv(numbers, n).recv(words, w);
+                    if(none.tryWait() != -1) {
+                        ++s_errors;
+                    }
+                }
+            }
+        });
+        iom.schedule([&](){
+            while(got_numbers + got_words < 2000) {
+                usleep(1000);
+            }
+            quit.send(1);
+        });
+    }
+    if(got_numbers != 1000 || got_words != 1000) {
+        ++s_errors;
+    }
+
+    //send分支: 缓冲区满时选中另一个通道, 没选中的值留在原处
+    awcotn::Channel<Item> full(1);
+    awcotn::Channel<Item> free_ch(1);
+    full.send(Item(new int(0)));
+    awcotn::ChannelSelect sel;
+    sel.send(full, Item(new int(1))).send(free_ch, Item(new int(2)));
+    Item out;
+    if(sel.wait() != 1 || !free_ch.tryRecv(out) || *out != 2 || full.size() != 1) {
+        ++s_errors;
+    }
+
+    //已关闭通道的recv分支通过ok返回false
+    awcotn::Channel<int> closed(1);
+    closed.close();
+    int v;
+    bool ok = true;
+    awcotn::ChannelSelect sel2;
+    sel2.recv(closed, v, &ok);
+    if(sel2.wait() != 0 || ok) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "select numbers=" << got_numbers << " words=" << got_words;
+}
+
+//普通线程和协程之间收发
+void test_thread() {
+    awcotn::Channel<int> ch(2);
+    int64_t sum = 0;
+    {
+        awcotn::IOManager iom(1, false);
+        iom.schedule([&](){
+            int v;
+            while(ch.recv(v)) {
+                sum += v;
+            }
+        });
+        awcotn::Thread thr([&](){
+            for(int i = 1; i <= 1000; ++i) {
+                ch.send(i);
+            }
+            ch.close();
+        }, "chan_thread");
+        thr.join();
+    }
+    if(sum != 500500) {
+        ++s_errors;
+    }
+}
+
+//一个线程上的一问一答
+void bench_ping_pong(size_t capacity) {
+    const int rounds = 50000;
+    awcotn::Channel<int> ping(capacity);
+    awcotn::Channel<int> pong(capacity);
+    uint64_t begin = awcotn::GetCurrentUS();
+    {
+        awcotn::IOManager iom(1, false);
+        iom.schedule([&](){
+            int v;
+            for(int i = 0; i < rounds; ++i) {
+                ping.send(i);
+                if(!pong.recv(v) || v != i) {
+                    ++s_errors;
+                }
+            }
+        });
+        iom.schedule([&](){
+            int v;
+            for(int i = 0; i < rounds; ++i) {
+                ping.recv(v);
+                pong.send(v);
+            }
+        });
+    }
+    AWCOTN_LOG_INFO(g_logger) << "ping_pong capacity=" << capacity << " rounds=" << rounds << " time=" << awcotn::GetCurrentUS() - begin << "us";
+}
+
+//一个线程上的单向流水线, 生产者 -> 处理 -> 消费者
+void bench_stream(size_t capacity) {
+    const int items = 50000;
+    awcotn::Channel<Item> in(capacity);
+    awcotn::Channel<Item> out(capacity);
+    int64_t sum = 0;
+    uint64_t begin = awcotn::GetCurrentUS();
+    {
+        awcotn::IOManager iom(1, false);
+        iom.schedule([&](){
+            for(int i = 1; i <= items; ++i) {
+                in.send(Item(new int(i)));
+            }
+            in.close();
+        });
+        iom.schedule([&](){
+            Item item;
+            while(in.recv(item)) {
+                out.send(std::move(item));
+            }
+            out.close();
+        });
+        iom.schedule([&](){
+            Item item;
+            while(out.recv(item)) {
+                sum += *item;
+            }
+        });
+    }
+    if(sum != (int64_t)items * (items + 1) / 2) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "stream capacity=" << capacity << " items=" << items << " time=" << awcotn::GetCurrentUS() - begin << "us";
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_pipeline();
+    test_close();
+    test_try();
+    test_select();
+    test_thread();
+    bench_ping_pong(0);
+    bench_ping_pong(1);
+    bench_stream(0);
+    bench_stream(16);
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "awcotn/awcotn.h"
+#include <ucontext.h>
+#include <stdlib.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static const uint64_t s_loops = 2000000;
+static const size_t s_stack_size = 128 * 1024;
+
+static void report(const char* name, uint64_t switches, uint64_t us) {
+    AWCOTN_LOG_INFO(g_logger) << name << ": switches=" << switches
+        << " time=" << us << "us"
+        << " switches/s=" << (uint64_t)(switches * 1000000.0 / (us ? us : 1))
+        << " ns/switch=" << (us * 1000.0 / switches);
+}
+
+//ucontext原始切换, 作为回退后端的参照
+static ucontext_t s_uc_main;
+static ucontext_t s_uc_fiber;
+
+static void uc_func() {
+    while(true) {
+        swapcontext(&s_uc_fiber, &s_uc_main);
+    }
+}
+
+void bench_ucontext() {
+    void* stack = malloc(s_stack_size);
+    getcontext(&s_uc_fiber);
+    s_uc_fiber.uc_link = nullptr;
+    s_uc_fiber.uc_stack.ss_sp = stack;
+    s_uc_fiber.uc_stack.ss_size = s_stack_size;
+    makecontext(&s_uc_fiber, &uc_func, 0);
+
+    uint64_t begin = awcotn::GetCurrentUS();
+    for(uint64_t i = 0; i < s_loops; ++i) {
+        swapcontext(&s_uc_main, &s_uc_fiber);
+    }
+    report("raw ucontext", s_loops * 2, awcotn::GetCurrentUS() - begin);
+    free(stack);
+}
+
+//当前编译的后端的原始切换
+static awcotn::FiberContext s_ctx_main;
+static awcotn::FiberContext s_ctx_fiber;
+
+static void ctx_func() {
+    while(true) {
+        awcotn::SwapFiberContext(&s_ctx_fiber, &s_ctx_main);
+    }
+}
+
+void bench_context() {
+    void* stack = malloc(s_stack_size);
+    awcotn::MakeFiberContext(&s_ctx_fiber, stack, s_stack_size, &ctx_func);
+
+    uint64_t begin = awcotn::GetCurrentUS();
+    for(uint64_t i = 0; i < s_loops; ++i) {
+        awcotn::SwapFiberContext(&s_ctx_main, &s_ctx_fiber);
+    }
+    report((std::string("raw ") + awcotn::FiberContextBackend()).c_str()
+            , s_loops * 2, awcotn::GetCurrentUS() - begin);
+    free(stack);
+}
+
+//Fiber::call/back, 包含协程状态维护的完整开销
+void bench_fiber(const char* name) {
+    awcotn::Fiber::GetThis();
+    bool running = true;
+    awcotn::Fiber* raw = nullptr;
+    awcotn::Fiber::ptr fiber(new awcotn::Fiber([&running, &raw](){
+        while(running) {
+            raw->back();
+        }
+    }, s_stack_size, true));
+    raw = fiber.get();
+
+    uint64_t begin = awcotn::GetCurrentUS();
+    for(uint64_t i = 0; i < s_loops; ++i) {
+        fiber->call();
+    }
+    report((std::string(name) + " " + awcotn::FiberContextBackend()).c_str()
+            , s_loops * 2, awcotn::GetCurrentUS() - begin);
+    running = false;
+    fiber->call();
+    awcotn::Fiber::Stats st = fiber->getStats();
+    AWCOTN_LOG_INFO(g_logger) << name << " stats cpu_us=" << st.cpuNs / 1000
+        << " ready_us=" << st.readyNs / 1000 << " switches=" << st.switches;
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_INFO(g_logger) << "fiber context backend: "
+        << awcotn::FiberContextBackend();
+    bench_ucontext();
+    bench_context();
+    bench_fiber("fiber");
+    awcotn::Config::Lookup<bool>("fiber.stats.enable")->setValue(true);
+    bench_fiber("fiber+stats");
+    return 0;
+}
@@ -0,0 +1,304 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+static long get_rss_kb() {
+    long pages = 0, rss = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(fp) {
+        if(fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void set_nonblock(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+//读满n字节, 对端关闭返回false
+static awcotn::CoTask<bool> read_full(awcotn::IOManager* iom, int fd, char* buf, size_t n) {
+    size_t off = 0;
+    while(off < n) {
+        ssize_t rt = read(fd, buf + off, n - off);
+        if(rt > 0) {
+            off += rt;
+        } else if(rt == 0) {
+            co_return false;
+        } else if(errno == EAGAIN) {
+            if(co_await iom->readable(fd)) {
+                co_return false;
+            }
+        } else {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+//回显服务: 每条消息4字节
+static awcotn::CoTask<void> echo_server(awcotn::IOManager* iom, int fd) {
+    char buf[4];
+    while(co_await read_full(iom, fd, buf, sizeof(buf))) {
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            ++s_errors;
+        }
+    }
+    close(fd);
+}
+
+static awcotn::CoTask<int> echo_client(awcotn::IOManager* iom, int fd, int rounds) {
+    char buf[4];
+    for(int i = 0; i < rounds; ++i) {
+        memcpy(buf, &i, sizeof(i));
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            ++s_errors;
+        }
+        if(!co_await read_full(iom, fd, buf, sizeof(buf))) {
+            ++s_errors;
+            break;
+        }
+        int v = 0;
+        memcpy(&v, buf, sizeof(v));
+        if(v != i) {
+            ++s_errors;
+        }
+    }
+    close(fd);
+    co_return rounds;
+}
+
+void test_echo() {
+    const int conns = 64;
+    const int rounds = 1000;
+    awcotn::IOManager iom(2, false);
+    std::vector<awcotn::Future<int> > results;
+    uint64_t begin = awcotn::GetCurrentUS();
+    for(int i = 0; i < conns; ++i) {
+        int fds[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+            ++s_errors;
+            return;
+        }
+        set_nonblock(fds[0]);
+        set_nonblock(fds[1]);
+        awcotn::CoSpawn(&iom, echo_server(&iom, fds[0]));
+        results.push_back(awcotn::CoSpawn(&iom, echo_client(&iom, fds[1], rounds)));
+    }
+    int total = 0;
+    for(auto& i : results) {
+        total += i.get();
+    }
+    uint64_t used = awcotn::GetCurrentUS() - begin;
+    if(total != conns * rounds) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "echo conns=" << conns << " messages=" << total
+        << " time=" << used << "us";
+    iom.stop();
+}
+
+void test_timer() {
+    awcotn::IOManager iom(1, false);
+    auto task = [](awcotn::IOManager* iom) -> awcotn::CoTask<void> {
+        uint64_t begin = awcotn::GetCurrentMS();
+        co_await iom->sleepFor(50);
+        if(awcotn::GetCurrentMS() - begin < 45) {
+            ++s_errors;
+        }
+        //没有数据可读, 等待超时
+        int fds[2];
+        if(pipe(fds)) {
+            ++s_errors;
+            co_return;
+        }
+        set_nonblock(fds[0]);
+        begin = awcotn::GetCurrentMS();
+        int rt = co_await iom->readable(fds[0], 30);
+        if(rt != -1 || errno != ETIMEDOUT || awcotn::GetCurrentMS() - begin < 25) {
+            ++s_errors;
+        }
+        //超时之前就绪
+        if(write(fds[1], "x", 1) != 1) {
+            ++s_errors;
+        }
+        rt = co_await iom->readable(fds[0], 1000);
+        if(rt != 0) {
+            ++s_errors;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    };
+    awcotn::CoSpawn(&iom, task(&iom)).get();
+    iom.stop();
+}
+
+//协程与协程(有栈)共用同一组同步原语
+void test_sync() {
+    const int n = 200;
+    const int loops = 100;
+    awcotn::IOManager iom(4, false);
+    awcotn::FiberMutex mutex;
+    awcotn::WaitGroup wg(2 * n);
+    int64_t counter = 0;
+    for(int i = 0; i < n; ++i) {
+        auto co = [](awcotn::FiberMutex& m, awcotn::WaitGroup& wg, int64_t& c) -> awcotn::CoTask<void> {
+            for(int j = 0; j < loops; ++j) {
+                co_await awcotn::CoLock(m);
+                ++c;
+                m.unlock();
+                if(j % 10 == 0) {
+                    co_await awcotn::CoSchedule(awcotn::Scheduler::GetThis());
+                }
+            }
+            wg.done();
+        };
+        awcotn::CoSpawn(&iom, co(mutex, wg, counter));
+        iom.schedule([&](){
+            for(int j = 0; j < loops; ++j) {
+                awcotn::FiberMutex::Lock lock(mutex);
+                ++counter;
+            }
+            wg.done();
+        });
+    }
+    //协程等待WaitGroup
+    auto waiter = [](awcotn::WaitGroup& wg, int64_t& c) -> awcotn::CoTask<int64_t> {
+        co_await awcotn::CoWait(wg);
+        co_return c;
+    };
+    if(awcotn::CoSpawn(&iom, waiter(wg, counter)).get() != 2 * n * loops) {
+        ++s_errors;
+    }
+
+    //有栈协程生产, 无栈协程通过条件变量和信号量消费
+    awcotn::FiberCondVar cond;
+    awcotn::FiberSemaphore sem(0);
+    std::vector<int> queue;
+    auto consumer = [](awcotn::FiberMutex& m, awcotn::FiberCondVar& cond
+            , std::vector<int>& q, awcotn::FiberSemaphore& sem) -> awcotn::CoTask<int64_t> {
+        int64_t sum = 0;
+        for(int i = 0; i < 1000; ++i) {
+            co_await awcotn::CoLock(m);
+            while(q.empty()) {
+                co_await awcotn::CoWait(cond, m);
+            }
+            sum += q.back();
+            q.pop_back();
+            m.unlock();
+            co_await awcotn::CoWait(sem);
+        }
+        co_return sum;
+    };
+    awcotn::Future<int64_t> f = awcotn::CoSpawn(&iom, consumer(mutex, cond, queue, sem));
+    iom.schedule([&](){
+        for(int i = 0; i < 1000; ++i) {
+            {
+                awcotn::FiberMutex::Lock lock(mutex);
+                queue.push_back(i);
+            }
+            cond.notifyOne();
+            sem.notify();
+        }
+    });
+    if(f.get() != 999 * 1000 / 2) {
+        ++s_errors;
+    }
+
+    awcotn::FiberRWMutex rw;
+    auto reader = [](awcotn::FiberRWMutex& rw) -> awcotn::CoTask<void> {
+        co_await awcotn::CoReadLock(rw);
+        rw.unlock();
+        co_await awcotn::CoWriteLock(rw);
+        rw.unlock();
+    };
+    awcotn::CoSpawn(&iom, reader(rw)).get();
+    iom.stop();
+}
+
+void test_exception() {
+    awcotn::IOManager iom(1, false);
+    auto inner = []() -> awcotn::CoTask<int> {
+        throw std::runtime_error("inner");
+        co_return 1;
+    };
+    auto outer = [inner]() -> awcotn::CoTask<int> {
+        try {
+            co_await inner();
+        } catch(const std::runtime_error&) {
+            co_return 2;
+        }
+        co_return 0;
+    };
+    if(awcotn::CoSpawn(&iom, outer()).get() != 2) {
+        ++s_errors;
+    }
+    try {
+        awcotn::CoSpawn(&iom, inner()).get();
+        ++s_errors;
+    } catch(const std::runtime_error&) {
+    }
+    iom.stop();
+}
+
+//n个挂起的无栈协程和有栈协程各占用的内存
+void bench_memory() {
+    const int n = 10000;
+    awcotn::IOManager iom(1, false);
+    awcotn::FiberSemaphore sem(0);
+    awcotn::WaitGroup wg(n);
+    long base = get_rss_kb();
+    for(int i = 0; i < n; ++i) {
+        auto co = [](awcotn::FiberSemaphore& sem, awcotn::WaitGroup& wg) -> awcotn::CoTask<void> {
+            co_await awcotn::CoWait(sem);
+            wg.done();
+        };
+        awcotn::CoSpawn(&iom, co(sem, wg));
+    }
+    usleep(200 * 1000);
+    long co_kb = get_rss_kb() - base;
+    for(int i = 0; i < n; ++i) {
+        sem.notify();
+    }
+    wg.wait();
+
+    awcotn::WaitGroup wg2(n);
+    base = get_rss_kb();
+    for(int i = 0; i < n; ++i) {
+        iom.schedule([&](){
+            sem.wait();
+            wg2.done();
+        });
+    }
+    usleep(200 * 1000);
+    long fiber_kb = get_rss_kb() - base;
+    for(int i = 0; i < n; ++i) {
+        sem.notify();
+    }
+    wg2.wait();
+    iom.stop();
+    AWCOTN_LOG_INFO(g_logger) << "suspended n=" << n << " coroutine rss=" << co_kb
+        << "KB fiber rss=" << fiber_kb << "KB";
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_echo();
+    test_timer();
+    test_sync();
+    test_exception();
+    bench_memory();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
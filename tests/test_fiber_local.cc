@@ -0,0 +1,71 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+struct RequestCtx {
+    RequestCtx() { ++s_alive; }
+    ~RequestCtx() { --s_alive; }
+
+    std::string traceId;
+    uint64_t deadline = 0;
+
+    static std::atomic<int> s_alive;
+};
+
+std::atomic<int> RequestCtx::s_alive {0};
+
+static awcotn::FiberLocal<RequestCtx> s_request;
+
+void test_migrate() {
+    static const int s_count = 1000;
+    static std::atomic<int> s_errors {0};
+    static std::atomic<int> s_migrated {0};
+    {
+        awcotn::IOManager iom(3, false);
+        for(int i = 0; i < s_count; ++i) {
+            iom.schedule([i](){
+                s_request->traceId = "req-" + std::to_string(i);
+                s_request->deadline = i;
+                int tid = awcotn::GetThreadId();
+                for(int j = 0; j < 5; ++j) {
+                    usleep(1000);
+                    if(s_request->traceId != "req-" + std::to_string(i)
+                            || s_request->deadline != (uint64_t)i) {
+                        ++s_errors;
+                    }
+                }
+                if(tid != awcotn::GetThreadId()) {
+                    ++s_migrated;
+                }
+            });
+        }
+    }
+    AWCOTN_LOG_INFO(g_logger) << "fiber local errors=" << s_errors
+        << " migrated=" << s_migrated << " alive=" << RequestCtx::s_alive;
+}
+
+void test_perf() {
+    static const int s_count = 10000000;
+    awcotn::Fiber::ptr fiber(new awcotn::Fiber([](){
+        s_request->deadline = 1;
+        uint64_t sum = 0;
+        uint64_t begin = awcotn::GetCurrentUS();
+        for(int i = 0; i < s_count; ++i) {
+            sum += s_request.get()->deadline;
+        }
+        uint64_t used = awcotn::GetCurrentUS() - begin;
+        AWCOTN_LOG_INFO(g_logger) << "fiber local get " << s_count << " times: "
+            << used << "us, " << (used * 1000.0 / s_count) << "ns/get sum=" << sum;
+    }, 0, true));
+    fiber->call();
+    AWCOTN_LOG_INFO(g_logger) << "after fiber term alive=" << RequestCtx::s_alive;
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::INFO);
+    awcotn::Fiber::GetThis();
+    test_migrate();
+    test_perf();
+    return 0;
+}
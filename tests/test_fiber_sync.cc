@@ -0,0 +1,198 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <unistd.h>
+#include <deque>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+//多个线程上的协程和一个普通线程竞争同一把锁, 持锁期间让出
+void test_mutex() {
+    awcotn::FiberMutex mutex;
+    int64_t count = 0;
+    std::atomic<int> holders {0};
+    const int fibers = 200;
+    const int loops = 200;
+    auto body = [&](){
+        for(int i = 0; i < loops; ++i) {
+            awcotn::FiberMutex::Lock lock(mutex);
+            if(++holders != 1) {
+                ++s_errors;
+            }
+            ++count;
+            if(i % 50 == 0) {
+                awcotn::Fiber::YieldToReady();
+            }
+            --holders;
+        }
+    };
+    uint64_t begin = awcotn::GetCurrentUS();
+    {
+        awcotn::IOManager iom(4, false);
+        for(int i = 0; i < fibers; ++i) {
+            iom.schedule(body);
+        }
+        awcotn::Thread thr([&](){
+            for(int i = 0; i < loops; ++i) {
+                awcotn::FiberMutex::Lock lock(mutex);
+                if(++holders != 1) {
+                    ++s_errors;
+                }
+                ++count;
+                --holders;
+            }
+        }, "sync_thread");
+        thr.join();
+    }
+    if(count != (int64_t)(fibers + 1) * loops) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "mutex count=" << count
+        << " time=" << awcotn::GetCurrentUS() - begin << "us";
+}
+
+//等锁时只挂起协程: 一个线程的调度器, 持锁的协程sleep期间其它协程继续执行
+void test_mutex_no_block() {
+    awcotn::FiberMutex mutex;
+    std::atomic<int> progress {0};
+    bool waited = false;
+    {
+        awcotn::IOManager iom(1, false);
+        iom.schedule([&](){
+            awcotn::FiberMutex::Lock lock(mutex);
+            usleep(20 * 1000);
+        });
+        iom.schedule([&](){
+            awcotn::FiberMutex::Lock lock(mutex);
+            //在等锁期间, 另一个协程已经执行完
+            waited = progress == 1;
+        });
+        iom.schedule([&](){
+            ++progress;
+        });
+    }
+    if(!waited) {
+        ++s_errors;
+    }
+}
+
+void test_condvar() {
+    awcotn::FiberMutex mutex;
+    awcotn::FiberCondVar cond;
+    std::deque<int> queue;
+    bool closed = false;
+    int64_t sum = 0;
+    const int items = 10000;
+    {
+        awcotn::IOManager iom(4, false);
+        for(int c = 0; c < 4; ++c) {
+            iom.schedule([&](){
+                while(true) {
+                    awcotn::FiberMutex::Lock lock(mutex);
+                    cond.wait(mutex, [&](){ return closed || !queue.empty(); });
+                    if(queue.empty()) {
+                        break;
+                    }
+                    sum += queue.front();
+                    queue.pop_front();
+                }
+            });
+        }
+        iom.schedule([&](){
+            for(int i = 1; i <= items; ++i) {
+                {
+                    awcotn::FiberMutex::Lock lock(mutex);
+                    queue.push_back(i);
+                }
+                cond.notifyOne();
+            }
+            awcotn::FiberMutex::Lock lock(mutex);
+            closed = true;
+            lock.unlock();
+            cond.notifyAll();
+        });
+    }
+    if(sum != (int64_t)items * (items + 1) / 2) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "condvar sum=" << sum;
+}
+
+//信号量限制同时执行的协程数
+void test_semaphore() {
+    awcotn::FiberSemaphore sem(3);
+    std::atomic<int> running {0};
+    std::atomic<int> peak {0};
+    std::atomic<int> done {0};
+    {
+        awcotn::IOManager iom(4, false);
+        for(int i = 0; i < 60; ++i) {
+            iom.schedule([&](){
+                sem.wait();
+                int cur = ++running;
+                int p = peak;
+                while(cur > p && !peak.compare_exchange_weak(p, cur));
+                usleep(1000);
+                --running;
+                ++done;
+                sem.notify();
+            });
+        }
+    }
+    if(peak > 3 || done != 60 || sem.getCount() != 3) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "semaphore peak=" << peak << " done=" << done;
+}
+
+void test_rwmutex() {
+    awcotn::FiberRWMutex rw;
+    std::atomic<int> readers {0};
+    std::atomic<int> writers {0};
+    std::atomic<int> peak_readers {0};
+    int value = 0;
+    {
+        awcotn::IOManager iom(4, false);
+        for(int i = 0; i < 100; ++i) {
+            iom.schedule([&, i](){
+                for(int j = 0; j < 20; ++j) {
+                    if((i + j) % 10 == 0) {
+                        awcotn::FiberRWMutex::WriteLock lock(rw);
+                        if(++writers != 1 || readers != 0) {
+                            ++s_errors;
+                        }
+                        ++value;
+                        usleep(100);
+                        --writers;
+                    } else {
+                        awcotn::FiberRWMutex::ReadLock lock(rw);
+                        int cur = ++readers;
+                        if(writers != 0) {
+                            ++s_errors;
+                        }
+                        int p = peak_readers;
+                        while(cur > p && !peak_readers.compare_exchange_weak(p, cur));
+                        usleep(100);
+                        --readers;
+                    }
+                }
+            });
+        }
+    }
+    if(value != 200) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "rwmutex writes=" << value << " peak_readers=" << peak_readers;
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_mutex();
+    test_mutex_no_block();
+    test_condvar();
+    test_semaphore();
+    test_rwmutex();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
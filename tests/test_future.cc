@@ -0,0 +1,221 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include "awcotn/sync_call.h"
+#include <stdexcept>
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+//模拟一个后端请求, 等待ms毫秒后返回
+static int backend(int i, int ms) {
+    usleep(ms * 1000);
+    return i * i;
+}
+
+//扇出到N个后端, 全部返回后合并
+void test_fan_out() {
+    const int n = 8;
+    awcotn::IOManager iom(2, false);
+    uint64_t used = 0;
+    iom.schedule([&](){
+        uint64_t begin = awcotn::GetCurrentUS();
+        std::vector<awcotn::Future<int> > futures;
+        for(int i = 0; i < n; ++i) {
+            futures.push_back(awcotn::Async(&iom, std::bind(backend, i, 10 + i)));
+        }
+        std::vector<int> values = awcotn::WhenAll(futures).get();
+        used = awcotn::GetCurrentUS() - begin;
+        if(values.size() != (size_t)n || !futures.empty()) {
+            ++s_errors;
+            return;
+        }
+        for(int i = 0; i < n; ++i) {
+            if(values[i] != i * i) {
+                ++s_errors;
+            }
+        }
+    });
+    iom.stop();
+    //并发执行, 总时间接近最慢的一个而不是总和
+    if(used >= 10 * n * 1000) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "fan_out n=" << n << " time=" << used << "us";
+}
+
+void test_then() {
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&iom](){
+        awcotn::Future<std::string> f = awcotn::Async(&iom, [](){ return 20; })
+            .then([](int v){ return v + 1; })
+            //返回Future时展开
+            .then([&iom](int v){
+                return awcotn::Async(&iom, [v](){ return v * 2; });
+            })
+            .then([](int v){ return std::to_string(v); });
+        if(f.get() != "42") {
+            ++s_errors;
+        }
+
+        //void和只能移动的值
+        std::unique_ptr<int> out;
+        awcotn::Async(&iom, [](){ usleep(1000); })
+            .then([](){ return std::unique_ptr<int>(new int(7)); })
+            .then([&out](std::unique_ptr<int> p){ out = std::move(p); })
+            .get();
+        if(!out || *out != 7) {
+            ++s_errors;
+        }
+    });
+    iom.stop();
+}
+
+void test_exception() {
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&iom](){
+        std::atomic<bool> skipped {true};
+        awcotn::Future<int> f = awcotn::Async(&iom, []() -> int {
+                throw std::runtime_error("backend down");
+            }).then([&skipped](int v){
+                skipped = false;
+                return v;
+            });
+        try {
+            f.get();
+            ++s_errors;
+        } catch(const std::runtime_error& e) {
+            if(std::string(e.what()) != "backend down") {
+                ++s_errors;
+            }
+        }
+        if(!skipped) {
+            ++s_errors;
+        }
+
+        //WhenAll遇到异常立即完成, 不等慢的
+        std::vector<awcotn::Future<int> > futures;
+        futures.push_back(awcotn::Async(&iom, std::bind(backend, 1, 200)));
+        futures.push_back(awcotn::Async(&iom, []() -> int {
+                throw std::runtime_error("fail");
+            }));
+        uint64_t begin = awcotn::GetCurrentUS();
+        try {
+            awcotn::WhenAll(futures).get();
+            ++s_errors;
+        } catch(const std::runtime_error&) {
+        }
+        if(awcotn::GetCurrentUS() - begin >= 200 * 1000) {
+            ++s_errors;
+        }
+
+        //Promise没有设置结果就析构
+        awcotn::Future<int> broken;
+        {
+            awcotn::Promise<int> p;
+            broken = p.getFuture();
+        }
+        try {
+            broken.get();
+            ++s_errors;
+        } catch(const std::future_error& e) {
+            if(e.code() != std::future_errc::broken_promise) {
+                ++s_errors;
+            }
+        }
+
+        //SyncCall把任务的异常抛给调用者
+        awcotn::SyncCall sc;
+        try {
+            sc.call([](){ throw std::logic_error("sync"); });
+            ++s_errors;
+        } catch(const std::logic_error&) {
+        }
+        if(!sc.isDone()) {
+            ++s_errors;
+        }
+    });
+    iom.stop();
+}
+
+void test_when_any() {
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&iom](){
+        std::vector<awcotn::Future<int> > futures;
+        futures.push_back(awcotn::Async(&iom, std::bind(backend, 1, 100)));
+        futures.push_back(awcotn::Async(&iom, []() -> int {
+                throw std::runtime_error("fail");
+            }));
+        futures.push_back(awcotn::Async(&iom, std::bind(backend, 3, 5)));
+        //第一个成功的, 跳过失败的
+        std::pair<size_t, int> first = awcotn::WhenAny(futures).get();
+        if(first.first != 2 || first.second != 9) {
+            ++s_errors;
+        }
+
+        std::vector<awcotn::Future<void> > voids;
+        voids.push_back(awcotn::Async(&iom, [](){ usleep(50 * 1000); }));
+        voids.push_back(awcotn::Async(&iom, [](){ usleep(1000); }));
+        if(awcotn::WhenAny(voids).get() != 1) {
+            ++s_errors;
+        }
+
+        voids.push_back(awcotn::Async(&iom, [](){ usleep(1000); }));
+        voids.push_back(awcotn::MakeReadyFuture());
+        awcotn::WhenAll(voids).get();
+    });
+    iom.stop();
+}
+
+//普通线程等待协程设置的结果
+void test_thread_wait() {
+    awcotn::IOManager iom(1, false);
+    awcotn::Promise<int> p;
+    awcotn::Future<int> f = p.getFuture();
+    std::shared_ptr<awcotn::Promise<int> > sp(new awcotn::Promise<int>(std::move(p)));
+    iom.schedule([sp](){
+        usleep(5 * 1000);
+        sp->setValue(5);
+    });
+    if(f.get() != 5) {
+        ++s_errors;
+    }
+    iom.stop();
+}
+
+//扇出4个立即返回的请求再合并, 每轮的开销
+void bench_fan_out() {
+    const int rounds = 20000;
+    const int n = 4;
+    awcotn::IOManager iom(2, false);
+    uint64_t begin = awcotn::GetCurrentUS();
+    iom.schedule([&](){
+        for(int r = 0; r < rounds; ++r) {
+            std::vector<awcotn::Future<int> > futures;
+            for(int i = 0; i < n; ++i) {
+                futures.push_back(awcotn::Async(&iom, [i](){ return i; }));
+            }
+            std::vector<int> values = awcotn::WhenAll(futures).get();
+            if(values[n - 1] != n - 1) {
+                ++s_errors;
+            }
+        }
+    });
+    iom.stop();
+    uint64_t used = awcotn::GetCurrentUS() - begin;
+    AWCOTN_LOG_INFO(g_logger) << "bench_fan_out rounds=" << rounds << " n=" << n
+        << " time=" << used << "us ns/round=" << used * 1000 / rounds;
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_fan_out();
+    test_then();
+    test_exception();
+    test_when_any();
+    test_thread_wait();
+    bench_fan_out();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <sys/epoll.h>
 #include "awcotn/timer.h"
+#include "awcotn/stack_allocator.h"
+#include <string.h>
 
 awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
 
@@ -70,8 +72,130 @@ void test_timer() {
     }, true);
 }
 
+void test_fiber_pool() {
+    static const int s_count = 10000;
+    static std::atomic<int> s_done {0};
+    awcotn::IOManager iom(2);
+    for(int i = 0; i < s_count; ++i) {
+        iom.schedule([](){
+            //挂起一次, 回调协程离开cb_fiber, 结束后回到协程池
+            usleep(1000);
+            if(++s_done == s_count) {
+                auto iom = awcotn::IOManager::GetThis();
+                AWCOTN_LOG_INFO(g_logger) << "fiber pool hits=" << iom->getFiberPoolHits()
+                    << " misses=" << iom->getFiberPoolMisses()
+                    << " total_fibers=" << awcotn::Fiber::TotalFibers();
+            }
+        });
+    }
+}
+
+void test_shared_stack() {
+    static const int s_count = 1000;
+    static std::atomic<int> s_done {0};
+    static std::atomic<int> s_errors {0};
+    awcotn::IOManager iom(2);
+    for(int i = 0; i < s_count; ++i) {
+        awcotn::Fiber::ptr fiber(new awcotn::Fiber([i](){
+            //栈上数据在换出换入后必须保持不变
+            char buf[4096];
+            memset(buf, i & 0xff, sizeof(buf));
+            usleep(1000);
+            for(size_t j = 0; j < sizeof(buf); ++j) {
+                if(buf[j] != (char)(i & 0xff)) {
+                    ++s_errors;
+                    break;
+                }
+            }
+            if(++s_done == s_count) {
+                AWCOTN_LOG_INFO(g_logger) << "shared stack fibers=" << s_count
+                    << " errors=" << s_errors
+                    << " mapped_stacks=" << awcotn::StackPool::GetMappedCount();
+            }
+        }, 0, false, true));
+        iom.schedule(fiber);
+    }
+}
+
+static long get_rss_kb() {
+    long pages = 0, rss = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(fp) {
+        if(fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+//一次性使用128K栈, 返回后这部分栈页仍然驻留
+void touch_stack() {
+    char buf[128 * 1024];
+    memset(buf, 1, sizeof(buf));
+    __asm__ __volatile__("" : : "r"(buf) : "memory");
+}
+
+void test_stack_trim() {
+    static const int s_count = 500;
+    static std::atomic<int> s_errors {0};
+    awcotn::Config::Lookup<uint32_t>("fiber.stack_trim.idle_ms")->setValue(200);
+    awcotn::IOManager iom(2);
+    for(int i = 0; i < s_count; ++i) {
+        iom.schedule([](){
+            char live[256];
+            memset(live, 7, sizeof(live));
+            touch_stack();
+            //长时间挂起, 期间栈指针以下的页被回收
+            usleep(1500 * 1000);
+            for(size_t j = 0; j < sizeof(live); ++j) {
+                if(live[j] != 7) {
+                    ++s_errors;
+                    break;
+                }
+            }
+        });
+    }
+    iom.addTimer(100, [](){
+        AWCOTN_LOG_INFO(g_logger) << "parked fibers rss=" << get_rss_kb() << "KB";
+    });
+    iom.addTimer(1300, [](){
+        AWCOTN_LOG_INFO(g_logger) << "after trim rss=" << get_rss_kb() << "KB"
+            << " trimmed=" << awcotn::StackPool::GetTrimmedBytes() / 1024 << "KB";
+    });
+    iom.addTimer(2000, [](){
+        AWCOTN_LOG_INFO(g_logger) << "stack trim errors=" << s_errors;
+    });
+}
+
+void test_fiber_stats() {
+    awcotn::Config::Lookup<bool>("fiber.stats.enable")->setValue(true);
+    awcotn::Config::Lookup<bool>("fiber.stats.log")->setValue(true);
+    awcotn::IOManager iom(2);
+    //占用CPU的回调
+    iom.schedule([](){
+        uint64_t begin = awcotn::GetCurrentMS();
+        while(awcotn::GetCurrentMS() - begin < 20);
+        awcotn::Fiber::Stats st = awcotn::Fiber::GetThis()->getStats();
+        AWCOTN_LOG_INFO(g_logger) << "cpu handler cpu_us=" << st.cpuNs / 1000
+            << " hold_us=" << st.holdNs / 1000;
+    });
+    //大部分时间挂起的回调
+    iom.schedule([](){
+        for(int i = 0; i < 5; ++i) {
+            usleep(10 * 1000);
+        }
+        awcotn::Fiber::Stats st = awcotn::Fiber::GetThis()->getStats();
+        AWCOTN_LOG_INFO(g_logger) << "sleep handler cpu_us=" << st.cpuNs / 1000
+            << " hold_us=" << st.holdNs / 1000 << " switches=" << st.switches;
+    });
+}
 
 int main(int argc, char** argv) {
     test_timer();
+    test_fiber_pool();
+    test_shared_stack();
+    test_stack_trim();
+    test_fiber_stats();
     return 0;
 }
\ No newline at end of file
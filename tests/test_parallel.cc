@@ -0,0 +1,218 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+//生成模拟的访问日志
+static std::vector<std::string> make_logs(size_t n) {
+    static const char* methods[] = {"GET", "POST", "PUT"};
+    static const int codes[] = {200, 200, 200, 304, 404, 500};
+    std::vector<std::string> logs;
+    logs.reserve(n);
+    char buf[256];
+    for(size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "10.0.%d.%d - - [17/Oct/2026:10:%02d:%02d +0800] \"%s /api/v1/item/%zu HTTP/1.1\" %d %zu"
+                , (int)(i / 256 % 256), (int)(i % 256), (int)(i / 60 % 60), (int)(i % 60)
+                , methods[i % 3], i, codes[i % 6], i * 7 % 4096);
+        logs.push_back(buf);
+    }
+    return logs;
+}
+
+//解析一行日志, 返回状态码为200的响应字节数
+static uint64_t parse_line(const std::string& line) {
+    const char* p = strchr(line.c_str(), '"');
+    p = p ? strchr(p + 1, '"') : nullptr;
+    if(!p) {
+        return 0;
+    }
+    char* end = nullptr;
+    long code = strtol(p + 1, &end, 10);
+    long bytes = strtol(end, nullptr, 10);
+    uint64_t h = 0;
+    //模拟字段校验的计算量
+    for(size_t i = 0; i < line.size(); ++i) {
+        h = h * 131 + line[i];
+    }
+    if(h == 0 || code != 200) {
+        return 0;
+    }
+    return bytes;
+}
+
+static uint64_t parse_range(const std::vector<std::string>& logs, size_t lo, size_t hi) {
+    uint64_t sum = 0;
+    for(size_t i = lo; i < hi; ++i) {
+        sum += parse_line(logs[i]);
+    }
+    return sum;
+}
+
+void test_for() {
+    const size_t n = 100000;
+    awcotn::IOManager iom(4, false);
+    std::vector<int> marks(n, 0);
+    iom.schedule([&](){
+        //每个元素恰好执行一次
+        awcotn::ParallelFor(&iom, 0, n, 1000, [&marks](size_t lo, size_t hi){
+            for(size_t i = lo; i < hi; ++i) {
+                ++marks[i];
+            }
+        });
+        //自动选择块大小, 区间不从0开始
+        awcotn::ParallelFor(&iom, 10, n, 0, [&marks](size_t lo, size_t hi){
+            for(size_t i = lo; i < hi; ++i) {
+                ++marks[i];
+            }
+        });
+        //空区间
+        awcotn::ParallelFor(&iom, 5, 5, 1, [](size_t, size_t){ ++s_errors; });
+    });
+    iom.stop();
+    for(size_t i = 0; i < n; ++i) {
+        if(marks[i] != (i < 10 ? 1 : 2)) {
+            ++s_errors;
+            break;
+        }
+    }
+}
+
+void test_reduce() {
+    awcotn::IOManager iom(4, false);
+    iom.schedule([&iom](){
+        const size_t n = 1000000;
+        int64_t sum = awcotn::ParallelReduce(&iom, 0, n, 4096, (int64_t)0
+                , [](size_t lo, size_t hi){
+                    int64_t s = 0;
+                    for(size_t i = lo; i < hi; ++i) {
+                        s += i;
+                    }
+                    return s;
+                }, [](int64_t a, int64_t b){ return a + b; });
+        if(sum != (int64_t)n * (n - 1) / 2) {
+            ++s_errors;
+        }
+
+        //合并顺序与块的顺序一致, 不要求交换律
+        std::string s = awcotn::ParallelReduce(&iom, 0, 26, 1, std::string()
+                , [](size_t lo, size_t hi){ return std::string(1, (char)('a' + lo)); }
+                , [](std::string a, std::string b){ return a + b; });
+        if(s != "abcdefghijklmnopqrstuvwxyz") {
+            ++s_errors;
+        }
+
+        //块中再嵌套并行
+        int64_t nested = awcotn::ParallelReduce(&iom, 0, 64, 4, (int64_t)0
+                , [&iom](size_t lo, size_t hi){
+                    return awcotn::ParallelReduce(&iom, lo * 1000, hi * 1000, 100, (int64_t)0
+                        , [](size_t l, size_t h){ return (int64_t)(h - l); }
+                        , [](int64_t a, int64_t b){ return a + b; });
+                }, [](int64_t a, int64_t b){ return a + b; });
+        if(nested != 64000) {
+            ++s_errors;
+        }
+
+        //bool结果: 每块的结果不能按位共享存储
+        for(size_t bad = 0; bad < 64; bad += 21) {
+            bool all = awcotn::ParallelReduce(&iom, 0, 64, 1, true
+                    , [bad](size_t lo, size_t hi){ return lo != bad; }
+                    , [](bool a, bool b){ return a && b; });
+            bool any = awcotn::ParallelReduce(&iom, 0, 64, 1, false
+                    , [bad](size_t lo, size_t hi){ return lo == bad; }
+                    , [](bool a, bool b){ return a || b; });
+            if(all || !any) {
+                ++s_errors;
+            }
+        }
+    });
+    iom.stop();
+}
+
+void test_exception() {
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&iom](){
+        std::atomic<size_t> ran {0};
+        try {
+            awcotn::ParallelFor(&iom, 0, 1000, 1, [&ran](size_t lo, size_t){
+                if(lo == 10) {
+                    throw std::runtime_error("chunk 10");
+                }
+                usleep(100);
+                ++ran;
+            });
+            ++s_errors;
+        } catch(const std::runtime_error& e) {
+            if(std::string(e.what()) != "chunk 10") {
+                ++s_errors;
+            }
+        }
+        //出错后没有开始的块被跳过
+        if(ran >= 999) {
+            ++s_errors;
+        }
+        AWCOTN_LOG_INFO(g_logger) << "exception skipped=" << 999 - ran << " chunks";
+    });
+    iom.stop();
+}
+
+//普通线程调用, 块全部由调度器执行
+void test_thread_caller() {
+    awcotn::IOManager iom(2, false);
+    int64_t sum = awcotn::ParallelReduce(&iom, 0, 10000, 0, (int64_t)0
+            , [](size_t lo, size_t hi){ return (int64_t)(hi - lo); }
+            , [](int64_t a, int64_t b){ return a + b; });
+    if(sum != 10000) {
+        ++s_errors;
+    }
+    iom.stop();
+}
+
+//解析日志: 单线程循环与不同线程数的ParallelReduce对比
+void bench_parse() {
+    const size_t n = 400000;
+    std::vector<std::string> logs = make_logs(n);
+
+    uint64_t begin = awcotn::GetCurrentUS();
+    uint64_t expect = parse_range(logs, 0, n);
+    uint64_t serial_used = awcotn::GetCurrentUS() - begin;
+    AWCOTN_LOG_INFO(g_logger) << "bench_parse lines=" << n << " serial=" << serial_used << "us";
+
+    size_t hw = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    for(size_t threads = 1; threads <= std::max<size_t>(hw, 4); threads *= 2) {
+        awcotn::IOManager iom(threads, false);
+        uint64_t used = 0;
+        iom.schedule([&](){
+            uint64_t b = awcotn::GetCurrentUS();
+            uint64_t sum = awcotn::ParallelReduce(&iom, 0, n, 0, (uint64_t)0
+                    , [&logs](size_t lo, size_t hi){ return parse_range(logs, lo, hi); }
+                    , [](uint64_t a, uint64_t b){ return a + b; });
+            used = awcotn::GetCurrentUS() - b;
+            if(sum != expect) {
+                ++s_errors;
+            }
+        });
+        iom.stop();
+        AWCOTN_LOG_INFO(g_logger) << "bench_parse threads=" << threads << " time=" << used
+            << "us speedup=" << (double)serial_used / std::max<uint64_t>(used, 1)
+            << " cores=" << hw;
+    }
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_for();
+    test_reduce();
+    test_exception();
+    test_thread_caller();
+    bench_parse();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
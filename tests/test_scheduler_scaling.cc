@@ -0,0 +1,207 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include "awcotn/numa.h"
+#include <unistd.h>
+#include <sys/resource.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static const int s_roots = 64;
+static const int s_children = 2000;
+static std::atomic<uint64_t> s_done {0};
+static volatile uint64_t s_sink = 0;
+
+//少量计算, 模拟短任务
+static void work() {
+    uint64_t v = 0;
+    for(int i = 0; i < 200; ++i) {
+        v += i * i;
+    }
+    s_sink = s_sink + v;
+    ++s_done;
+}
+
+//根任务在工作线程内派生子任务, 子任务进入本线程的本地队列, 空闲线程需要窃取
+static void root() {
+    awcotn::Scheduler* sc = awcotn::Scheduler::GetThis();
+    for(int i = 0; i < s_children; ++i) {
+        sc->schedule(&work);
+    }
+    ++s_done;
+}
+
+static std::atomic<int> s_lastThread {-1};
+static std::atomic<int> s_pinErrors {0};
+
+//根任务把子任务指定到上一个根任务所在的线程, 既有投递给本线程的也有投递给其它线程的
+static void pinned_root() {
+    awcotn::Scheduler* sc = awcotn::Scheduler::GetThis();
+    int self = awcotn::GetThreadId();
+    int target = s_lastThread.exchange(self);
+    if(target == -1) {
+        target = self;
+    }
+    for(int i = 0; i < s_children; ++i) {
+        sc->schedule([target](){
+            if(awcotn::GetThreadId() != target) {
+                ++s_pinErrors;
+            }
+            work();
+        }, target);
+    }
+    ++s_done;
+}
+
+void bench(const char* name, void(*cb)(), int threads) {
+    s_done = 0;
+    s_lastThread = -1;
+    uint64_t begin = awcotn::GetCurrentUS();
+    {
+        awcotn::IOManager iom(threads, false);
+        for(int i = 0; i < s_roots; ++i) {
+            iom.schedule(cb);
+        }
+    }
+    uint64_t used = awcotn::GetCurrentUS() - begin;
+    AWCOTN_LOG_INFO(g_logger) << name << " threads=" << threads << " tasks=" << s_done
+        << " time=" << used << "us"
+        << " tasks/s=" << (uint64_t)(s_done * 1000000.0 / (used ? used : 1));
+}
+
+static uint64_t cpu_us() {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1000000ull + ru.ru_utime.tv_usec
+        + ru.ru_stime.tv_sec * 1000000ull + ru.ru_stime.tv_usec;
+}
+
+//没有IO的Scheduler, 空闲时工作线程应该休眠而不是空转
+void test_idle_cpu(int threads) {
+    s_done = 0;
+    awcotn::Scheduler sc(threads, false, "idle");
+    sc.start();
+    sc.schedule(&root);
+    //等待任务执行完, 进入空闲
+    while(s_done < (uint64_t)s_children + 1) {
+        usleep(1000);
+    }
+    usleep(10 * 1000);
+    uint64_t cpu = cpu_us();
+    uint64_t begin = awcotn::GetCurrentUS();
+    usleep(500 * 1000);
+    uint64_t idle_cpu = cpu_us() - cpu;
+    uint64_t wall = awcotn::GetCurrentUS() - begin;
+
+    //空闲后再提交任务, 检查能被唤醒
+    begin = awcotn::GetCurrentUS();
+    sc.schedule(&work);
+    while(s_done < (uint64_t)s_children + 2) {
+        usleep(100);
+    }
+    uint64_t wake_us = awcotn::GetCurrentUS() - begin;
+    sc.stop();
+    AWCOTN_LOG_INFO(g_logger) << "idle threads=" << threads << " cpu_us=" << idle_cpu
+        << " wall_us=" << wall << " wake_us=" << wake_us;
+}
+
+//弹性线程数: 突发的耗时任务使线程数增加, 空闲后退回最少线程数
+void test_elastic(int max_threads) {
+    awcotn::Config::Lookup<uint32_t>("scheduler.elastic.grow_wait_ms")->setValue(5);
+    awcotn::Config::Lookup<uint32_t>("scheduler.elastic.retire_idle_ms")->setValue(300);
+    s_done = 0;
+    awcotn::IOManager iom(1, false, "elastic", max_threads);
+    for(int i = 0; i < 64; ++i) {
+        iom.schedule([](){
+            //约5ms的计算
+            uint64_t begin = awcotn::GetCurrentUS();
+            while(awcotn::GetCurrentUS() - begin < 5000);
+            ++s_done;
+        });
+    }
+    while(s_done < 64) {
+        usleep(1000);
+    }
+    size_t busy_threads = iom.getThreadCount();
+    sleep(3);
+    AWCOTN_LOG_INFO(g_logger) << "elastic done=" << s_done
+        << " busy_threads=" << busy_threads
+        << " peak=" << iom.getPeakThreadCount()
+        << " idle_threads=" << iom.getThreadCount()
+        << " grow=" << iom.getThreadGrowCount()
+        << " retire=" << iom.getThreadRetireCount();
+}
+
+//绑定CPU后任务只在设置的CPU上执行
+void test_affinity(int threads) {
+    std::vector<int> online = awcotn::Numa::OnlineCpus();
+    std::vector<int> cpus(online.begin(), online.begin() + std::min<size_t>(2, online.size()));
+    std::atomic<int> errors {0};
+    s_done = 0;
+    {
+        awcotn::IOManager iom(threads, false, "affinity");
+        iom.setAffinity(cpus);
+        for(int i = 0; i < 1000; ++i) {
+            iom.schedule([&cpus, &errors](){
+                int cpu = sched_getcpu();
+                if(std::find(cpus.begin(), cpus.end(), cpu) == cpus.end()) {
+                    ++errors;
+                }
+                work();
+            });
+        }
+    }
+    AWCOTN_LOG_INFO(g_logger) << "affinity threads=" << threads << " cpus=" << cpus.size()
+        << " nodes=" << awcotn::Numa::NodeCount()
+        << " done=" << s_done << " errors=" << errors;
+}
+
+//后台任务积压时, 延迟敏感任务的排队时间应该远小于后台任务
+void test_priority(int threads) {
+    typedef awcotn::Scheduler S;
+    s_done = 0;
+    awcotn::IOManager iom(threads, false, "priority");
+    //约200us的后台任务, 一次性积压
+    for(int i = 0; i < 2000; ++i) {
+        iom.schedule([](){
+            uint64_t begin = awcotn::GetCurrentUS();
+            while(awcotn::GetCurrentUS() - begin < 200);
+            ++s_done;
+        }, -1, S::BACKGROUND);
+    }
+    //期间持续提交延迟敏感和普通任务
+    for(int i = 0; i < 200; ++i) {
+        iom.schedule(&work, -1, S::LATENCY);
+        iom.schedule(&work, -1, S::NORMAL);
+        usleep(1000);
+    }
+    while(s_done < 2000 + 400) {
+        usleep(1000);
+    }
+    const char* names[] = {"latency", "normal", "background"};
+    for(int i = 0; i < S::PRIORITY_COUNT; ++i) {
+        S::Priority p = (S::Priority)i;
+        AWCOTN_LOG_INFO(g_logger) << "priority threads=" << threads << " " << names[i]
+            << " wait_p50<=" << iom.getWaitPercentile(p, 50) << "us"
+            << " p99<=" << iom.getWaitPercentile(p, 99) << "us";
+    }
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(argc > 1) {
+        max_threads = atoi(argv[1]);
+    }
+    for(int i = 1; i <= max_threads; ++i) {
+        bench("spawn", &root, i);
+    }
+    for(int i = 1; i <= max_threads; ++i) {
+        bench("pinned", &pinned_root, i);
+    }
+    AWCOTN_LOG_INFO(g_logger) << "pinned errors=" << s_pinErrors;
+    test_idle_cpu(max_threads);
+    test_elastic(std::max(max_threads, 4));
+    test_affinity(std::max(max_threads, 2));
+    test_priority(max_threads);
+    return 0;
+}
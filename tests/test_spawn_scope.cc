@@ -0,0 +1,182 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <stdexcept>
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+//批量schedule之后等待全部完成, 在协程和普通线程中各等一次
+void test_wait_group() {
+    const int n = 50000;
+    std::atomic<int> ran {0};
+    awcotn::IOManager iom(4, false);
+    awcotn::WaitGroup wg;
+    std::vector<std::function<void()> > cbs;
+    for(int i = 0; i < n; ++i) {
+        cbs.push_back([&ran, &wg](){
+            ++ran;
+            wg.done();
+        });
+    }
+    wg.add(n);
+    iom.schedule(cbs.begin(), cbs.end());
+    awcotn::WaitGroup fiber_done(1);
+    iom.schedule([&](){
+        wg.wait();
+        if(ran != n) {
+            ++s_errors;
+        }
+        fiber_done.done();
+    });
+    wg.wait();
+    if(ran != n) {
+        ++s_errors;
+    }
+    fiber_done.wait();
+    iom.stop();
+}
+
+//栈上的WaitGroup, wait返回后立即析构
+void test_wait_group_lifetime() {
+    const int rounds = 5000;
+    awcotn::IOManager iom(4, false);
+    iom.schedule([&iom](){
+        for(int r = 0; r < rounds; ++r) {
+            awcotn::WaitGroup wg(4);
+            for(int i = 0; i < 4; ++i) {
+                iom.schedule([&wg](){ wg.done(); });
+            }
+            wg.wait();
+            if(wg.getCount() != 0) {
+                ++s_errors;
+            }
+        }
+    });
+    iom.stop();
+}
+
+void test_spawn() {
+    const int n = 50000;
+    awcotn::IOManager iom(4, false);
+    iom.schedule([&iom](){
+        std::atomic<int64_t> sum {0};
+        uint64_t begin = awcotn::GetCurrentUS();
+        {
+            awcotn::SpawnScope scope(&iom);
+            for(int i = 1; i <= n; ++i) {
+                scope.spawn([&sum, i](){ sum += i; });
+            }
+            scope.join();
+        }
+        uint64_t spawn_used = awcotn::GetCurrentUS() - begin;
+        if(sum != (int64_t)n * (n + 1) / 2) {
+            ++s_errors;
+        }
+
+        sum = 0;
+        begin = awcotn::GetCurrentUS();
+        awcotn::SpawnScope::Run([&sum](awcotn::SpawnScope& scope){
+            scope.spawnN(n, [&sum](size_t i){ sum += i + 1; });
+        });
+        uint64_t spawn_n_used = awcotn::GetCurrentUS() - begin;
+        if(sum != (int64_t)n * (n + 1) / 2) {
+            ++s_errors;
+        }
+        AWCOTN_LOG_INFO(g_logger) << "children=" << n << " spawn=" << spawn_used
+            << "us spawnN=" << spawn_n_used << "us";
+    });
+    iom.stop();
+}
+
+//子任务中嵌套作用域: 递归求和
+static int64_t tree_sum(awcotn::Scheduler* sc, int lo, int hi) {
+    if(hi - lo <= 64) {
+        int64_t s = 0;
+        for(int i = lo; i < hi; ++i) {
+            s += i;
+        }
+        return s;
+    }
+    int mid = lo + (hi - lo) / 2;
+    int64_t left = 0;
+    int64_t right = 0;
+    awcotn::SpawnScope::Run([&](awcotn::SpawnScope& scope){
+        scope.spawn([&](){ left = tree_sum(sc, lo, mid); });
+        right = tree_sum(sc, mid, hi);
+    }, sc);
+    return left + right;
+}
+
+void test_nested() {
+    const int n = 100000;
+    awcotn::IOManager iom(4, false);
+    iom.schedule([&iom](){
+        int64_t s = tree_sum(&iom, 0, n);
+        if(s != (int64_t)n * (n - 1) / 2) {
+            ++s_errors;
+        }
+    });
+    iom.stop();
+}
+
+void test_exception() {
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&iom](){
+        std::atomic<int> finished {0};
+        awcotn::SpawnScope scope(&iom);
+        for(int i = 0; i < 100; ++i) {
+            scope.spawn([i, &finished](){
+                if(i == 50) {
+                    throw std::runtime_error("child 50");
+                }
+                usleep(1000);
+                ++finished;
+            });
+        }
+        try {
+            scope.join();
+            ++s_errors;
+        } catch(const std::runtime_error& e) {
+            if(std::string(e.what()) != "child 50") {
+                ++s_errors;
+            }
+        }
+        //join返回时其余子任务都已经结束
+        if(finished != 99 || !scope.failed()) {
+            ++s_errors;
+        }
+        //异常已经取走, 再次join不抛出
+        scope.join();
+
+        //body抛出的异常同样在等待子任务之后抛出
+        std::atomic<bool> child_done {false};
+        try {
+            awcotn::SpawnScope::Run([&child_done](awcotn::SpawnScope& s){
+                s.spawn([&child_done](){
+                    usleep(5 * 1000);
+                    child_done = true;
+                });
+                throw std::logic_error("body");
+            }, &iom);
+            ++s_errors;
+        } catch(const std::logic_error&) {
+            if(!child_done) {
+                ++s_errors;
+            }
+        }
+    });
+    iom.stop();
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_wait_group();
+    test_wait_group_lifetime();
+    test_spawn();
+    test_nested();
+    test_exception();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/stack_allocator.h"
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+void test_reuse() {
+    void* a = awcotn::StackPool::Alloc(64 * 1024);
+    awcotn::StackPool::Dealloc(a, 64 * 1024);
+    void* b = awcotn::StackPool::Alloc(64 * 1024);
+    AWCOTN_LOG_INFO(g_logger) << "reuse=" << (a == b)
+        << " mapped=" << awcotn::StackPool::GetMappedCount();
+    awcotn::StackPool::Dealloc(b, 64 * 1024);
+}
+
+void test_fiber_churn() {
+    awcotn::Fiber::GetThis();
+    static const int s_count = 100000;
+    uint64_t begin = awcotn::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        awcotn::Fiber::ptr fiber(new awcotn::Fiber([](){}, 0, true));
+        fiber->call();
+    }
+    uint64_t used = awcotn::GetCurrentUS() - begin;
+    AWCOTN_LOG_INFO(g_logger) << "create+run+destroy " << s_count << " fibers: "
+        << used << "us, " << (used * 1000.0 / s_count) << "ns/fiber"
+        << " mapped=" << awcotn::StackPool::GetMappedCount();
+}
+
+int main(int argc, char** argv) {
+    //关闭system日志的debug输出, 避免Fiber构造析构日志影响计时
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::INFO);
+    test_reuse();
+    test_fiber_churn();
+
+    std::vector<awcotn::Thread::ptr> thrs;
+    for(int i = 0; i < 4; ++i) {
+        thrs.push_back(awcotn::Thread::ptr(new awcotn::Thread(&test_fiber_churn
+                        , "churn_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    AWCOTN_LOG_INFO(g_logger) << "after threads exit mapped=" << awcotn::StackPool::GetMappedCount()
+        << " global_cached=" << awcotn::StackPool::GetGlobalCachedCount();
+    return 0;
+}
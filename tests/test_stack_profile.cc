@@ -0,0 +1,104 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include "awcotn/stack_allocator.h"
+#include "awcotn/stack_profile.h"
+#include <string.h>
+#include <sstream>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_done {0};
+static const int s_count = 2000;
+
+//使用很少栈的回调
+void small_handler() {
+    char buf[512];
+    memset(buf, 0, sizeof(buf));
+    usleep(100);
+    ++s_done;
+}
+
+//使用约64K栈的回调
+void large_handler() {
+    char buf[64 * 1024];
+    memset(buf, 0, sizeof(buf));
+    usleep(100);
+    ++s_done;
+}
+
+void run_round(const char* name) {
+    s_done = 0;
+    uint64_t mapped = awcotn::StackPool::GetMappedCount();
+    {
+        awcotn::IOManager iom(2, false, name);
+        for(int i = 0; i < s_count; ++i) {
+            //每个lambda是不同的类型, 即不同的入口
+            if(i % 2) {
+                iom.schedule([](){ small_handler(); });
+            } else {
+                iom.schedule([](){ large_handler(); });
+            }
+        }
+    }
+    AWCOTN_LOG_INFO(g_logger) << name << " done=" << s_done
+        << " new_mapped_stacks=" << (awcotn::StackPool::GetMappedCount() - mapped);
+}
+
+//函数指针不能区分调用点: 浅的回调采样足够之后, 深的回调仍然使用默认栈大小
+//直接schedule, SpawnScope::spawn, Async和ParallelFor(std::function)都要覆盖
+void run_shared(const char* name, void (*submit)(awcotn::IOManager& iom, void (*fn)())) {
+    s_done = 0;
+    {
+        awcotn::IOManager iom(2, false, name);
+        submit(iom, &small_handler);
+    }
+    {
+        awcotn::IOManager iom(2, false, name);
+        submit(iom, &large_handler);
+    }
+    AWCOTN_LOG_INFO(g_logger) << name << " done=" << s_done;
+}
+
+void run_pointers() {
+    run_shared("schedule", [](awcotn::IOManager& iom, void (*fn)()){
+        for(int i = 0; i < s_count; ++i) {
+            iom.schedule(fn);
+        }
+    });
+    run_shared("spawn", [](awcotn::IOManager& iom, void (*fn)()){
+        awcotn::SpawnScope::Run([fn](awcotn::SpawnScope& scope){
+            for(int i = 0; i < s_count; ++i) {
+                scope.spawn(fn);
+            }
+        }, &iom);
+    });
+    run_shared("async", [](awcotn::IOManager& iom, void (*fn)()){
+        for(int i = 0; i < s_count; ++i) {
+            awcotn::Async(&iom, fn);
+        }
+    });
+    run_shared("parallel_for", [](awcotn::IOManager& iom, void (*fn)()){
+        std::function<void(size_t, size_t)> body = [fn](size_t lo, size_t hi){
+            for(size_t i = lo; i < hi; ++i) {
+                fn();
+            }
+        };
+        awcotn::ParallelFor(&iom, 0, s_count, 1, body);
+    });
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::INFO);
+    awcotn::Config::Lookup<bool>("fiber.stack_profile.adaptive")->setValue(true);
+
+    //第一轮: 样本不足, 使用默认栈并涂色采样
+    run_round("warmup");
+    //第二轮: 按入口使用建议栈大小
+    run_round("adaptive");
+    run_pointers();
+
+    std::stringstream ss;
+    awcotn::StackProfile::Dump(ss);
+    AWCOTN_LOG_INFO(g_logger) << "stack profile:" << std::endl << ss.str();
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <stdlib.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+//统计operator new的调用次数
+static std::atomic<uint64_t> s_allocs {0};
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static std::atomic<int> s_errors {0};
+
+void test_task() {
+    int moved = 0;
+    awcotn::Task t([&moved](){ ++moved; });
+    awcotn::Task t2(std::move(t));
+    if(t || !t2 || !t2.isInline()) {
+        ++s_errors;
+    }
+    t2();
+    //48字节的捕获内联保存, std::function需要分配
+    char buf[48] = {1};
+    uint64_t before = s_allocs;
+    awcotn::Task t3([buf, &moved](){ moved += buf[0]; });
+    t3();
+    uint64_t task_allocs = s_allocs - before;
+    if(moved != 2 || task_allocs != 0) {
+        ++s_errors;
+    }
+    before = s_allocs;
+    std::function<void()> f([buf, &moved](){ moved += buf[0]; });
+    f();
+    uint64_t function_allocs = s_allocs - before;
+
+    //只能移动的捕获
+    std::unique_ptr<int> up(new int(5));
+    int* raw = up.get();
+    struct MoveOnly {
+        std::unique_ptr<int> p;
+        int* expect;
+        void operator()() {
+            if(p.get() != expect) {
+                ++s_errors;
+            }
+        }
+    };
+    awcotn::Task t4(MoveOnly{std::move(up), raw});
+    awcotn::Task t5;
+    t5 = std::move(t4);
+    t5();
+    AWCOTN_LOG_INFO(g_logger) << "task sizeof=" << sizeof(awcotn::Task)
+        << " task_allocs=" << task_allocs << " function_allocs=" << function_allocs;
+}
+
+static const int s_count = 1000;
+static const int s_waves = 20;
+static std::atomic<int> s_done {0};
+
+//在工作线程内和线程外各提交一批带48字节捕获的任务
+void wave(awcotn::IOManager& iom) {
+    s_done = 0;
+    char payload[40] = {1};
+    iom.schedule([&iom, payload](){
+        for(int i = 0; i < s_count / 2; ++i) {
+            uint64_t tag = i;
+            iom.schedule([payload, tag](){
+                if(payload[0] != 1 || tag >= (uint64_t)s_count) {
+                    ++s_errors;
+                }
+                ++s_done;
+            });
+        }
+    });
+    for(int i = 0; i < s_count / 2; ++i) {
+        uint64_t tag = i;
+        iom.schedule([payload, tag](){
+            if(payload[0] != 1 || tag >= (uint64_t)s_count) {
+                ++s_errors;
+            }
+            ++s_done;
+        }, -1, awcotn::Scheduler::LATENCY);
+    }
+    while(s_done < s_count) {
+        usleep(100);
+    }
+}
+
+//预热之后队列深度不超过之前的峰值, 调度过程不应该再分配内存
+void test_schedule_allocs() {
+    awcotn::IOManager iom(2, false);
+    for(int i = 0; i < s_waves; ++i) {
+        wave(iom);
+    }
+    uint64_t before = s_allocs;
+    for(int i = 0; i < s_waves; ++i) {
+        wave(iom);
+    }
+    uint64_t allocs = s_allocs - before;
+    AWCOTN_LOG_INFO(g_logger) << "schedule tasks=" << s_waves * (s_count + 1)
+        << " allocs=" << allocs;
+}
+
+//不阻塞的回调在调度协程上执行, 与普通回调比较耗时
+void test_inline() {
+    static const int count = 20000;
+    std::atomic<int> wrong_fiber {0};
+    for(int run_inline = 0; run_inline < 2; ++run_inline) {
+        s_done = 0;
+        uint64_t begin = awcotn::GetCurrentUS();
+        {
+            awcotn::IOManager iom(1, false);
+            for(int i = 0; i < count; ++i) {
+                auto cb = [run_inline, &wrong_fiber](){
+                    bool on_main = awcotn::Fiber::GetThis().get() == awcotn::Scheduler::GetMainFiber();
+                    if(on_main != (bool)run_inline) {
+                        ++wrong_fiber;
+                    }
+                    ++s_done;
+                };
+                if(run_inline) {
+                    iom.scheduleInline(cb);
+                } else {
+                    iom.schedule(cb);
+                }
+            }
+            //不阻塞的定时器回调同样在调度协程上执行
+            iom.addTimer(10, [&wrong_fiber](){
+                if(awcotn::Fiber::GetThis().get() != awcotn::Scheduler::GetMainFiber()) {
+                    ++wrong_fiber;
+                }
+            }, false, true);
+        }
+        uint64_t used = awcotn::GetCurrentUS() - begin;
+        AWCOTN_LOG_INFO(g_logger) << (run_inline ? "inline" : "fiber") << " tasks=" << s_done
+            << " time=" << used << "us";
+    }
+    s_errors += wrong_fiber;
+}
+
+//循环定时器的回调比间隔慢时不会在两个线程上同时执行
+void test_recurring() {
+    struct Slow {
+        std::atomic<int>* inside;
+        std::atomic<int>* runs;
+        void operator()() {
+            if(++*inside != 1) {
+                ++s_errors;
+            }
+            ++*runs;
+            usleep(5 * 1000);
+            --*inside;
+        }
+    };
+    std::atomic<int> inside {0};
+    std::atomic<int> runs {0};
+    awcotn::IOManager iom(4, false);
+    awcotn::Timer::ptr timer = iom.addTimer(1, Slow{&inside, &runs}, true);
+    usleep(100 * 1000);
+    timer->cancel();
+    usleep(20 * 1000);
+    iom.stop();
+    if(inside != 0 || runs == 0) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "recurring runs=" << runs;
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    test_task();
+    test_schedule_allocs();
+    test_inline();
+    test_recurring();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
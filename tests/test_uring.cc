@@ -0,0 +1,356 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+static const char* backend_name(awcotn::IOManager::Backend b) {
+    return b == awcotn::IOManager::URING_BACKEND ? "io_uring" : "epoll";
+}
+
+//在hook的协程中创建监听socket, 返回端口
+static int listen_local(int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(fd, (sockaddr*)&addr, sizeof(addr)) || listen(fd, 1024)) {
+        ++s_errors;
+        return -1;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int connect_local(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool read_full(int fd, char* buf, size_t n) {
+    size_t off = 0;
+    while(off < n) {
+        ssize_t rt = read(fd, buf + off, n - off);
+        if(rt <= 0) {
+            return false;
+        }
+        off += rt;
+    }
+    return true;
+}
+
+/**
+ * @brief 回显: conns个连接各发送rounds条消息, 每条等待回显后再发下一条
+ * @return 用时(us)
+ */
+static uint64_t run_echo(awcotn::IOManager::Backend backend, int threads, int conns, int rounds
+                         ,size_t msg_size) {
+    awcotn::IOManager iom(threads, false, "echo", 0, backend);
+    if(iom.getBackend() != backend) {
+        AWCOTN_LOG_ERROR(g_logger) << "backend " << backend_name(backend) << " unavailable";
+        ++s_errors;
+        return 0;
+    }
+    std::atomic<uint64_t> begin {0};
+    std::atomic<uint64_t> used {0};
+    awcotn::WaitGroup wg(conns);
+    iom.schedule([&](){
+        int port = 0;
+        int lfd = listen_local(port);
+        iom.schedule([&, lfd](){
+            for(int i = 0; i < conns; ++i) {
+                int fd = accept(lfd, nullptr, nullptr);
+                if(fd < 0) {
+                    ++s_errors;
+                    break;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                iom.schedule([fd, msg_size](){
+                    std::vector<char> buf(msg_size);
+                    while(read_full(fd, &buf[0], msg_size)) {
+                        if(write(fd, &buf[0], msg_size) != (ssize_t)msg_size) {
+                            ++s_errors;
+                        }
+                    }
+                    close(fd);
+                });
+            }
+            close(lfd);
+        });
+        begin = awcotn::GetCurrentUS();
+        for(int i = 0; i < conns; ++i) {
+            iom.schedule([&, port](){
+                int fd = connect_local(port);
+                if(fd < 0) {
+                    ++s_errors;
+                    wg.done();
+                    return;
+                }
+                std::vector<char> buf(msg_size);
+                for(int j = 0; j < rounds; ++j) {
+                    memcpy(&buf[0], &j, sizeof(j));
+                    if(write(fd, &buf[0], msg_size) != (ssize_t)msg_size
+                            || !read_full(fd, &buf[0], msg_size)) {
+                        ++s_errors;
+                        break;
+                    }
+                    int v = 0;
+                    memcpy(&v, &buf[0], sizeof(v));
+                    if(v != j) {
+                        ++s_errors;
+                    }
+                }
+                close(fd);
+                wg.done();
+            });
+        }
+        wg.wait();
+        used = awcotn::GetCurrentUS() - begin;
+    });
+    iom.stop();
+    return used;
+}
+
+//SO_RCVTIMEO超时, close唤醒阻塞的读, 连接被拒绝
+void test_errors(awcotn::IOManager::Backend backend) {
+    awcotn::IOManager iom(2, false, "errors", 0, backend);
+    iom.schedule([&iom](){
+        int port = 0;
+        int lfd = listen_local(port);
+        int cfd = connect_local(port);
+        int sfd = accept(lfd, nullptr, nullptr);
+        if(cfd < 0 || sfd < 0) {
+            ++s_errors;
+            return;
+        }
+
+        timeval tv = {0, 100 * 1000};
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char c = 0;
+        uint64_t begin = awcotn::GetCurrentMS();
+        ssize_t rt = read(cfd, &c, 1);
+        uint64_t used = awcotn::GetCurrentMS() - begin;
+        if(rt != -1 || errno != ETIMEDOUT || used < 90 || used > 1000) {
+            AWCOTN_LOG_ERROR(g_logger) << "timeout rt=" << rt << " errno=" << errno
+                << " used=" << used;
+            ++s_errors;
+        }
+        //超时后连接仍然可用
+        if(write(sfd, "x", 1) != 1 || read(cfd, &c, 1) != 1 || c != 'x') {
+            ++s_errors;
+        }
+
+        //另一个协程close后阻塞的读返回
+        awcotn::WaitGroup wg(1);
+        iom.schedule([sfd, &wg](){
+            char c = 0;
+            ssize_t rt = read(sfd, &c, 1);
+            if(rt > 0) {
+                ++s_errors;
+            }
+            wg.done();
+        });
+        usleep(50 * 1000);
+        close(sfd);
+        wg.wait();
+        //对端关闭后读到0
+        if(read(cfd, &c, 1) != 0) {
+            ++s_errors;
+        }
+        close(cfd);
+        close(lfd);
+
+        //端口已经关闭, 连接被拒绝
+        if(connect_local(port) != -1 || errno != ECONNREFUSED) {
+            AWCOTN_LOG_ERROR(g_logger) << "connect errno=" << errno;
+            ++s_errors;
+        }
+    });
+    iom.stop();
+}
+
+//addEvent/cancelEvent/delEvent(io_uring后端为POLL_ADD/POLL_REMOVE)
+void test_events(awcotn::IOManager::Backend backend) {
+    awcotn::IOManager iom(1, false, "events", 0, backend);
+    iom.schedule([&iom](){
+        int fds[2];
+        if(pipe(fds)) {
+            ++s_errors;
+            return;
+        }
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        std::atomic<int> fired {0};
+        awcotn::WaitGroup wg(1);
+        iom.addEvent(fds[0], awcotn::IOManager::READ, [&](){
+            ++fired;
+            wg.done();
+        });
+        usleep(20 * 1000);
+        if(fired != 0) {
+            ++s_errors;
+        }
+        if(write(fds[1], "x", 1) != 1) {
+            ++s_errors;
+        }
+        wg.wait();
+
+        //cancelEvent立即触发, delEvent不触发
+        iom.addEvent(fds[0], awcotn::IOManager::READ, [&](){ ++fired; });
+        iom.addEvent(fds[1], awcotn::IOManager::WRITE, [&](){ fired += 10; });
+        iom.cancelEvent(fds[0], awcotn::IOManager::READ);
+        usleep(20 * 1000);
+        iom.addEvent(fds[0], awcotn::IOManager::READ, [&](){ fired += 100; });
+        iom.delEvent(fds[0], awcotn::IOManager::READ);
+        usleep(20 * 1000);
+        if(fired != 12) {
+            AWCOTN_LOG_ERROR(g_logger) << "fired=" << fired;
+            ++s_errors;
+        }
+        close(fds[0]);
+        close(fds[1]);
+
+        //反复删除后重新注册, 已删除的poll迟到的完成不能再注册出多余的poll
+        if(pipe(fds)) {
+            ++s_errors;
+            return;
+        }
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fired = 0;
+        for(int i = 0; i < 100; ++i) {
+            iom.addEvent(fds[0], awcotn::IOManager::READ, [&](){ ++fired; });
+            iom.delEvent(fds[0], awcotn::IOManager::READ);
+        }
+        iom.addEvent(fds[0], awcotn::IOManager::READ, [&](){ ++fired; });
+        usleep(20 * 1000);
+        iom.delEvent(fds[0], awcotn::IOManager::READ);
+        usleep(20 * 1000);
+        //没有遗留的poll持有读端, 关闭后写端得到EPIPE
+        close(fds[0]);
+        usleep(20 * 1000);
+        if(write(fds[1], "x", 1) != -1 || errno != EPIPE || fired != 0) {
+            AWCOTN_LOG_ERROR(g_logger) << "re-add errno=" << errno << " fired=" << fired;
+            ++s_errors;
+        }
+        close(fds[1]);
+    });
+    iom.stop();
+}
+
+//共享栈协程的读缓冲区在栈上, 挂起后共享栈被其它协程占用时数据仍然读到原来的缓冲区
+void test_shared_stack(awcotn::IOManager::Backend backend) {
+    awcotn::IOManager iom(1, false, "shared", 0, backend);
+    iom.schedule([&iom](){
+        int port = 0;
+        int lfd = listen_local(port);
+        int cfd = connect_local(port);
+        int sfd = accept(lfd, nullptr, nullptr);
+        if(cfd < 0 || sfd < 0) {
+            ++s_errors;
+            return;
+        }
+        awcotn::WaitGroup wg(1);
+        iom.schedule(awcotn::Fiber::ptr(new awcotn::Fiber([cfd, &wg](){
+            char buf[16] = {0};
+            ssize_t rt = recv(cfd, buf, sizeof(buf), 0);
+            if(rt != 5 || memcmp(buf, "hello", 5)) {
+                AWCOTN_LOG_ERROR(g_logger) << "shared stack recv rt=" << rt;
+                ++s_errors;
+            }
+            wg.done();
+        }, 0, false, true)));
+        //共享栈默认4个, 第4个之后的协程复用读协程的共享栈并改写整个栈帧
+        for(int i = 0; i < 4; ++i) {
+            iom.schedule(awcotn::Fiber::ptr(new awcotn::Fiber([](){
+                char junk[32 * 1024];
+                memset(junk, 0x5a, sizeof(junk));
+                usleep(1000);
+                memset(junk, 0x5a, sizeof(junk));
+            }, 0, false, true)));
+        }
+        usleep(50 * 1000);
+        if(send(sfd, "hello", 5, 0) != 5) {
+            ++s_errors;
+        }
+        wg.wait();
+        close(cfd);
+        close(sfd);
+        close(lfd);
+    });
+    iom.stop();
+}
+
+static uint64_t sys_time_us() {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_stime.tv_sec * 1000000ull + ru.ru_stime.tv_usec;
+}
+
+//同样的回显在两个后端上的用时和内核态时间
+void bench_echo() {
+    const int conns = 64;
+    const int rounds = 2000;
+    awcotn::IOManager::Backend backends[] = {awcotn::IOManager::EPOLL_BACKEND
+                                            ,awcotn::IOManager::URING_BACKEND};
+    for(int threads = 1; threads <= 2; ++threads) {
+        for(auto b : backends) {
+            uint64_t sys = sys_time_us();
+            uint64_t used = run_echo(b, threads, conns, rounds, 64);
+            sys = sys_time_us() - sys;
+            AWCOTN_LOG_INFO(g_logger) << "echo backend=" << backend_name(b) << " threads=" << threads
+                << " conns=" << conns << " messages=" << conns * rounds
+                << " time=" << used << "us sys=" << sys << "us"
+                << " qps=" << (uint64_t)(conns * rounds * 1000000.0 / std::max<uint64_t>(used, 1));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    signal(SIGPIPE, SIG_IGN);
+    {
+        //默认由配置决定
+        awcotn::IOManager iom(1, false);
+        if(iom.getBackend() != awcotn::IOManager::EPOLL_BACKEND) {
+            ++s_errors;
+        }
+        iom.stop();
+    }
+    awcotn::IOManager::Backend backends[] = {awcotn::IOManager::EPOLL_BACKEND
+                                            ,awcotn::IOManager::URING_BACKEND};
+    for(auto b : backends) {
+        run_echo(b, 2, 16, 100, 4096);
+        test_errors(b);
+        test_events(b);
+        test_shared_stack(b);
+        AWCOTN_LOG_INFO(g_logger) << backend_name(b) << " errors=" << s_errors;
+    }
+    bench_echo();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "awcotn/awcotn.h"
+#include "awcotn/iomanager.h"
+#include <unistd.h>
+
+static awcotn::Logger::ptr g_logger = AWCOTN_LOG_ROOT();
+
+static std::atomic<int> s_errors {0};
+
+static const int N = 100000;
+static awcotn::Fiber::ptr s_ping;
+static awcotn::Fiber::ptr s_pong;
+
+//两个协程轮流执行N次, direct为true时用YieldTo直接切换, 否则schedule后YieldToHold
+void ping_pong(bool direct) {
+    uint64_t begin = 0;
+    int turn = 0;
+    auto play = [&turn, direct](bool is_ping){
+        for(int i = 0; i < N; ++i) {
+            if(turn++ % 2 != (is_ping ? 0 : 1)) {
+                ++s_errors;
+            }
+            awcotn::Fiber::ptr other = is_ping ? s_pong : s_ping;
+            if(direct) {
+                if(!awcotn::Scheduler::YieldTo(other, false)) {
+                    ++s_errors;
+                }
+            } else {
+                awcotn::Scheduler::GetThis()->schedule(other);
+                awcotn::Fiber::YieldToHold();
+            }
+        }
+        //对方还停在最后一次让出, 唤醒它结束
+        if(is_ping) {
+            awcotn::Scheduler::GetThis()->schedule(s_pong);
+        }
+    };
+    {
+        awcotn::IOManager iom(1, false);
+        s_ping.reset(new awcotn::Fiber(std::bind(play, true)));
+        s_pong.reset(new awcotn::Fiber(std::bind(play, false)));
+        begin = awcotn::GetCurrentUS();
+        iom.schedule(s_ping);
+    }
+    uint64_t used = awcotn::GetCurrentUS() - begin;
+    if(s_ping->getState() != awcotn::Fiber::TERM
+            || s_pong->getState() != awcotn::Fiber::TERM) {
+        ++s_errors;
+    }
+    s_ping.reset();
+    s_pong.reset();
+    AWCOTN_LOG_INFO(g_logger) << (direct ? "yield_to" : "schedule") << " switches=" << 2 * N
+        << " time=" << used << "us ns/switch=" << used * 1000 / (2 * N);
+}
+
+//IOManager::call: 被调用协程挂起或结束后调用者继续执行
+void test_call() {
+    std::vector<int> order;
+    awcotn::IOManager iom(2, false);
+    iom.schedule([&order](){
+        awcotn::Fiber::ptr callee(new awcotn::Fiber([&order](){
+            order.push_back(1);
+            usleep(1000);
+            order.push_back(3);
+        }));
+        awcotn::IOManager::GetThis()->call(callee);
+        order.push_back(2);
+        //结束后再调用直接返回
+        awcotn::Fiber::ptr done(new awcotn::Fiber([&order](){
+            order.push_back(4);
+        }));
+        awcotn::IOManager::GetThis()->call(done);
+        if(done->getState() != awcotn::Fiber::TERM) {
+            ++s_errors;
+        }
+        awcotn::IOManager::GetThis()->call(done);
+        order.push_back(5);
+    });
+    iom.stop();
+    //callee在usleep中挂起时调用者已经继续执行
+    std::vector<int> expect = {1, 2, 4, 5, 3};
+    if(order != expect) {
+        ++s_errors;
+    }
+    AWCOTN_LOG_INFO(g_logger) << "call order size=" << order.size();
+}
+
+//共享栈协程之间不能直接切换, 退化为schedule
+void test_shared_stack() {
+    std::atomic<int> ran {0};
+    awcotn::IOManager iom(1, false);
+    awcotn::Fiber::ptr next(new awcotn::Fiber([&ran](){ ++ran; }, 0, false, true));
+    awcotn::Fiber::ptr first(new awcotn::Fiber([&ran, next](){
+        ++ran;
+        if(awcotn::Scheduler::YieldTo(next)) {
+            ++s_errors;
+        }
+    }, 0, false, true));
+    iom.schedule(first);
+    iom.stop();
+    if(ran != 2) {
+        ++s_errors;
+    }
+}
+
+int main(int argc, char** argv) {
+    AWCOTN_LOG_NAME("system")->setLevel(awcotn::LogLevel::WARN);
+    ping_pong(false);
+    ping_pong(true);
+    test_call();
+    test_shared_stack();
+    AWCOTN_LOG_INFO(g_logger) << "errors=" << s_errors;
+    return 0;
+}